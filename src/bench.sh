@@ -0,0 +1,154 @@
+#!/bin/sh
+#
+# bench.sh - time every copy mode of dvdbackup against generated discs
+#
+# Usage: bench.sh DVDBACKUP MKFIXTURE [OUTPUT.json]
+#
+# Builds a few fixtures with mkfixture, runs each copy mode against each of
+# them BENCH_RUNS times and writes the fastest run of every pair as JSON:
+# MiB/s, wall, user and system time, peak RSS and, when strace is installed,
+# system call counts from one extra traced run. The fixtures are read through
+# the page cache, so this measures dvdbackup and libdvdread, not the drive.
+#
+# BENCH_RUNS     runs per mode and fixture (default 3)
+# BENCH_DIR      where fixtures and copies go (default a new directory in /tmp)
+# BENCH_SCALE    multiplies the VOBUs per cell of every fixture (default 1)
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+set -e
+
+if [ $# -lt 2 ]; then
+	echo "Usage: $0 DVDBACKUP MKFIXTURE [OUTPUT.json]" >&2
+	exit 1
+fi
+
+dvdbackup=$1
+mkfixture=$2
+runs=${BENCH_RUNS:-3}
+scale=${BENCH_SCALE:-1}
+revision=$(git -C "$(dirname "$0")" describe --always --dirty 2>/dev/null || echo unknown)
+output=${3:-bench-$revision.json}
+
+if [ -n "$BENCH_DIR" ]; then
+	work=$BENCH_DIR
+	mkdir -p "$work"
+else
+	work=$(mktemp -d /tmp/dvdbackup-bench.XXXXXX)
+	trap 'rm -rf "$work"' EXIT
+fi
+
+# name, then mkfixture options
+fixtures="plain:-T 2 -t 2 -c 6 -v $((40 * scale)) -b 64 -d 0
+angles:-T 1 -t 2 -p 2 -c 4 -a 3 -v $((40 * scale)) -b 64 -d 0
+decoys:-T 2 -t 2 -c 6 -v $((40 * scale)) -b 64 -d 24"
+
+# name, then dvdbackup options
+modes="mirror:-M
+titleset:-T 1
+feature:-F
+chapters:-t 1 -s 1 -e 2
+unused:-M -r u"
+
+# json_field FILE KEY: a number from the --stats-json output
+json_field() {
+	sed -n "s/^  \"$2\": \([0-9.]*\),*$/\1/p" "$1"
+}
+
+# strace -c table to a JSON object of calls per system call
+syscall_counts() {
+	awk '
+		$NF == "total" { printf "%s\"total\": %s", sep, $4; exit }
+		$1 ~ /^[0-9.]+$/ && $4 ~ /^[0-9]+$/ { printf "%s\"%s\": %s", sep, $NF, $4; sep = ", " }
+	' "$1"
+}
+
+# the fixture: an ISO image if genisoimage is there, else the directory
+make_fixture() {
+	rm -rf "$work/$1"
+	# shellcheck disable=SC2086
+	if command -v genisoimage >/dev/null 2>&1; then
+		"$mkfixture" -s 1 $2 --iso="$work/$1.iso" "$work/$1" >&2
+		echo "$work/$1.iso"
+	else
+		"$mkfixture" -s 1 $2 "$work/$1" >&2
+		echo "$work/$1"
+	fi
+}
+
+first=1
+{
+	printf '{\n  "revision": "%s",\n  "date": "%s",\n  "host": "%s",\n  "runs": %s,\n  "results": [' \
+		"$revision" "$(date -u +%Y-%m-%dT%H:%M:%SZ)" "$(uname -srm)" "$runs"
+
+	while IFS=: read -r fixture fixture_options; do
+		input=$(make_fixture "$fixture" "$fixture_options")
+
+		while IFS=: read -r mode mode_options; do
+			best=
+			best_wall=
+			i=0
+			while [ $i -lt "$runs" ]; do
+				rm -rf "$work/out"
+				# shellcheck disable=SC2086
+				if ! "$dvdbackup" -i "$input" -o "$work/out" -n BENCH $mode_options \
+						--stats-json="$work/stats.$i.json" </dev/null >/dev/null 2>"$work/stderr"; then
+					echo "$fixture/$mode failed:" >&2
+					cat "$work/stderr" >&2
+					exit 1
+				fi
+				wall=$(json_field "$work/stats.$i.json" wall_s)
+				if [ -z "$best" ] || awk "BEGIN { exit !($wall < $best_wall) }"; then
+					best=$work/stats.$i.json
+					best_wall=$wall
+				fi
+				i=$((i + 1))
+			done
+
+			syscalls=null
+			if command -v strace >/dev/null 2>&1; then
+				rm -rf "$work/out"
+				# shellcheck disable=SC2086
+				strace -f -c -o "$work/strace" "$dvdbackup" -i "$input" -o "$work/out" -n BENCH \
+					$mode_options </dev/null >/dev/null 2>&1
+				syscalls="{ $(syscall_counts "$work/strace") }"
+			fi
+
+			read_bytes=$(json_field "$best" bytes_read)
+			[ $first -eq 1 ] || printf ','
+			first=0
+			printf '\n    { "fixture": "%s", "mode": "%s", "options": "%s",\n' "$fixture" "$mode" "$mode_options"
+			printf '      "mib_per_s": %s, "wall_s": %s, "user_s": %s, "system_s": %s,\n' \
+				"$(awk "BEGIN { printf \"%.2f\", $best_wall == 0 ? 0 : $read_bytes / 1048576 / $best_wall }")" \
+				"$best_wall" "$(json_field "$best" user_s)" "$(json_field "$best" system_s)"
+			printf '      "max_rss_kib": %s, "bytes_read": %s, "bytes_written": %s,\n' \
+				"$(json_field "$best" max_rss_kib)" "$read_bytes" "$(json_field "$best" bytes_written)"
+			printf '      "read_calls": %s, "write_calls": %s, "blocks_skipped": %s,\n' \
+				"$(json_field "$best" read_calls)" "$(json_field "$best" write_calls)" \
+				"$(json_field "$best" blocks_skipped)"
+			printf '      "read_size_kib": %s, "read_size_changes": %s,\n' \
+				"$(json_field "$best" read_size_kib)" "$(json_field "$best" read_size_changes)"
+			printf '      "syscalls": %s }' "$syscalls"
+		done <<-EOF
+		$modes
+		EOF
+	done <<-EOF
+	$fixtures
+	EOF
+
+	printf '\n  ]\n}\n'
+} > "$output.tmp"
+
+mv "$output.tmp" "$output"
+echo "Wrote $output"
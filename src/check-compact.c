@@ -0,0 +1,233 @@
+/*
+ * check-compact - check a copy made with --compact against its source
+ *
+ * Usage: check-compact ORIGINAL COPY
+ *
+ * Both are opened with libdvdread. In the title VOBs of every title set,
+ * each cell of each PGC must hold the same sectors in the copy, at the
+ * addresses the copy's IFO gives, as in the original at the original's
+ * addresses. NAV packs must carry their new logical block number, and the
+ * next and previous VOBU in their search information must be NAV packs
+ * too. Every other sector must be unchanged. The cell address table and
+ * the VOBU address map of the copy must point at NAV packs as well.
+ *
+ * Exits 0 if the copy checks out and 1 if not; run by make check.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+/* C standard libraries */
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* libdvdread */
+#include <dvdread/dvd_reader.h>
+#include <dvdread/ifo_read.h>
+
+/* offsets in a NAV pack, as in compact.c */
+#define NAV_PCI_LBN 0x2D
+#define NAV_DSI_LBN 0x40B
+#define NAV_VOBU_SRI 0x4F1
+
+/* next and previous VOBU in the search information */
+#define SRI_NEXT 20
+#define SRI_PREVIOUS 21
+#define SRI_VALID 0x80000000u
+#define SRI_OFFSET 0x3FFFFFFFu
+
+/* mismatches printed before the rest are only counted */
+#define MAX_REPORTED 20
+
+static int errors = 0;
+static long cells = 0;
+
+
+static uint32_t get32(const unsigned char *p) {
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+/* pack start, then a private stream 2 PCI packet and a DSI packet */
+static int is_nav(const unsigned char *p) {
+	return get32(p) == 0x000001BA && get32(p + 0x26) == 0x000001BF && p[0x2C] == 0x00
+		&& get32(p + 0x400) == 0x000001BF && p[0x406] == 0x01;
+}
+
+static void mismatch(int title_set, const char *fmt, ...) {
+	va_list ap;
+
+	if (errors++ >= MAX_REPORTED) {
+		return;
+	}
+	fprintf(stderr, "check-compact: title set %d: ", title_set);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+}
+
+static int read_block(dvd_file_t *file, uint32_t sector, unsigned char *block) {
+	return DVDReadBlocks(file, sector, 1, block) == 1;
+}
+
+
+/* The copy must have a NAV pack at sector that knows where it is. */
+static void check_nav(int title_set, dvd_file_t *copy, uint32_t sector, const char *what) {
+	unsigned char block[DVD_VIDEO_LB_LEN];
+
+	if (!read_block(copy, sector, block) || !is_nav(block)) {
+		mismatch(title_set, "%s at %u is not a NAV pack", what, sector);
+	} else if (get32(block + NAV_PCI_LBN) != sector || get32(block + NAV_DSI_LBN) != sector) {
+		mismatch(title_set, "the NAV pack at %u gives its block as %u and %u", sector,
+				get32(block + NAV_PCI_LBN), get32(block + NAV_DSI_LBN));
+	}
+}
+
+
+static void check_cell(int title_set, dvd_file_t *original, dvd_file_t *copy,
+		const cell_playback_t *from, const cell_playback_t *to) {
+	unsigned char a[DVD_VIDEO_LB_LEN], b[DVD_VIDEO_LB_LEN];
+	uint32_t i, sector, sri;
+
+	cells++;
+	if (to->last_sector - to->first_sector != from->last_sector - from->first_sector) {
+		mismatch(title_set, "cell %u-%u became %u-%u", from->first_sector, from->last_sector,
+				to->first_sector, to->last_sector);
+		return;
+	}
+
+	for (i = 0; i <= from->last_sector - from->first_sector; i++) {
+		sector = to->first_sector + i;
+		if (!read_block(original, from->first_sector + i, a) || !read_block(copy, sector, b)) {
+			mismatch(title_set, "cannot read %u or its copy at %u", from->first_sector + i, sector);
+			return;
+		}
+		if (!is_nav(a)) {
+			if (memcmp(a, b, DVD_VIDEO_LB_LEN) != 0) {
+				mismatch(title_set, "%u differs from its copy at %u", from->first_sector + i, sector);
+			}
+			continue;
+		}
+
+		check_nav(title_set, copy, sector, "a VOBU start");
+		sri = get32(b + NAV_VOBU_SRI + SRI_NEXT * 4);
+		if ((sri & SRI_VALID) && (sri & SRI_OFFSET) != SRI_OFFSET) {
+			check_nav(title_set, copy, sector + (sri & SRI_OFFSET), "the VOBU after one");
+		}
+		sri = get32(b + NAV_VOBU_SRI + SRI_PREVIOUS * 4);
+		if ((sri & SRI_VALID) && (sri & SRI_OFFSET) != SRI_OFFSET) {
+			check_nav(title_set, copy, sector - (sri & SRI_OFFSET), "the VOBU before one");
+		}
+	}
+}
+
+
+static void check_title_set(dvd_reader_t *original_dvd, dvd_reader_t *copy_dvd, int title_set) {
+	ifo_handle_t *from, *to;
+	dvd_file_t *original, *copy;
+	pgc_t *a, *b;
+	uint32_t nr;
+	uint32_t i;
+	int j;
+
+	from = ifoOpen(original_dvd, title_set);
+	to = ifoOpen(copy_dvd, title_set);
+	original = DVDOpenFile(original_dvd, title_set, DVD_READ_TITLE_VOBS);
+	copy = DVDOpenFile(copy_dvd, title_set, DVD_READ_TITLE_VOBS);
+	if (from == NULL || to == NULL || original == NULL || copy == NULL
+			|| from->vts_pgcit == NULL || to->vts_pgcit == NULL) {
+		mismatch(title_set, "cannot open the IFO or the title VOBs");
+	} else if (to->vts_pgcit->nr_of_pgci_srp != from->vts_pgcit->nr_of_pgci_srp) {
+		mismatch(title_set, "%d PGCs became %d", from->vts_pgcit->nr_of_pgci_srp, to->vts_pgcit->nr_of_pgci_srp);
+	} else {
+		for (i = 0; i < from->vts_pgcit->nr_of_pgci_srp; i++) {
+			a = from->vts_pgcit->pgci_srp[i].pgc;
+			b = to->vts_pgcit->pgci_srp[i].pgc;
+			if (a->nr_of_cells != b->nr_of_cells) {
+				mismatch(title_set, "PGC %u: %d cells became %d", i + 1, a->nr_of_cells, b->nr_of_cells);
+				continue;
+			}
+			for (j = 0; j < a->nr_of_cells; j++) {
+				check_cell(title_set, original, copy, &a->cell_playback[j], &b->cell_playback[j]);
+			}
+		}
+
+		if (to->vts_c_adt != NULL) {
+			nr = (to->vts_c_adt->last_byte + 1 - C_ADT_SIZE) / sizeof(cell_adr_t);
+			for (i = 0; i < nr; i++) {
+				check_nav(title_set, copy, to->vts_c_adt->cell_adr_table[i].start_sector, "a cell address");
+			}
+		}
+		if (to->vts_vobu_admap != NULL) {
+			nr = (to->vts_vobu_admap->last_byte + 1 - VOBU_ADMAP_SIZE) / 4;
+			for (i = 0; i < nr; i++) {
+				check_nav(title_set, copy, to->vts_vobu_admap->vobu_start_sectors[i], "a VOBU address");
+			}
+		}
+	}
+
+	if (copy != NULL) {
+		DVDCloseFile(copy);
+	}
+	if (original != NULL) {
+		DVDCloseFile(original);
+	}
+	if (to != NULL) {
+		ifoClose(to);
+	}
+	if (from != NULL) {
+		ifoClose(from);
+	}
+}
+
+
+int main(int argc, char *argv[]) {
+	dvd_reader_t *original_dvd, *copy_dvd;
+	ifo_handle_t *vmg;
+	int nr_of_title_sets;
+	int i;
+
+	if (argc != 3) {
+		fprintf(stderr, "Usage: %s ORIGINAL COPY\n", argv[0]);
+		return 1;
+	}
+
+	if ((original_dvd = DVDOpen(argv[1])) == NULL || (copy_dvd = DVDOpen(argv[2])) == NULL) {
+		fprintf(stderr, "check-compact: cannot open %s or %s\n", argv[1], argv[2]);
+		return 1;
+	}
+	if ((vmg = ifoOpen(original_dvd, 0)) == NULL) {
+		fprintf(stderr, "check-compact: cannot read VIDEO_TS.IFO of %s\n", argv[1]);
+		return 1;
+	}
+	nr_of_title_sets = vmg->vmgi_mat->vmg_nr_of_title_sets;
+	ifoClose(vmg);
+
+	for (i = 1; i <= nr_of_title_sets; i++) {
+		check_title_set(original_dvd, copy_dvd, i);
+	}
+
+	DVDClose(copy_dvd);
+	DVDClose(original_dvd);
+
+	if (errors > MAX_REPORTED) {
+		fprintf(stderr, "check-compact: %d more mismatches\n", errors - MAX_REPORTED);
+	}
+	printf("check-compact: %ld cells in %d title sets, %d mismatches\n", cells, nr_of_title_sets, errors);
+	return errors > 0;
+}
@@ -0,0 +1,308 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * How many blocks the copy loops ask for per read. A drive may stall on
+ * large requests that an image file or a network mount reads fastest, so
+ * instead of one fixed size the size is searched for while copying.
+ *
+ * The sizes tried are a ladder from the lower bound of --read-size,
+ * doubling, up to the upper bound. Every CHUNK_WINDOW reads of one size make
+ * a measurement of its throughput, the blocks read over the time
+ * DVDReadBlocks took. The copy stays at one size, its home, and tries each
+ * neighbour on the ladder that has not been measured yet, larger first,
+ * coming home after every try. Once both are measured the fastest of the
+ * three becomes home. After CHUNK_SETTLE measurements at home the
+ * neighbours are forgotten and tried again, because drives read the outer
+ * part of a disc faster.
+ *
+ * Only reads of the whole current size count. Reads cut short by the end
+ * of a file or a run of unused sectors say little about the size, and
+ * failed reads even less.
+ *
+ * Near damage the drive spends its whole retry budget on every request, so
+ * after a read error the size is capped at what failed over CHUNK_DECREASE
+ * and grows back by a CHUNK_INCREASE-th of the current size with every
+ * read that works. Good parts of the disc are read at full size, bad ones
+ * a few blocks at a time.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+/* C standard libraries */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* libdvdread */
+#include <dvdread/dvd_reader.h>
+
+/* internationalisation */
+#include "gettext.h"
+#define _(String) gettext(String)
+
+#include "dvdbackup.h"
+#include "dvdlogger.h"
+#include "chunk.h"
+#include "probes.h"
+#include "stats.h"
+
+/* reads of the current size per measurement */
+#define CHUNK_WINDOW 8
+/* measurements before the neighbours are tried again */
+#define CHUNK_SETTLE 32
+/* a read this slow ends the measurement at once, in microseconds */
+#define CHUNK_STALL_US 1000000L
+
+/* after a read error, what failed over this */
+#define CHUNK_DECREASE 8
+/* reads that work before the size is back from a read error */
+#define CHUNK_INCREASE 16
+
+/* 1, 2, 4 ... CHUNK_LIMIT_BLOCKS and an upper bound in between */
+#define CHUNK_MAX_LEVELS 17
+
+typedef struct {
+	int blocks;
+	double rate;	/* blocks per microsecond, 0 while not measured */
+} chunk_level_t;
+
+static int min_blocks = CHUNK_MIN_BLOCKS;
+static int max_blocks = CHUNK_MAX_BLOCKS;
+
+static chunk_level_t levels[CHUNK_MAX_LEVELS];
+static int nr_of_levels = 0;
+/* the size in use, which is home or one of its neighbours */
+static int level = 0;
+static int home = 0;
+
+/* the measurement under way */
+static int window_reads = 0;
+static uint64_t window_blocks = 0;
+static uint64_t window_us = 0;
+/* measurements at home since it became home */
+static int settled = 0;
+/* blocks per read since the last read error, 0 when there is no cap */
+static int cap = 0;
+
+static unsigned char *buffer = NULL;
+static unsigned char *zero_buffer = NULL;
+
+
+/* KiB to blocks; 0 for anything that is not a positive number of blocks */
+static int chunk_kib(const char *arg, char **end) {
+	long kib = strtol(arg, end, 10);
+
+	if (*end == arg || kib < 2 || kib % 2 != 0 || kib / 2 > CHUNK_LIMIT_BLOCKS) {
+		return 0;
+	}
+
+	return kib / 2;
+}
+
+/* Take the bounds from --read-size=KIB or --read-size=MIN-MAX. Returns 0
+ * on success. */
+int chunk_parse(const char *arg) {
+	char *end;
+	int min, max;
+
+	if ((min = chunk_kib(arg, &end)) == 0) {
+		return 1;
+	}
+	max = min;
+	if (*end == '-' && (max = chunk_kib(end + 1, &end)) == 0) {
+		return 1;
+	}
+	if (*end != '\0' || max < min) {
+		return 1;
+	}
+
+	min_blocks = min;
+	max_blocks = max;
+	return 0;
+}
+
+static void chunk_set_level(int new_level) {
+	if (new_level != level) {
+		if (verbose > 0) {
+			XLog3(pApp, _("Reading %d KiB at a time"), levels[new_level].blocks * DVD_VIDEO_LB_LEN / 1024);
+		}
+		PROBE3(read__size, levels[level].blocks, levels[new_level].blocks,
+				(long)(levels[level].rate * 1e6));
+		STATS_ADD(read_size_changes, 1);
+	}
+	level = new_level;
+	STATS_SET(read_size_blocks, levels[level].blocks);
+}
+
+/* Build the ladder and allocate the buffers for the largest size. Returns 0
+ * on success. */
+int chunk_init(void) {
+	int blocks;
+
+	nr_of_levels = 0;
+	for (blocks = min_blocks; blocks < max_blocks; blocks *= 2) {
+		levels[nr_of_levels].blocks = blocks;
+		levels[nr_of_levels].rate = 0;
+		nr_of_levels++;
+	}
+	levels[nr_of_levels].blocks = max_blocks;
+	levels[nr_of_levels].rate = 0;
+	nr_of_levels++;
+
+	home = 0;
+	while (home + 1 < nr_of_levels && levels[home + 1].blocks <= CHUNK_START_BLOCKS) {
+		home++;
+	}
+	level = home;
+	settled = 0;
+	cap = 0;
+	chunk_set_level(home);
+	STATS_SET(read_size_min_blocks, min_blocks);
+	STATS_SET(read_size_max_blocks, max_blocks);
+
+	buffer = malloc((size_t)max_blocks * DVD_VIDEO_LB_LEN);
+	zero_buffer = calloc(max_blocks, DVD_VIDEO_LB_LEN);
+	if (buffer == NULL || zero_buffer == NULL) {
+		fprintf(stderr, _("Out of memory for %d KiB read buffers\n"), max_blocks * DVD_VIDEO_LB_LEN / 1024);
+		chunk_free();
+		return 1;
+	}
+
+	return 0;
+}
+
+/* blocks to ask for next */
+int chunk_size(void) {
+	if (cap > 0 && cap < levels[level].blocks) {
+		return cap;
+	}
+
+	return levels[level].blocks;
+}
+
+/* the most chunk_size will ever return */
+int chunk_max(void) {
+	return max_blocks;
+}
+
+/* chunk_max blocks to read into */
+unsigned char* chunk_buffer(void) {
+	return buffer;
+}
+
+/* chunk_max blocks of zeros to pad with */
+unsigned char* chunk_zero_buffer(void) {
+	return zero_buffer;
+}
+
+/* the size to measure next */
+static int chunk_next_level(void) {
+	int best = home;
+
+	if (home + 1 < nr_of_levels && levels[home + 1].rate == 0) {
+		return home + 1;
+	}
+	if (home > 0 && levels[home - 1].rate == 0) {
+		return home - 1;
+	}
+
+	if (home > 0 && levels[home - 1].rate > levels[best].rate) {
+		best = home - 1;
+	}
+	if (home + 1 < nr_of_levels && levels[home + 1].rate > levels[best].rate) {
+		best = home + 1;
+	}
+	if (best != home) {
+		home = best;
+		settled = 0;
+	} else if (++settled >= CHUNK_SETTLE) {
+		if (home > 0) {
+			levels[home - 1].rate = 0;
+		}
+		if (home + 1 < nr_of_levels) {
+			levels[home + 1].rate = 0;
+		}
+		settled = 0;
+	}
+
+	return home;
+}
+
+/* Tell how a read of asked blocks went: result blocks read or -1, in us
+ * microseconds. */
+void chunk_record(int asked, int result, long us) {
+	double rate;
+
+	if (result != asked) {
+		/* the measurement would straddle the damage */
+		window_reads = 0;
+		window_blocks = 0;
+		window_us = 0;
+		return;
+	}
+
+	if (cap > 0) {
+		cap += (levels[level].blocks + CHUNK_INCREASE - 1) / CHUNK_INCREASE;
+		if (cap >= levels[level].blocks) {
+			cap = 0;
+		}
+	}
+	if (asked != levels[level].blocks) {
+		return;
+	}
+
+	window_reads++;
+	window_blocks += result;
+	window_us += us > 0 ? us : 1;
+	if (window_reads < CHUNK_WINDOW && us < CHUNK_STALL_US) {
+		return;
+	}
+
+	rate = (double)window_blocks / window_us;
+	window_reads = 0;
+	window_blocks = 0;
+	window_us = 0;
+
+	/* half the old measurement, so one hiccup does not decide */
+	if (levels[level].rate > 0) {
+		levels[level].rate = (levels[level].rate + rate) / 2;
+	} else {
+		levels[level].rate = rate;
+	}
+
+	chunk_set_level(chunk_next_level());
+}
+
+/* After asked blocks could not all be read, read at most asked over
+ * CHUNK_DECREASE blocks but no fewer than floor until the reads work
+ * again. */
+void chunk_error(int asked, int floor) {
+	cap = asked / CHUNK_DECREASE;
+	if (cap < floor) {
+		cap = floor;
+	}
+	if (cap < 1) {
+		cap = 1;
+	}
+	PROBE2(read__cap, asked, cap);
+}
+
+void chunk_free(void) {
+	free(buffer);
+	free(zero_buffer);
+	buffer = NULL;
+	zero_buffer = NULL;
+}
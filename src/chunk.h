@@ -0,0 +1,22 @@
+#ifndef CHUNK_H_
+#define CHUNK_H_
+
+/* default bounds of --read-size, in DVD logical blocks */
+#define CHUNK_MIN_BLOCKS 32
+#define CHUNK_MAX_BLOCKS 4096
+/* where the search starts, the old fixed buffer size */
+#define CHUNK_START_BLOCKS 512
+/* largest --read-size accepted */
+#define CHUNK_LIMIT_BLOCKS 32768
+
+int chunk_parse(const char *arg);
+int chunk_init(void);
+int chunk_size(void);
+int chunk_max(void);
+unsigned char* chunk_buffer(void);
+unsigned char* chunk_zero_buffer(void);
+void chunk_record(int asked, int result, long us);
+void chunk_error(int asked, int floor);
+void chunk_free(void);
+
+#endif /* CHUNK_H_ */
@@ -0,0 +1,583 @@
+/* compact.c.
+ Support for compacted backups, which physically drop the sectors of a VOB set that no PGC references. The kept ranges are renumbered consecutively, and every sector address in the IFO that points into the VOBs (cell playback, cell address table, VOBU address map and time maps) as well as the logical block number in each NAV pack is rewritten to match.
+ The relative pointers in the NAV packs (VOBU search information, angle and interleaved unit addresses) shrink by the sectors dropped between the pack and their target. A target inside a dropped range moves to the first kept sector after it, which is the start of a cell and so of a VOBU.
+ Title sets start earlier on a compacted disc by what was dropped before them, so the start sectors in the title search pointer table of VIDEO_TS.IFO move too.
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <glib.h>
+
+#include <dvdread/dvd_reader.h>
+
+#include "find-sector.h"
+#include "compact.h"
+
+/* offsets in the VMGI_MAT of VIDEO_TS.IFO */
+#define VMG_LAST_SECTOR		0x0C
+#define VMG_NR_OF_TITLE_SETS	0x3E
+#define VMG_FIRST_PLAY_PGC	0x84
+#define VMG_TT_SRPT		0xC4
+#define VMGM_PGCI_UT		0xC8
+#define VMGM_C_ADT		0xD8
+#define VMGM_VOBU_ADMAP		0xDC
+
+/* offsets in the VTSI_MAT of VTS_XX_0.IFO */
+#define VTS_LAST_SECTOR		0x0C
+#define VTSM_VOBS		0xC0
+#define VTSTT_VOBS		0xC4
+#define VTS_PGCIT		0xCC
+#define VTSM_PGCI_UT		0xD0
+#define VTS_TMAPT		0xD4
+#define VTSM_C_ADT		0xD8
+#define VTSM_VOBU_ADMAP		0xDC
+#define VTS_C_ADT		0xE0
+#define VTS_VOBU_ADMAP		0xE4
+
+/* offsets in a PGC and its cell playback entries */
+#define PGC_NR_OF_CELLS		0x03
+#define PGC_CELL_PLAYBACK	0xE8
+#define PGC_SIZE		0xEC
+#define CELL_PLAYBACK_SIZE	24
+
+/* offsets of a title search pointer and its fields */
+#define TT_SRPT_ENTRIES		8
+#define TT_SRPT_SIZE		12
+#define TT_TITLE_SET_NR		6
+#define TT_TITLE_SET_ST_SECTOR	8
+
+/* offsets of the logical block number of a NAV pack in its PCI and DSI */
+#define NAV_PCI_LBN		0x2D
+#define NAV_DSI_LBN		0x40B
+
+/* relative addresses in the PCI and DSI of a NAV pack */
+#define NAV_NSML_AGLI		0x69	/* 9 angles, 4 bytes each */
+#define NAV_ILVU_SA		0x42D	/* start of the next interleaved unit */
+#define NAV_SML_AGLI		0x4BB	/* 9 angles, 4 byte address and 2 byte size */
+#define NAV_VOBU_SRI		0x4F1	/* see below */
+#define NAV_AGLI_ANGLES		9
+
+/* the VOBU search information: next video VOBU, 19 forward, next and
+ * previous VOBU, 19 backward, previous video VOBU */
+#define SRI_FORWARD		21
+#define SRI_ENTRIES		42
+#define SRI_OFFSET		0x3FFFFFFFu
+#define SRI_END_OF_CELL		0x3FFFFFFFu
+
+/* angle addresses count backwards with the top bit set */
+#define AGLI_BACKWARD		0x80000000u
+#define AGLI_NONE		0x7FFFFFFFu
+
+#define TMAP_DISCONTINUITY	0x80000000u
+
+typedef struct {
+	unsigned char *ifo;
+	int size;
+	GSList *visited;
+} ifo_buffer;
+
+static uint32_t get16(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 8) | p[1];
+}
+
+static uint32_t get32(const unsigned char *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put32(unsigned char *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static int in_ifo(const ifo_buffer *b, uint32_t offset, uint32_t length)
+{
+	return offset < (uint32_t)b->size && length <= (uint32_t)b->size - offset;
+}
+
+/* build the map from a sorted, merged range list as produced by add_sector_range_list */
+compact_map *compact_map_new(GSList *range_list, int nr_of_sectors)
+{
+	compact_map *map;
+	GSList *node;
+	int new_start = 0;
+
+	map = malloc(sizeof(compact_map));
+	if(map == NULL)
+		return NULL;
+
+	map->nr_of_ranges = 0;
+	map->nr_of_sectors = nr_of_sectors;
+	map->ranges = malloc((g_slist_length(range_list) + 1) * sizeof(compact_range));
+	if(map->ranges == NULL)
+	{
+		free(map);
+		return NULL;
+	}
+
+	for(node = range_list; node != NULL; node = g_slist_next(node))
+	{
+		int start = ((sector_range *)(node->data))->start;
+		int end = ((sector_range *)(node->data))->end;
+
+		if(start < 0)
+			start = 0;
+		if(end >= nr_of_sectors)
+			end = nr_of_sectors - 1;
+		if(start > end)
+			continue;
+
+		map->ranges[map->nr_of_ranges].start = start;
+		map->ranges[map->nr_of_ranges].end = end;
+		map->ranges[map->nr_of_ranges].new_start = new_start;
+		new_start += end - start + 1;
+		map->nr_of_ranges++;
+	}
+	map->new_nr_of_sectors = new_start;
+
+	return map;
+}
+
+void compact_map_free(compact_map *map)
+{
+	if(map == NULL)
+		return;
+
+	free(map->ranges);
+	free(map);
+}
+
+/* index of the first range that ends at or after sector, or nr_of_ranges */
+static int find_range(const compact_map *map, int sector)
+{
+	int lo = 0, hi = map->nr_of_ranges;
+
+	while(lo < hi)
+	{
+		int mid = lo + (hi - lo) / 2;
+		if(map->ranges[mid].end < sector)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* returns 1 and the new address if sector is kept, 0 if it is dropped */
+int compact_map_sector(const compact_map *map, int sector, int *new_sector)
+{
+	int i = find_range(map, sector);
+
+	if(i >= map->nr_of_ranges || sector < map->ranges[i].start)
+		return 0;
+
+	*new_sector = map->ranges[i].new_start + sector - map->ranges[i].start;
+	return 1;
+}
+
+/* new address of the first kept sector at or after sector; sectors past the
+ * last kept range map to the end of the compacted set */
+static int compact_map_sector_after(const compact_map *map, int sector)
+{
+	int i = find_range(map, sector);
+
+	if(i >= map->nr_of_ranges)
+		return map->new_nr_of_sectors;
+	if(sector < map->ranges[i].start)
+		return map->ranges[i].new_start;
+	return map->ranges[i].new_start + sector - map->ranges[i].start;
+}
+
+/* new address of the last kept sector at or before sector, or -1 */
+static int compact_map_sector_before(const compact_map *map, int sector)
+{
+	int i = find_range(map, sector);
+
+	if(i < map->nr_of_ranges && sector >= map->ranges[i].start)
+		return map->ranges[i].new_start + sector - map->ranges[i].start;
+	if(i == 0)
+		return -1;
+	return map->ranges[i - 1].new_start + map->ranges[i - 1].end - map->ranges[i - 1].start;
+}
+
+/* Same contract as find_next_sectors, with positive counts limited to max. */
+int compact_map_next_run(const compact_map *map, int offset, int max)
+{
+	int i = find_range(map, offset);
+	int run;
+
+	if(i >= map->nr_of_ranges)
+		return -INT_MAX;
+	if(offset < map->ranges[i].start)
+		return offset - map->ranges[i].start;
+
+	run = map->ranges[i].end - offset + 1;
+	return (max > 0 && run > max) ? max : run;
+}
+
+/* New distance from the NAV pack at sector, now at new_sector, to what lay
+ * distance sectors away from it. */
+static uint32_t compact_distance(const compact_map *map, int sector, int new_sector, uint32_t distance, int backward)
+{
+	long target = backward ? (long)sector - distance : (long)sector + distance;
+	int new_target;
+
+	if(target < 0)
+		target = 0;
+	if(target >= map->nr_of_sectors)
+		target = map->nr_of_sectors - 1;
+
+	new_target = compact_map_sector_after(map, target);
+	if(backward)
+		return new_target < new_sector ? (uint32_t)(new_sector - new_target) : 0;
+	return new_target > new_sector ? (uint32_t)(new_target - new_sector) : 0;
+}
+
+/* a VOBU search pointer: an offset with two flag bits above it */
+static void compact_sri(unsigned char *p, const compact_map *map, int sector, int new_sector, int backward)
+{
+	uint32_t v = get32(p);
+	uint32_t distance;
+
+	if((v & SRI_OFFSET) == 0 || (v & SRI_OFFSET) == SRI_END_OF_CELL)
+		return;
+
+	distance = compact_distance(map, sector, new_sector, v & SRI_OFFSET, backward);
+	put32(p, distance == 0 ? SRI_END_OF_CELL : (v & ~SRI_OFFSET) | distance);
+}
+
+/* an angle address: a distance with the direction in the top bit */
+static void compact_agli(unsigned char *p, const compact_map *map, int sector, int new_sector)
+{
+	uint32_t v = get32(p);
+	uint32_t distance;
+
+	if(v == 0 || v == AGLI_NONE)
+		return;
+
+	distance = compact_distance(map, sector, new_sector, v & ~AGLI_BACKWARD, (v & AGLI_BACKWARD) != 0);
+	put32(p, distance == 0 ? AGLI_NONE : (v & AGLI_BACKWARD) | distance);
+}
+
+/* Rewrite the logical block number and the relative addresses of every NAV
+ * pack among count sectors that were read starting at offset and are all
+ * kept. */
+void compact_nav_packs(unsigned char *buffer, int count, int offset, const compact_map *map)
+{
+	int i, j, new_sector;
+	uint32_t ilvu;
+	unsigned char *pack;
+
+	for(i = 0; i < count; i++)
+	{
+		pack = buffer + i * DVD_VIDEO_LB_LEN;
+
+		/* pack start, then a private stream 2 PCI packet and a DSI packet */
+		if(get32(pack) != 0x000001BA || get32(pack + 0x26) != 0x000001BF || pack[0x2C] != 0x00 ||
+				get32(pack + 0x400) != 0x000001BF || pack[0x406] != 0x01)
+			continue;
+
+		if(!compact_map_sector(map, offset + i, &new_sector))
+			continue;
+
+		put32(pack + NAV_PCI_LBN, new_sector);
+		put32(pack + NAV_DSI_LBN, new_sector);
+
+		for(j = 0; j < NAV_AGLI_ANGLES; j++)
+		{
+			compact_agli(pack + NAV_NSML_AGLI + j * 4, map, offset + i, new_sector);
+			compact_agli(pack + NAV_SML_AGLI + j * 6, map, offset + i, new_sector);
+		}
+
+		if((ilvu = get32(pack + NAV_ILVU_SA)) != 0 && ilvu != 0xFFFFFFFFu)
+			put32(pack + NAV_ILVU_SA, compact_distance(map, offset + i, new_sector, ilvu, 0));
+
+		for(j = 0; j < SRI_ENTRIES; j++)
+			compact_sri(pack + NAV_VOBU_SRI + j * 4, map, offset + i, new_sector, j >= SRI_FORWARD);
+	}
+}
+
+static void compact_pgc(ifo_buffer *b, uint32_t pgc_offset, const compact_map *map)
+{
+	uint32_t cell_offset;
+	int nr_of_cells, i, first, last;
+	unsigned char *cell;
+
+	if(!in_ifo(b, pgc_offset, PGC_SIZE))
+		return;
+
+	/* pgcs can be shared between search pointers and language units */
+	if(g_slist_find(b->visited, GUINT_TO_POINTER(pgc_offset)) != NULL)
+		return;
+	b->visited = g_slist_prepend(b->visited, GUINT_TO_POINTER(pgc_offset));
+
+	nr_of_cells = b->ifo[pgc_offset + PGC_NR_OF_CELLS];
+	cell_offset = get16(b->ifo + pgc_offset + PGC_CELL_PLAYBACK);
+	if(nr_of_cells == 0 || cell_offset == 0 || !in_ifo(b, pgc_offset + cell_offset, nr_of_cells * CELL_PLAYBACK_SIZE))
+		return;
+
+	for(i = 0; i < nr_of_cells; i++)
+	{
+		cell = b->ifo + pgc_offset + cell_offset + i * CELL_PLAYBACK_SIZE;
+		first = get32(cell + 8);
+		last = get32(cell + 20);
+
+		/* every cell of every pgc is kept, so first and last always map */
+		put32(cell + 8, compact_map_sector_after(map, first));
+		if(get32(cell + 12) >= (uint32_t)first && get32(cell + 12) <= (uint32_t)last)
+			put32(cell + 12, compact_map_sector_before(map, get32(cell + 12)));
+		if(get32(cell + 16) >= (uint32_t)first && get32(cell + 16) <= (uint32_t)last)
+			put32(cell + 16, compact_map_sector_before(map, get32(cell + 16)));
+		put32(cell + 20, compact_map_sector_before(map, last));
+	}
+}
+
+/* a PGCIT, either the title one or a language unit of a PGCI_UT */
+static void compact_pgcit(ifo_buffer *b, uint32_t pgcit_offset, const compact_map *map)
+{
+	int nr_of_srps, i;
+
+	if(!in_ifo(b, pgcit_offset, 8))
+		return;
+
+	nr_of_srps = get16(b->ifo + pgcit_offset);
+	if(!in_ifo(b, pgcit_offset + 8, nr_of_srps * 8))
+		return;
+
+	for(i = 0; i < nr_of_srps; i++)
+		compact_pgc(b, pgcit_offset + get32(b->ifo + pgcit_offset + 8 + i * 8 + 4), map);
+}
+
+static void compact_pgci_ut(ifo_buffer *b, uint32_t pgci_ut_offset, const compact_map *map)
+{
+	int nr_of_lus, i;
+
+	if(!in_ifo(b, pgci_ut_offset, 8))
+		return;
+
+	nr_of_lus = get16(b->ifo + pgci_ut_offset);
+	if(!in_ifo(b, pgci_ut_offset + 8, nr_of_lus * 8))
+		return;
+
+	for(i = 0; i < nr_of_lus; i++)
+		compact_pgcit(b, pgci_ut_offset + get32(b->ifo + pgci_ut_offset + 8 + i * 8 + 4), map);
+}
+
+/* cell address table: entries of dropped cells are removed */
+static void compact_c_adt(ifo_buffer *b, uint32_t c_adt_offset, const compact_map *map)
+{
+	uint32_t last_byte;
+	int nr_of_entries, i, kept = 0;
+	int start, last, new_start, new_last;
+	unsigned char *entry;
+
+	if(!in_ifo(b, c_adt_offset, 8))
+		return;
+
+	last_byte = get32(b->ifo + c_adt_offset + 4);
+	if(last_byte < 7 || !in_ifo(b, c_adt_offset, last_byte + 1))
+		return;
+
+	nr_of_entries = (last_byte + 1 - 8) / 12;
+	for(i = 0; i < nr_of_entries; i++)
+	{
+		entry = b->ifo + c_adt_offset + 8 + i * 12;
+		start = get32(entry + 4);
+		last = get32(entry + 8);
+		new_start = compact_map_sector_after(map, start);
+		new_last = compact_map_sector_before(map, last);
+		if(new_last < new_start)
+			continue;
+
+		memmove(b->ifo + c_adt_offset + 8 + kept * 12, entry, 4);
+		put32(b->ifo + c_adt_offset + 8 + kept * 12 + 4, new_start);
+		put32(b->ifo + c_adt_offset + 8 + kept * 12 + 8, new_last);
+		kept++;
+	}
+
+	memset(b->ifo + c_adt_offset + 8 + kept * 12, 0, (nr_of_entries - kept) * 12);
+	put32(b->ifo + c_adt_offset + 4, 8 + kept * 12 - 1);
+}
+
+/* VOBU address map: VOBUs in dropped ranges are removed */
+static void compact_vobu_admap(ifo_buffer *b, uint32_t admap_offset, const compact_map *map)
+{
+	uint32_t last_byte;
+	int nr_of_entries, i, kept = 0, new_sector;
+
+	if(!in_ifo(b, admap_offset, 4))
+		return;
+
+	last_byte = get32(b->ifo + admap_offset);
+	if(last_byte < 3 || !in_ifo(b, admap_offset, last_byte + 1))
+		return;
+
+	nr_of_entries = (last_byte + 1 - 4) / 4;
+	for(i = 0; i < nr_of_entries; i++)
+	{
+		if(!compact_map_sector(map, get32(b->ifo + admap_offset + 4 + i * 4), &new_sector))
+			continue;
+		put32(b->ifo + admap_offset + 4 + kept * 4, new_sector);
+		kept++;
+	}
+
+	memset(b->ifo + admap_offset + 4 + kept * 4, 0, (nr_of_entries - kept) * 4);
+	put32(b->ifo + admap_offset, 4 + kept * 4 - 1);
+}
+
+/* time maps: entries into dropped ranges move to the next kept VOBU */
+static void compact_tmapt(ifo_buffer *b, uint32_t tmapt_offset, const compact_map *map)
+{
+	int nr_of_tmaps, nr_of_entries, i, j;
+	uint32_t tmap_offset, entry;
+	unsigned char *p;
+
+	if(!in_ifo(b, tmapt_offset, 8))
+		return;
+
+	nr_of_tmaps = get16(b->ifo + tmapt_offset);
+	if(!in_ifo(b, tmapt_offset + 8, nr_of_tmaps * 4))
+		return;
+
+	for(i = 0; i < nr_of_tmaps; i++)
+	{
+		tmap_offset = tmapt_offset + get32(b->ifo + tmapt_offset + 8 + i * 4);
+		if(!in_ifo(b, tmap_offset, 4))
+			continue;
+
+		nr_of_entries = get16(b->ifo + tmap_offset + 2);
+		if(!in_ifo(b, tmap_offset + 4, nr_of_entries * 4))
+			continue;
+
+		for(j = 0; j < nr_of_entries; j++)
+		{
+			p = b->ifo + tmap_offset + 4 + j * 4;
+			entry = get32(p);
+			put32(p, (entry & TMAP_DISCONTINUITY) |
+					(uint32_t)compact_map_sector_after(map, entry & ~TMAP_DISCONTINUITY));
+		}
+	}
+}
+
+static uint32_t table_offset(const ifo_buffer *b, int field)
+{
+	return get32(b->ifo + field) * DVD_VIDEO_LB_LEN;
+}
+
+static int dropped(const compact_map *map)
+{
+	return map ? map->nr_of_sectors - map->new_nr_of_sectors : 0;
+}
+
+/* Move the start sector of every title by what was dropped before its title
+ * set: the menu VOB of the VMG and the title sets in front of it. */
+static void compact_tt_srpt(ifo_buffer *b, uint32_t tt_srpt_offset, const compact_map *menu_map, const int *title_set_dropped)
+{
+	int nr_of_srpts, nr_of_title_sets, i, j, title_set;
+	unsigned char *entry;
+	uint32_t shift;
+
+	if(!in_ifo(b, tt_srpt_offset, TT_SRPT_ENTRIES))
+		return;
+
+	nr_of_srpts = get16(b->ifo + tt_srpt_offset);
+	nr_of_title_sets = get16(b->ifo + VMG_NR_OF_TITLE_SETS);
+	if(!in_ifo(b, tt_srpt_offset + TT_SRPT_ENTRIES, nr_of_srpts * TT_SRPT_SIZE))
+		return;
+
+	for(i = 0; i < nr_of_srpts; i++)
+	{
+		entry = b->ifo + tt_srpt_offset + TT_SRPT_ENTRIES + i * TT_SRPT_SIZE;
+		title_set = entry[TT_TITLE_SET_NR];
+		if(title_set < 1 || title_set > nr_of_title_sets)
+			continue;
+
+		shift = dropped(menu_map);
+		for(j = 1; j < title_set; j++)
+			shift += title_set_dropped[j];
+		put32(entry + TT_TITLE_SET_ST_SECTOR, get32(entry + TT_TITLE_SET_ST_SECTOR) - shift);
+	}
+}
+
+/* Rewrite a copy of VIDEO_TS.IFO (title set 0) or VTS_XX_0.IFO in place for
+ * compacted VOBs. Either map may be NULL if the domain is not compacted. For
+ * VIDEO_TS.IFO, title_set_dropped holds the sectors dropped from each title
+ * set, indexed by title set number, or is NULL if the title sets are not
+ * copied. Returns 0 on success, 1 if the buffer is not an IFO of the expected
+ * kind. */
+int compact_ifo(unsigned char *ifo, int size, int title_set, const compact_map *menu_map, const compact_map *title_map,
+		const int *title_set_dropped)
+{
+	ifo_buffer b = { ifo, size, NULL };
+	uint32_t offset;
+
+	if(size < 0x100)
+		return 1;
+
+	if(title_set == 0)
+	{
+		if(memcmp(ifo, "DVDVIDEO-VMG", 12) != 0)
+			return 1;
+
+		if(menu_map != NULL)
+		{
+			if((offset = get32(ifo + VMG_FIRST_PLAY_PGC)) != 0)
+				compact_pgc(&b, offset, menu_map);
+			if((offset = table_offset(&b, VMGM_PGCI_UT)) != 0)
+				compact_pgci_ut(&b, offset, menu_map);
+			if((offset = table_offset(&b, VMGM_C_ADT)) != 0)
+				compact_c_adt(&b, offset, menu_map);
+			if((offset = table_offset(&b, VMGM_VOBU_ADMAP)) != 0)
+				compact_vobu_admap(&b, offset, menu_map);
+		}
+
+		if(title_set_dropped != NULL && (offset = table_offset(&b, VMG_TT_SRPT)) != 0)
+			compact_tt_srpt(&b, offset, menu_map, title_set_dropped);
+
+		put32(ifo + VMG_LAST_SECTOR, get32(ifo + VMG_LAST_SECTOR) - dropped(menu_map));
+	}
+	else
+	{
+		if(memcmp(ifo, "DVDVIDEO-VTS", 12) != 0)
+			return 1;
+
+		if(menu_map != NULL)
+		{
+			if((offset = table_offset(&b, VTSM_PGCI_UT)) != 0)
+				compact_pgci_ut(&b, offset, menu_map);
+			if((offset = table_offset(&b, VTSM_C_ADT)) != 0)
+				compact_c_adt(&b, offset, menu_map);
+			if((offset = table_offset(&b, VTSM_VOBU_ADMAP)) != 0)
+				compact_vobu_admap(&b, offset, menu_map);
+		}
+
+		if(title_map != NULL)
+		{
+			if((offset = table_offset(&b, VTS_PGCIT)) != 0)
+				compact_pgcit(&b, offset, title_map);
+			if((offset = table_offset(&b, VTS_TMAPT)) != 0)
+				compact_tmapt(&b, offset, title_map);
+			if((offset = table_offset(&b, VTS_C_ADT)) != 0)
+				compact_c_adt(&b, offset, title_map);
+			if((offset = table_offset(&b, VTS_VOBU_ADMAP)) != 0)
+				compact_vobu_admap(&b, offset, title_map);
+		}
+
+		/* the title VOBs follow the menu VOB in the title set */
+		if(get32(ifo + VTSM_VOBS) != 0 && get32(ifo + VTSTT_VOBS) != 0)
+			put32(ifo + VTSTT_VOBS, get32(ifo + VTSTT_VOBS) - dropped(menu_map));
+		put32(ifo + VTS_LAST_SECTOR, get32(ifo + VTS_LAST_SECTOR) - dropped(menu_map) - dropped(title_map));
+	}
+
+	g_slist_free(b.visited);
+	return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef COMPACT_H
+#define COMPACT_H
+
+#include <stdint.h>
+#include <glib.h>
+
+/* A sector range that is kept in a compacted VOB set, and where it ends up. */
+typedef struct compact_range
+{
+	int start;
+	int end;
+	int new_start;
+} compact_range;
+
+/* Mapping from the sectors of a domain (menu or title VOBs) to the sectors of
+ * its compacted copy. Sectors outside the ranges are dropped. */
+typedef struct compact_map
+{
+	int nr_of_ranges;
+	compact_range *ranges;
+	int nr_of_sectors;
+	int new_nr_of_sectors;
+} compact_map;
+
+compact_map *compact_map_new(GSList *range_list, int nr_of_sectors);
+void compact_map_free(compact_map *map);
+int compact_map_sector(const compact_map *map, int sector, int *new_sector);
+int compact_map_next_run(const compact_map *map, int offset, int max);
+void compact_nav_packs(unsigned char *buffer, int count, int offset, const compact_map *map);
+int compact_ifo(unsigned char *ifo, int size, int title_set, const compact_map *menu_map, const compact_map *title_map,
+		const int *title_set_dropped);
+
+#endif
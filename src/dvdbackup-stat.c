@@ -0,0 +1,276 @@
+/*
+ * dvdbackup-stat - list the running dvdbackup jobs
+ *
+ * Reads the live statistics segments described in stats.h.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "stats.h"
+
+/* internationalisation */
+#include "gettext.h"
+#define _(String) gettext(String)
+
+/* C standard libraries */
+#include <errno.h>
+#include <limits.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* C POSIX libraries */
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* ...and getopt_long */
+#include <getopt.h>
+
+/* where Linux shows the POSIX shared memory namespace */
+#define STATS_SHM_DIR "/dev/shm"
+
+/* what was read last time round, for the rate in repeat mode */
+typedef struct {
+	int pid;
+	uint64_t bytes_read;
+} stat_seen_t;
+
+static stat_seen_t* seen = NULL;
+static int nr_of_seen = 0;
+
+
+static void print_help(const char* program_name) {
+	printf(_("Usage: %s [OPTION]...\n"), program_name);
+	printf("\n");
+	printf(_("List the running dvdbackup jobs.\n\n"));
+	printf(_("\
+  -i, --interval=SECONDS   list the jobs again every SECONDS seconds\n\
+  -h, --help               display this help and exit\n\
+  -V, --version            display version information and exit\n"));
+}
+
+
+static const char* state_name(int state) {
+	switch (state) {
+	case STATS_STATE_STARTING:
+		return _("starting");
+	case STATS_STATE_COPYING:
+		return _("copying");
+	case STATS_STATE_DONE:
+		return _("done");
+	case STATS_STATE_FAILED:
+		return _("failed");
+	default:
+		return "?";
+	}
+}
+
+
+/* Map one segment read-only; NULL if it is not a dvdbackup segment we
+ * understand. */
+static dvdbackup_stats_t* stat_map(const char* name) {
+	char path[NAME_MAX + 2];
+	struct stat st;
+	dvdbackup_stats_t* s;
+	int fd;
+
+	snprintf(path, sizeof(path), "/%s", name);
+	fd = shm_open(path, O_RDONLY, 0);
+	if (fd == -1) {
+		return NULL;
+	}
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(dvdbackup_stats_t)) {
+		/* too small, or still being set up */
+		close(fd);
+		return NULL;
+	}
+
+	s = mmap(NULL, sizeof(dvdbackup_stats_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (s == MAP_FAILED) {
+		return NULL;
+	}
+
+	if (__atomic_load_n(&s->magic, __ATOMIC_ACQUIRE) != STATS_MAGIC
+			|| s->version != STATS_VERSION
+			|| s->size < sizeof(dvdbackup_stats_t)) {
+		munmap(s, sizeof(dvdbackup_stats_t));
+		return NULL;
+	}
+
+	return s;
+}
+
+
+/* Read rate in MiB/s: over the last interval if the job was seen then,
+ * since it started otherwise. */
+static double stat_rate(const dvdbackup_stats_t* s, stat_seen_t* previous, int nr_of_previous, int interval, time_t now) {
+	uint64_t bytes_read = STATS_GET(s, bytes_read);
+	int i;
+
+	for (i = 0; i < nr_of_previous; i++) {
+		if (previous[i].pid == s->pid && interval > 0) {
+			return (double)(bytes_read - previous[i].bytes_read) / interval / (1024 * 1024);
+		}
+	}
+
+	if (now > s->started) {
+		return (double)bytes_read / (now - s->started) / (1024 * 1024);
+	}
+	return 0;
+}
+
+
+static int stat_list(int interval) {
+	DIR* dir;
+	struct dirent* entry;
+	stat_seen_t* previous = seen;
+	int nr_of_previous = nr_of_seen;
+	int nr_of_jobs = 0;
+	time_t now = time(NULL);
+	size_t prefix_length = strlen(STATS_SHM_PREFIX) - 1;
+
+	dir = opendir(STATS_SHM_DIR);
+	if (dir == NULL) {
+		fprintf(stderr, _("Cannot read %s: %s\n"), STATS_SHM_DIR, strerror(errno));
+		return(1);
+	}
+
+	seen = NULL;
+	nr_of_seen = 0;
+
+	printf("%7s %-8s %-16s %-20s %-9s %10s %9s %9s %7s %6s %7s %9s %9s\n",
+		_("PID"), _("STATE"), _("DEVICE"), _("DISC"), _("VOB"), _("LBA"),
+		_("READ MiB"), _("WROTE MiB"), _("MiB/s"), _("ERRORS"), _("RETRIES"),
+		_("LAST ms"), _("MAX ms"));
+
+	while ((entry = readdir(dir)) != NULL) {
+		dvdbackup_stats_t* s;
+		stat_seen_t* more;
+		char vob[16];
+
+		/* STATS_SHM_PREFIX without its leading slash */
+		if (strncmp(entry->d_name, STATS_SHM_PREFIX + 1, prefix_length) != 0) {
+			continue;
+		}
+
+		s = stat_map(entry->d_name);
+		if (s == NULL) {
+			continue;
+		}
+
+		/* a job killed before it could clean up */
+		if (kill(s->pid, 0) != 0 && errno == ESRCH) {
+			munmap(s, sizeof(dvdbackup_stats_t));
+			continue;
+		}
+
+		if (STATS_GET(s, menu)) {
+			snprintf(vob, sizeof(vob), "%d/menu", STATS_GET(s, title_set));
+		} else {
+			snprintf(vob, sizeof(vob), "%d/%d", STATS_GET(s, title_set), STATS_GET(s, vob));
+		}
+
+		printf("%7d %-8s %-16.16s %-20.20s %-9s %10lld %9.1f %9.1f %7.2f %6llu %7llu %9.1f %9.1f\n",
+			s->pid, state_name(STATS_GET(s, state)), s->device, s->disc, vob,
+			(long long)STATS_GET(s, lba),
+			(double)STATS_GET(s, bytes_read) / (1024 * 1024),
+			(double)STATS_GET(s, bytes_written) / (1024 * 1024),
+			stat_rate(s, previous, nr_of_previous, interval, now),
+			(unsigned long long)STATS_GET(s, read_errors),
+			(unsigned long long)STATS_GET(s, retries),
+			STATS_GET(s, last_read_us) / 1000.0,
+			STATS_GET(s, max_read_us) / 1000.0);
+
+		more = realloc(seen, (nr_of_seen + 1) * sizeof(stat_seen_t));
+		if (more != NULL) {
+			seen = more;
+			seen[nr_of_seen].pid = s->pid;
+			seen[nr_of_seen].bytes_read = STATS_GET(s, bytes_read);
+			nr_of_seen++;
+		}
+
+		munmap(s, sizeof(dvdbackup_stats_t));
+		nr_of_jobs++;
+	}
+	closedir(dir);
+	free(previous);
+
+	if (nr_of_jobs == 0) {
+		printf(_("No dvdbackup jobs are running\n"));
+	}
+	fflush(stdout);
+
+	return(0);
+}
+
+
+int main(int argc, char* argv[]) {
+	int interval = 0;
+	int flags;
+	char* end;
+	struct option longopts[] = {
+		{"interval", required_argument, NULL, 'i'},
+		{"help", no_argument, NULL, 'h'},
+		{"version", no_argument, NULL, 'V'},
+		{NULL, 0, NULL, 0}
+	};
+
+	setlocale(LC_ALL, "");
+	bindtextdomain(PACKAGE, LOCALEDIR);
+	textdomain(PACKAGE);
+
+	while ((flags = getopt_long(argc, argv, "i:hV", longopts, NULL)) != -1) {
+		switch (flags) {
+		case 'i':
+			errno = 0;
+			interval = strtol(optarg, &end, 10);
+			if (errno != 0 || *end != '\0' || interval < 1) {
+				fprintf(stderr, _("Invalid interval %s\n"), optarg);
+				exit(1);
+			}
+			break;
+		case 'h':
+			print_help(argv[0]);
+			exit(0);
+		case 'V':
+			printf("dvdbackup-stat (%s)\n", PACKAGE_STRING);
+			exit(0);
+		default:
+			fprintf(stderr, _("Try `%s --help' for more information.\n"), argv[0]);
+			exit(1);
+		}
+	}
+
+	if (stat_list(0) != 0) {
+		exit(1);
+	}
+	while (interval > 0) {
+		sleep(interval);
+		printf("\n");
+		if (stat_list(interval) != 0) {
+			exit(1);
+		}
+	}
+
+	free(seen);
+	exit(0);
+}
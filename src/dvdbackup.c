@@ -45,19 +45,22 @@
 
 #include "dvdbackup.h"
 #include "dvdlogger.h"
+#include "report.h"
+#include "heatmap.h"
+#include "progress.h"
+#include "stats.h"
+#include "probes.h"
+#include "reader.h"
+#include "chunk.h"
 
 #ifdef FIND_UNUSED
 #include "find-sector.h"
+#include "sector-bitmap.h"
+#include "compact.h"
 #endif
 
 #define MAXNAME 256
 
-/**
- * Buffer size in DVD logical blocks (2 KiB).
- * Currently set to 1 MiB.
- */
-#define BUFFER_SIZE 512
-
 /**
  * The maximum size of a VOB file is 1 GiB or 524288 in Video DVD logical block
  * respectively.
@@ -66,10 +69,56 @@
 
 #define DVD_SEC_SIZ 2048
 
+/**
+ * With -r m and -r u a failed read is tried again in smaller reads down to
+ * this many blocks; what still fails is padded. The other strategies go down
+ * to single blocks.
+ */
+#define MULTIBLOCK_BLOCKS 32
+
+/**
+ * A VOB read slower than --read-timeout makes the copy jump WATCHDOG_JUMP
+ * blocks ahead, twice as far after every slow read in a row up to
+ * WATCHDOG_MAX_JUMP, and come back for what it jumped over at the end of
+ * the file.
+ */
+#define WATCHDOG_JUMP 64
+#define WATCHDOG_MAX_JUMP 65536
+
 /* Flag for verbose mode */
 int verbose = 0;
 int aspect;
 int progress = 0;
+int compact = 0;
+int read_timeout = 0;
+int deadline = 0;
+
+/* when --deadline is up, CLOCK_MONOTONIC */
+static struct timespec deadline_at;
+
+/* blocks left for later: jumped over by the watchdog, or with --deadline
+ * unreadable or unreferenced */
+typedef struct {
+	int offset;		/* in blocks from the start of the domain */
+	int blocks;
+	off_t position;		/* where they go in the VOB file, in bytes */
+	int title_set;
+	dvd_read_domain_t domain;
+	int vob;
+	int unreferenced;	/* no PGC refers to them, so they come first */
+	char *targetname;	/* the VOB file, once the copy has moved on */
+} deferred_extent_t;
+
+/* --deadline: what every VOB file left for the recovery pass, and what is
+ * still missing after it */
+static deferred_extent_t *recovery = NULL;
+static int nr_of_recovery = 0;
+static deferred_extent_t *missing = NULL;
+static int nr_of_missing = 0;
+/* what the first, single try at the blocks no PGC refers to could not
+ * read; it waits for the blocks PGCs do refer to */
+static deferred_extent_t *requeued = NULL;
+static int nr_of_requeued = 0;
 char progressText[MAXNAME] = "n/a";
 
 /* Structs to keep title set information in */
@@ -174,6 +223,77 @@ static int CheckAudioSubChannels(int audio_audio_array[], int title_set_audio_ar
 
 
 
+static long DVDElapsedUs(const struct timespec *start) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000L;
+}
+
+/* DVDReadBlocks and write, timed for the extent records */
+static ssize_t DVDTimedReadBlocks(dvd_file_t *dvd_file, int offset, size_t count, unsigned char *buffer, long *us) {
+	struct timespec start;
+	ssize_t result;
+
+	PROBE2(read__begin, offset, count);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	result = reader_read_blocks(dvd_file, offset, count, buffer);
+	*us = DVDElapsedUs(&start);
+	PROBE4(read__end, offset, count, result, *us);
+	chunk_record(count, result, *us);
+
+	STATS_SET(last_read_us, *us);
+	stats_read_latency(*us);
+	if ((uint64_t)*us > STATS_GET(stats, max_read_us)) {
+		STATS_SET(max_read_us, *us);
+	}
+	if (result > 0) {
+		STATS_ADD(bytes_read, (uint64_t)result * DVD_VIDEO_LB_LEN);
+	}
+
+	return result;
+}
+
+static ssize_t DVDTimedWrite(int fd, const void *buffer, size_t count, long *us) {
+	struct timespec start;
+	ssize_t result;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	result = write(fd, buffer, count);
+	*us = DVDElapsedUs(&start);
+	PROBE3(write__end, count, result, *us);
+
+	stats_write_latency(*us);
+	if (result > 0) {
+		STATS_ADD(bytes_written, result);
+	}
+
+	return result;
+}
+
+static void DVDRecordExtent(int title_set, dvd_read_domain_t domain, int vob, int offset, int blocks,
+		long read_us, long write_us, dvdlog_extent_status_t status) {
+	dvdlog_extent_t extent;
+
+	extent.title_set = title_set;
+	extent.menu = domain == DVD_READ_MENU_VOBS;
+	extent.vob = vob;
+	extent.offset = offset;
+	extent.blocks = blocks;
+	extent.read_us = read_us;
+	extent.write_us = write_us;
+	extent.status = status;
+	clock_gettime(CLOCK_REALTIME, &extent.when);
+
+	DVDLogExtent(&extent);
+
+	/* retried and deferred blocks are counted where they end up */
+	if (heatmap && status != DVDLOG_EXTENT_SKIPPED && status != DVDLOG_EXTENT_RETRIED
+			&& status != DVDLOG_EXTENT_DEFERRED) {
+		heatmap_add(title_set, domain, offset, blocks, read_us, status == DVDLOG_EXTENT_PADDED);
+	}
+}
+
 
 static int DVDWriteCells(dvd_reader_t * dvd, int cell_start_sector[],
 		int cell_end_sector[], int length, int titles,
@@ -192,7 +312,7 @@ static int DVDWriteCells(dvd_reader_t * dvd, int cell_start_sector[],
 
 	/* Write buffer */
 
-	unsigned char * buffer=NULL;
+	unsigned char * buffer = chunk_buffer();
 
 	/* File Handler */
 	int streamout;
@@ -202,10 +322,16 @@ static int DVDWriteCells(dvd_reader_t * dvd, int cell_start_sector[],
 
 	int to_read;
 	int have_read;
+	long read_us, write_us;
 
 	/* Offsets */
 	int soffset;
 
+	/* Blocks for the progress report */
+	int cells_total = 0;
+	int cells_done = 0;
+	int file_total = 0;
+
 
 	/* DVD handler */
 	dvd_file_t* dvd_file = NULL;
@@ -264,12 +390,6 @@ static int DVDWriteCells(dvd_reader_t * dvd, int cell_start_sector[],
 	XLog4(pApp, "DVDWriteCells: 1");
 #endif
 
-	if ((buffer = (unsigned char *)malloc(BUFFER_SIZE * DVD_VIDEO_LB_LEN * sizeof(unsigned char))) == NULL) {
-		XLog0(pApp, _("Out of memory copying %s"), targetname);
-		free(targetname);
-		return(1);
-	}
-
 #ifdef DEBUG
 	XLog4(pApp, "DVDWriteCells: 2");
 #endif
@@ -281,22 +401,43 @@ static int DVDWriteCells(dvd_reader_t * dvd, int cell_start_sector[],
 		free(targetname);
 		return(1);
 	}
+	PROBE3(file__open, targetname, title_set, vob);
 
 #ifdef DEBUG
 	XLog4(pApp, "DVDWriteCells: 3");
 #endif
 
 
-	if ((dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_TITLE_VOBS))== 0) {
+	if ((dvd_file = reader_open_file(dvd, title_set, DVD_READ_TITLE_VOBS))== 0) {
 		XLog0(pApp, _("Failed opening TITLE VOB"));
-		free(buffer);
 		close(streamout);
 		free(targetname);
 		return(1);
 	}
 
+	if (report) {
+		report_open_domain(dvd, title_set, DVD_READ_TITLE_VOBS);
+	}
+	if (heatmap) {
+		heatmap_open_domain(dvd, title_set, DVD_READ_TITLE_VOBS);
+	}
+
+	STATS_SET(title_set, title_set);
+	STATS_SET(menu, 0);
+	STATS_SET(vob, vob);
+
 	size = 0;
 
+	if (progress || progress_fd >= 0) {
+		for (i=0; i<length; i++) {
+			cells_total += cell_end_sector[i] - cell_start_sector[i];
+		}
+		progress_job_add(cells_total);
+		snprintf(progressText, MAXNAME, _("Title %i"), titles);
+		file_total = cells_total < MAX_VOB_SIZE ? cells_total : MAX_VOB_SIZE;
+		progress_file_start(strrchr(targetname, '/') + 1, file_total);
+	}
+
 	for (i=0; i<length; i++) {
 		left = cell_end_sector[i] - cell_start_sector[i];
 		soffset = cell_start_sector[i];
@@ -306,14 +447,16 @@ static int DVDWriteCells(dvd_reader_t * dvd, int cell_start_sector[],
 			if (to_read + size > MAX_VOB_SIZE) {
 				to_read = MAX_VOB_SIZE - size;
 			}
-			if (to_read > BUFFER_SIZE) {
-				to_read = BUFFER_SIZE;
+			if (to_read > chunk_size()) {
+				to_read = chunk_size();
 			}
 
-			if ((have_read = DVDReadBlocks(dvd_file,soffset, to_read, buffer)) < 0) {
+			if ((have_read = DVDTimedReadBlocks(dvd_file,soffset, to_read, buffer, &read_us)) < 0) {
 				XLog0(pApp, _("Error reading MENU VOB: %d != %d"), have_read, to_read);
-				free(buffer);
-				DVDCloseFile(dvd_file);
+				if (progress || progress_fd >= 0) {
+					progress_file_done(0, 0);
+				}
+				reader_close_file(dvd_file);
 				close(streamout);
 				free(targetname);
 				return(1);
@@ -321,13 +464,25 @@ static int DVDWriteCells(dvd_reader_t * dvd, int cell_start_sector[],
 			if (have_read < to_read) {
 				XLog2(pApp, _("DVDReadBlocks read %d blocks of %d blocks"), have_read, to_read);
 			}
-			if (write(streamout, buffer, have_read * DVD_VIDEO_LB_LEN) != have_read * DVD_VIDEO_LB_LEN) {
+			if (DVDTimedWrite(streamout, buffer, have_read * DVD_VIDEO_LB_LEN, &write_us) != have_read * DVD_VIDEO_LB_LEN) {
 				XLog0(pApp, _("Error writing TITLE VOB"));
-				free(buffer);
+				if (progress || progress_fd >= 0) {
+					progress_file_done(0, 0);
+				}
+				reader_close_file(dvd_file);
 				close(streamout);
 				free(targetname);
 				return(1);
 			}
+			report_add(title_set, DVD_READ_TITLE_VOBS, soffset, have_read, REPORT_COPIED);
+			stats_phase_add(STATS_PHASE_READ, read_us);
+			stats_phase_add(STATS_PHASE_WRITE, write_us);
+			STATS_SET(lba, soffset + have_read);
+			DVDRecordExtent(title_set, DVD_READ_TITLE_VOBS, vob, soffset, have_read, read_us, write_us, DVDLOG_EXTENT_OK);
+			if (progress || progress_fd >= 0) {
+				cells_done += have_read;
+				progress_update(progressText, size + have_read, file_total, have_read, 0);
+			}
 #ifdef DEBUG
 			XLog4(pApp, "Current soffset changed from %i to %i", soffset, soffset + have_read);
 #endif
@@ -341,19 +496,33 @@ static int DVDWriteCells(dvd_reader_t * dvd, int cell_start_sector[],
 				close(streamout);
 				vob = vob + 1;
 				size = 0;
+				STATS_SET(vob, vob);
 				snprintf(targetname, targetname_length, "%s/%s/VIDEO_TS/VTS_%02i_%i.VOB", targetdir, title_name, title_set, vob);
+				if (progress || progress_fd >= 0) {
+					progress_file_done(1, 0);
+					file_total = cells_total - cells_done < MAX_VOB_SIZE ? cells_total - cells_done : MAX_VOB_SIZE;
+					progress_file_start(strrchr(targetname, '/') + 1, file_total);
+				}
 				if ((streamout = open(targetname, O_WRONLY | O_CREAT | O_APPEND, 0666)) == -1) {
 					XLog0(pApp, _("Error creating %s"), targetname);
 					perror(PACKAGE);
+					if (progress || progress_fd >= 0) {
+						progress_file_done(0, 0);
+					}
+					reader_close_file(dvd_file);
 					free(targetname);
 					return(1);
 				}
+				PROBE3(file__open, targetname, title_set, vob);
 			}
 		}
 	}
 
-	DVDCloseFile(dvd_file);
-	free(buffer);
+	if (progress || progress_fd >= 0) {
+		progress_file_done(1, 0);
+	}
+
+	reader_close_file(dvd_file);
 	close(streamout);
 	free(targetname);
 
@@ -830,45 +999,459 @@ static titles_info_t * DVDGetInfo(dvd_reader_t * _dvd) {
 }
 
 
-static int DVDCopyBlocks(dvd_file_t* dvd_file, int destination, int offset, int size, char* filename, read_error_strategy_t errorstrat, dvd_reader_t *dvd, int title_set) {
+#ifdef FIND_UNUSED
+/* Reachability of the domain being copied. The title VOBs of a title set are
+ * copied part by part, so the bitmap is kept until another domain is needed
+ * instead of running the vm simulation again for every part. */
+static struct {
+	int title_set;
+	dvd_read_domain_t domain;
+	sector_bitmap *bitmap;
+} reachable = { -1, DVD_READ_TITLE_VOBS, NULL };
+
+static sector_bitmap* DVDGetReachable(dvd_reader_t *dvd, dvd_file_t *dvd_file, int title_set, dvd_read_domain_t domain) {
+	GSList *range_list = NULL;
+	stats_timer_t timer;
+
+	if(reachable.bitmap != NULL && reachable.title_set == title_set && reachable.domain == domain) {
+		return reachable.bitmap;
+	}
+
+	stats_timer_start(&timer);
+
+	sector_bitmap_free(reachable.bitmap);
+	reachable.bitmap = NULL;
+	reachable.title_set = title_set;
+	reachable.domain = domain;
+
+	/* menu cells are addressed relative to the menu VOB, title cells
+	 * relative to the title VOBs, so each domain has its own map */
+	if(domain == DVD_READ_MENU_VOBS) {
+		create_menu_range_list(dvd, title_set, &range_list);
+	} else {
+		create_titleset_range_list(dvd, title_set, &range_list);
+	}
+
+	if(range_list != NULL) {
+		reachable.bitmap = sector_bitmap_new(DVDFileSize(dvd_file));
+		if(reachable.bitmap != NULL) {
+			sector_bitmap_add_range_list(reachable.bitmap, range_list);
+		}
+		free_sector_range_list(range_list);
+	}
+
+	stats_timer_stop(&timer, STATS_PHASE_VM);
+	return reachable.bitmap;
+}
+
+/* Compaction maps of the title set being copied, [0] for the menu VOB and
+ * [1] for the title VOBs. Both are needed when its IFO is rewritten, and again
+ * while its VOBs are copied. */
+static struct {
+	int title_set;
+	compact_map *map[2];
+} compaction = { -1, { NULL, NULL } };
+
+static compact_map* DVDGetCompactMap(dvd_reader_t *dvd, int title_set, dvd_read_domain_t domain) {
+	static const dvd_read_domain_t domains[2] = { DVD_READ_MENU_VOBS, DVD_READ_TITLE_VOBS };
+	GSList *range_list;
+	dvd_stat_t statbuf;
 	int i;
+	stats_timer_t timer;
+
+	if(compaction.title_set != title_set) {
+		stats_timer_start(&timer);
+		compaction.title_set = title_set;
+		for(i = 0; i < 2; i++) {
+			compact_map_free(compaction.map[i]);
+			compaction.map[i] = NULL;
+
+			if((title_set == 0 && domains[i] == DVD_READ_TITLE_VOBS) ||
+					DVDFileStat(dvd, title_set, domains[i], &statbuf) == -1) {
+				continue;
+			}
+
+			/* keep everything any pgc refers to; a domain without
+			 * references is copied as it is */
+			range_list = NULL;
+			create_domain_range_list(dvd, title_set, domains[i], &range_list);
+			if(range_list != NULL) {
+				compaction.map[i] = compact_map_new(range_list, statbuf.size / DVD_VIDEO_LB_LEN);
+				free_sector_range_list(range_list);
+			}
+		}
+		stats_timer_stop(&timer, STATS_PHASE_VM);
+	}
+
+	return compaction.map[domain == DVD_READ_MENU_VOBS ? 0 : 1];
+}
+
+/* Sectors --compact drops from each title set, indexed by title set number,
+ * which the title start sectors in VIDEO_TS.IFO move by. NULL if out of
+ * memory; the caller frees it. */
+static int* DVDGetCompactDropped(dvd_reader_t *dvd, int nr_of_title_sets) {
+	compact_map *map;
+	int *dropped;
+	int i;
+
+	if((dropped = calloc(nr_of_title_sets + 1, sizeof(int))) == NULL) {
+		return NULL;
+	}
+
+	for(i = 1; i <= nr_of_title_sets; i++) {
+		if((map = DVDGetCompactMap(dvd, i, DVD_READ_MENU_VOBS)) != NULL) {
+			dropped[i] += map->nr_of_sectors - map->new_nr_of_sectors;
+		}
+		if((map = DVDGetCompactMap(dvd, i, DVD_READ_TITLE_VOBS)) != NULL) {
+			dropped[i] += map->nr_of_sectors - map->new_nr_of_sectors;
+		}
+	}
+
+	return dropped;
+}
+#endif
+
+
+/* Blocks to pad for a read of failed blocks that did not work, -1 to abort */
+static int DVDBlanks(read_error_strategy_t errorstrat, int failed) {
+	switch (errorstrat) {
+	case STRATEGY_ABORT:
+		XLog0(pApp, _("aborting"));
+		return -1;
+
+	case STRATEGY_SKIP_BLOCK:
+		XLog1(pApp, _("padding single block"));
+		return 1;
+
+	case STRATEGY_SKIP_MULTIBLOCK:
+		XLog1(pApp, _("padding %d blocks"), failed);
+		return failed;
+#ifdef FIND_UNUSED
+	case STRATEGY_SKIP_UNUSED:
+		XLog1(pApp, _("bad block, even when skipping unused; padding %d blocks"), failed);
+		return failed;
+#endif
+	}
+
+	return failed;
+}
+
+/* blocks a failed read must be down to before errorstrat applies; abort
+ * gives up on the first read that fails, without trying smaller ones */
+static int DVDErrorFloor(read_error_strategy_t errorstrat) {
+	switch (errorstrat) {
+	case STRATEGY_ABORT:
+		return INT_MAX;
+	case STRATEGY_SKIP_BLOCK:
+		return 1;
+	default:
+		return MULTIBLOCK_BLOCKS;
+	}
+}
+
+/* Start the clock for --deadline. */
+void DVDSetDeadline(int seconds) {
+	deadline = seconds;
+	clock_gettime(CLOCK_MONOTONIC, &deadline_at);
+	deadline_at.tv_sec += seconds;
+}
+
+static int DVDPastDeadline(void) {
+	struct timespec now;
+
+	if (deadline <= 0) {
+		return 0;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec > deadline_at.tv_sec
+		|| (now.tv_sec == deadline_at.tv_sec && now.tv_nsec >= deadline_at.tv_nsec);
+}
+
+/* Add extent to a list of extents, merging it with the last one where they
+ * meet. Returns 0 on success. */
+static int DVDDefer(deferred_extent_t **deferred, int *nr_of_deferred, const deferred_extent_t *extent) {
+	deferred_extent_t *last = *nr_of_deferred > 0 ? &(*deferred)[*nr_of_deferred - 1] : NULL;
+	deferred_extent_t *more;
+
+	if (last != NULL && last->offset + last->blocks == extent->offset
+			&& last->position + (off_t)last->blocks * DVD_VIDEO_LB_LEN == extent->position
+			&& last->unreferenced == extent->unreferenced && last->targetname == extent->targetname) {
+		last->blocks += extent->blocks;
+		return 0;
+	}
+
+	if ((more = realloc(*deferred, (*nr_of_deferred + 1) * sizeof(deferred_extent_t))) == NULL) {
+		return 1;
+	}
+	*deferred = more;
+	more[*nr_of_deferred] = *extent;
+	(*nr_of_deferred)++;
+
+	return 0;
+}
+
+/* Read the blocks of extent again and write what comes back into the
+ * hole left for them. The watchdog does not jump here, but after a failed
+ * read slower than --read-timeout the reads drop to error_floor blocks at
+ * once, and those that fail are padded. With once, what fails is not
+ * tried again but requeued. With --deadline it stops when time is up and
+ * leaves what it did not get to in extent, and notes what it had to pad as
+ * missing. Returns 1 on errors and when errorstrat says to abort. */
+static int DVDCopyDeferred(dvd_reader_t *dvd, dvd_file_t *dvd_file, int destination, const char *filename,
+		read_error_strategy_t errorstrat, deferred_extent_t *extent, int once) {
+	int error_floor = DVDErrorFloor(errorstrat);
+	int to_read, act_read, numBlanks;
+	int total = extent->blocks;
+	long read_us, write_us;
+	long slow; /* how long a read over --read-timeout took, else 0 */
+	deferred_extent_t padded;
+
+#ifdef FIND_UNUSED
+	compact_map *compaction_map = NULL;
+
+	if(compact) {
+		compaction_map = DVDGetCompactMap(dvd, extent->title_set, extent->domain);
+	}
+#else
+	(void)dvd;
+#endif
+
+	XLog1(pApp, _("Reading %d blocks of %s at block %d again"), extent->blocks, filename, extent->offset);
+	if (lseek(destination, extent->position, SEEK_SET) < 0) {
+		XLog0(pApp, _("Error writing %s."), filename);
+		return(1);
+	}
+
+	while (extent->blocks > 0 && !DVDPastDeadline()) {
+		to_read = chunk_size() < extent->blocks ? chunk_size() : extent->blocks;
+
+		STATS_SET(lba, extent->offset);
+		act_read = DVDTimedReadBlocks(dvd_file, extent->offset, to_read, chunk_buffer(), &read_us);
+		slow = (read_timeout > 0 && read_us > read_timeout * 1000L) ? read_us : 0;
+		if (act_read != to_read) {
+			STATS_ADD(read_errors, 1);
+			XLog0(pApp, _("Error reading %s at block %d"), filename, extent->offset + (act_read > 0 ? act_read : 0));
+		}
+
+		if (act_read > 0) {
+#ifdef FIND_UNUSED
+			if(compaction_map != NULL) {
+				compact_nav_packs(chunk_buffer(), act_read, extent->offset, compaction_map);
+			}
+#endif
+			if(DVDTimedWrite(destination, chunk_buffer(), act_read * DVD_VIDEO_LB_LEN, &write_us) != act_read * DVD_VIDEO_LB_LEN) {
+				XLog0(pApp, _("Error writing %s."), filename);
+				return(1);
+			}
+
+			report_add(extent->title_set, extent->domain, extent->offset, act_read, REPORT_COPIED);
+			stats_phase_add(STATS_PHASE_READ, read_us);
+			stats_phase_add(STATS_PHASE_WRITE, write_us);
+			DVDRecordExtent(extent->title_set, extent->domain, extent->vob, extent->offset, act_read, read_us, write_us, DVDLOG_EXTENT_OK);
+			read_us = 0;
+			extent->offset += act_read;
+			extent->blocks -= act_read;
+			extent->position += (off_t)act_read * DVD_VIDEO_LB_LEN;
+			if (progress || progress_fd >= 0) {
+				progress_update(filename, total - extent->blocks, total, act_read, 0);
+			}
+		}
+
+		if (act_read != to_read) {
+			if (act_read < 0) {
+				act_read = 0;
+			}
+
+			/* a read this slow that fails is the drive retrying already;
+			 * go straight down to reads of error_floor blocks, each
+			 * tried once, rather than wait for it at every size between */
+			chunk_error(slow ? error_floor : to_read, error_floor);
+			if (once) {
+				padded = *extent;
+				padded.blocks = to_read - act_read;
+				if (DVDDefer(&requeued, &nr_of_requeued, &padded) != 0) {
+					XLog0(pApp, _("Out of memory copying %s"), filename);
+					return 1;
+				}
+				if (lseek(destination, padded.blocks * DVD_VIDEO_LB_LEN, SEEK_CUR) < 0) {
+					XLog0(pApp, _("Error writing %s (padding)"), filename);
+					return 1;
+				}
+				stats_phase_add(STATS_PHASE_RECOVERY, read_us);
+				DVDRecordExtent(extent->title_set, extent->domain, extent->vob, extent->offset, padded.blocks, read_us, 0, DVDLOG_EXTENT_DEFERRED);
+				extent->offset += padded.blocks;
+				extent->blocks -= padded.blocks;
+				extent->position += (off_t)padded.blocks * DVD_VIDEO_LB_LEN;
+				continue;
+			}
+			if (to_read > error_floor) {
+				STATS_ADD(retries, 1);
+				stats_phase_add(STATS_PHASE_RECOVERY, read_us);
+				DVDRecordExtent(extent->title_set, extent->domain, extent->vob, extent->offset, to_read - act_read, read_us, 0, DVDLOG_EXTENT_RETRIED);
+				continue;
+			}
+
+			if ((numBlanks = DVDBlanks(errorstrat, to_read - act_read)) < 0) {
+				return 1;
+			}
+
+			/* the hole from the first pass reads as zeros */
+			if (lseek(destination, numBlanks * DVD_VIDEO_LB_LEN, SEEK_CUR) < 0) {
+				XLog0(pApp, _("Error writing %s (padding)"), filename);
+				return 1;
+			}
+			report_add(extent->title_set, extent->domain, extent->offset, numBlanks, REPORT_PADDED);
+			STATS_ADD(blocks_padded, numBlanks);
+			stats_phase_add(STATS_PHASE_RECOVERY, read_us);
+			DVDRecordExtent(extent->title_set, extent->domain, extent->vob, extent->offset, numBlanks, read_us, 0, DVDLOG_EXTENT_PADDED);
+			PROBE4(pad, extent->title_set, extent->domain == DVD_READ_MENU_VOBS, extent->offset, numBlanks);
+			if (progress || progress_fd >= 0) {
+				progress_error(extent->offset, numBlanks, "padded");
+			}
+
+			if (deadline > 0) {
+				padded = *extent;
+				padded.blocks = numBlanks;
+				if (DVDDefer(&missing, &nr_of_missing, &padded) != 0) {
+					XLog0(pApp, _("Out of memory copying %s"), filename);
+					return 1;
+				}
+			}
+			extent->offset += numBlanks;
+			extent->blocks -= numBlanks;
+			extent->position += (off_t)numBlanks * DVD_VIDEO_LB_LEN;
+			if (progress || progress_fd >= 0) {
+				progress_update(filename, total - extent->blocks, total, 0, numBlanks);
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* Give up on the file DVDCopyBlocks is copying. Returns 1. */
+static int DVDCopyBlocksFailed(deferred_extent_t *deferred) {
+	free(deferred);
+	if (progress || progress_fd >= 0) {
+		progress_file_done(0, 0);
+	}
+	return 1;
+}
+
+static int DVDCopyBlocks(dvd_file_t* dvd_file, int destination, int offset, int size, char* filename, const char *targetname, read_error_strategy_t errorstrat, dvd_reader_t *dvd, int title_set, dvd_read_domain_t domain, int vob) {
+	long read_us, write_us;
 
 	/* all sizes are in DVD logical blocks */
 	int remaining = size;
 	int total = size; // total size in blocks
-	float totalMiB = (float)(total) / 512.0f; // total size in [MiB]
-	int to_read = BUFFER_SIZE;
+	int reported = 0; // blocks handed to the progress report
+	int got = 0; // of the blocks since, those read
+	int later = 0; // and those left for later
+	int to_read;
 	int act_read; /* number of buffers actually read */
+	int error_floor = DVDErrorFloor(errorstrat);
+	int numBlanks;
+	int i;
 
-	/* Write buffer */
-	unsigned char buffer[BUFFER_SIZE * DVD_VIDEO_LB_LEN];
-	unsigned char buffer_zero[BUFFER_SIZE * DVD_VIDEO_LB_LEN];
+	/* read watchdog: blocks still to jump over, how far the next slow read
+	 * jumps, and what was jumped over */
+	int skip = 0;
+	int jump = WATCHDOG_JUMP;
+	long slow; /* how long a read over --read-timeout took, else 0 */
+	int unreferenced = 0;
+	deferred_extent_t extent;
+	deferred_extent_t *deferred = NULL;
+	int nr_of_deferred = 0;
+	int blocks_deferred = 0; /* left to DVDRecover, so not yet copied */
+	char *name;
+	off_t end;
+	struct stat info;
+
+	/* Write buffer, chunk_max blocks each */
+	unsigned char *buffer = chunk_buffer();
+	unsigned char *buffer_zero = chunk_zero_buffer();
 
 #ifdef FIND_UNUSED
-	GSList *range_list = NULL;
+	sector_bitmap *reachable_bitmap = NULL;
+	sector_bitmap *referenced_bitmap = NULL; /* --deadline reads these first */
+	compact_map *compaction_map = NULL;
 
-	if(errorstrat == STRATEGY_SKIP_UNUSED)
-		create_titleset_range_list(dvd, title_set, &range_list);
+	if(compact) {
+		compaction_map = DVDGetCompactMap(dvd, title_set, domain);
+	}
+
+	if(errorstrat == STRATEGY_SKIP_UNUSED) {
+		reachable_bitmap = DVDGetReachable(dvd, dvd_file, title_set, domain);
+
+		if(reachable_bitmap == NULL) {
+			XLog1(pApp, _("No referenced blocks found in %s; copying all blocks"), filename);
+			errorstrat = STRATEGY_SKIP_MULTIBLOCK;
+		}
+	} else if(deadline > 0 && compaction_map == NULL) {
+		referenced_bitmap = DVDGetReachable(dvd, dvd_file, title_set, domain);
+	}
 #endif
 
 
-	for(i = 0; i < BUFFER_SIZE * DVD_VIDEO_LB_LEN; i++) {
-		buffer_zero[i] = '\0';
+	if (report) {
+		report_open_domain(dvd, title_set, domain);
+	}
+	if (heatmap) {
+		heatmap_open_domain(dvd, title_set, domain);
 	}
 
+	if (progress || progress_fd >= 0) {
+		progress_file_start(filename, size);
+	}
+	PROBE3(file__open, filename, title_set, vob);
+
+	STATS_SET(state, STATS_STATE_COPYING);
+	STATS_SET(title_set, title_set);
+	STATS_SET(menu, domain == DVD_READ_MENU_VOBS);
+	STATS_SET(vob, vob);
+
 	while( remaining > 0 ) {
 
-		to_read = BUFFER_SIZE;
+		if (skip == 0 && DVDPastDeadline()) {
+			XLog1(pApp, _("Out of time; leaving blocks %d to %d of %s unread"), offset, offset + remaining - 1, filename);
+			skip = remaining;
+		}
+
+		to_read = skip > 0 ? skip : chunk_size();
 
+		if (to_read > chunk_max()) {
+			to_read = chunk_max();
+		}
 		if (to_read > remaining) {
 			to_read = remaining;
 		}
 
 #ifdef FIND_UNUSED
+		/* leave out blocks no pgc refers to from compacted backups */
+		if(compaction_map != NULL)
+		{
+			int next_sectors = compact_map_next_run(compaction_map, offset, to_read);
+			if(next_sectors < 0)
+			{
+				int missing = -next_sectors;
+				if(missing > remaining)
+					missing = remaining;
+
+				report_add(title_set, domain, offset, missing, REPORT_SKIPPED);
+				STATS_ADD(blocks_skipped, missing);
+				DVDRecordExtent(title_set, domain, vob, offset, missing, 0, 0, DVDLOG_EXTENT_SKIPPED);
+				PROBE4(skip__compact, title_set, domain == DVD_READ_MENU_VOBS, offset, missing);
+				remaining -= missing;
+				offset += missing;
+				continue;
+			}
+			to_read = next_sectors;
+		}
+
 		/* skip or blank out unused blocks */
 		if(errorstrat == STRATEGY_SKIP_UNUSED)
 		{
-			int next_sectors = find_next_sectors(range_list, offset);
+			int next_sectors = sector_bitmap_next_run(reachable_bitmap, offset, to_read);
 //			fprintf(stderr, "offset %d next_sectors %d\n", offset, next_sectors);
 			if(next_sectors > 0)
 			{
@@ -889,30 +1472,79 @@ static int DVDCopyBlocks(dvd_file_t* dvd_file, int destination, int offset, int
 				}
 #ifdef PAD_SKIPPED_BLOCK
 				if(write(destination,buffer,missing *  2048) != missing * 2048)
-				fprintf(stderr, "writing %d padded blocks\n", missing);
+				XLog2(pApp, _("writing %d padded blocks"), missing);
 #else
-				fprintf(stderr, "seeking over %d unreferenced blocks\n", missing);
+				XLog2(pApp, _("seeking over %d unreferenced blocks"), missing);
 				if(lseek(destination, missing *2048, SEEK_CUR) < 0)
 #endif
 				{
-					fprintf(stderr, "Error writing TITLE VOB\n");
-					DVDCloseFile(dvd_file);
+					XLog0(pApp, _("Error writing TITLE VOB"));
+					reader_close_file(dvd_file);
 					close(destination);
-					return(1);
+					return DVDCopyBlocksFailed(deferred);
 				}
 
+				report_add(title_set, domain, offset, missing, REPORT_SKIPPED);
+				STATS_ADD(blocks_skipped, missing);
+				DVDRecordExtent(title_set, domain, vob, offset, missing, 0, 0, DVDLOG_EXTENT_SKIPPED);
+				PROBE4(skip__unused, title_set, domain == DVD_READ_MENU_VOBS, offset, missing);
 				remaining -= missing;
 				offset += missing;
 				continue;
 			}
 		}
+
+		/* with --deadline, blocks no PGC refers to wait for those they do */
+		if(referenced_bitmap != NULL && skip == 0)
+		{
+			int next_sectors = sector_bitmap_next_run(referenced_bitmap, offset, to_read);
+			unreferenced = next_sectors < 0;
+			if(next_sectors > 0 && next_sectors < to_read)
+				to_read = next_sectors;
+			else if(next_sectors < 0 && -next_sectors < to_read)
+				to_read = -next_sectors;
+		}
 #endif
 
+		/* left for later; a hole until then */
+		if (skip > 0 || unreferenced) {
+			extent.offset = offset;
+			extent.blocks = to_read;
+			extent.position = lseek(destination, 0, SEEK_CUR);
+			extent.title_set = title_set;
+			extent.domain = domain;
+			extent.vob = vob;
+			extent.unreferenced = skip == 0;
+			extent.targetname = NULL;
+
+			if (extent.position < 0 || lseek(destination, (off_t)to_read * DVD_VIDEO_LB_LEN, SEEK_CUR) < 0) {
+				XLog0(pApp, _("Error writing %s (padding)"), filename);
+				return DVDCopyBlocksFailed(deferred);
+			}
+			if (DVDDefer(&deferred, &nr_of_deferred, &extent) != 0) {
+				XLog0(pApp, _("Out of memory copying %s"), filename);
+				return DVDCopyBlocksFailed(deferred);
+			}
+
+			DVDRecordExtent(title_set, domain, vob, offset, to_read, 0, 0, DVDLOG_EXTENT_DEFERRED);
+			later += to_read;
+			if (skip > 0) {
+				skip -= to_read;
+			}
+			unreferenced = 0;
+			offset += to_read;
+			remaining -= to_read;
+			continue;
+		}
+
 
 		/* Reading blocks */
-		act_read = DVDReadBlocks(dvd_file, offset, to_read, buffer);
+		STATS_SET(lba, offset);
+		act_read = DVDTimedReadBlocks(dvd_file, offset, to_read, buffer, &read_us);
+		slow = (read_timeout > 0 && read_us > read_timeout * 1000L) ? read_us : 0;
 
 		if(act_read != to_read) {
+			STATS_ADD(read_errors, 1);
 			if(act_read >= 0) {
 				XLog0(pApp, _("Error reading %s at block %d"), filename, offset+act_read);
 			} else {
@@ -921,47 +1553,86 @@ static int DVDCopyBlocks(dvd_file_t* dvd_file, int destination, int offset, int
 		}
 
 		if(act_read > 0) {
+#ifdef FIND_UNUSED
+			if(compaction_map != NULL) {
+				compact_nav_packs(buffer, act_read, offset, compaction_map);
+			}
+#endif
 			/* Writing blocks */
-			if(write(destination, buffer, act_read * DVD_VIDEO_LB_LEN) != act_read * DVD_VIDEO_LB_LEN) {
+			if(DVDTimedWrite(destination, buffer, act_read * DVD_VIDEO_LB_LEN, &write_us) != act_read * DVD_VIDEO_LB_LEN) {
 				XLog0(pApp, _("Error writing %s."), filename);
-				return(1);
+				return DVDCopyBlocksFailed(deferred);
 			}
 
+			report_add(title_set, domain, offset, act_read, REPORT_COPIED);
+			stats_phase_add(STATS_PHASE_READ, read_us);
+			stats_phase_add(STATS_PHASE_WRITE, write_us);
+			DVDRecordExtent(title_set, domain, vob, offset, act_read, read_us, write_us, DVDLOG_EXTENT_OK);
+			/* the failed read that follows was part of this one */
+			read_us = 0;
+			got += act_read;
 			offset += act_read;
 			remaining -= act_read;
 		}
 
-		if(act_read != to_read) {
-			int numBlanks = 0;
+		/* a drive this slow is retrying, and with --deadline every
+		 * error waits for the bulk of the copy; come back later */
+		if ((slow || (deadline > 0 && act_read != to_read)) && remaining > 0) {
+			skip = to_read - (act_read > 0 ? act_read : 0) + jump;
+			if (slow) {
+				XLog1(pApp, _("Reading %s took %ld ms; leaving blocks %d to %d for the end"),
+						filename, slow / 1000, offset, offset + skip - 1);
+			} else {
+				XLog1(pApp, _("Leaving blocks %d to %d of %s until the rest is copied"),
+						offset, offset + skip - 1, filename);
+			}
+			PROBE3(watchdog, offset, skip, slow);
+			if (progress || progress_fd >= 0) {
+				progress_error(offset, skip, "deferred");
+			}
+			if (jump < WATCHDOG_MAX_JUMP) {
+				jump *= 2;
+			}
+			continue;
+		}
+		if (act_read == to_read) {
+			jump = WATCHDOG_JUMP;
+		}
 
+		if(act_read != to_read) {
 			if (act_read < 0) {
 				act_read = 0;
 			}
 
-			switch (errorstrat) {
-			case STRATEGY_ABORT:
-				XLog0(pApp, _("aborting"));
-				return 1;
-
-			case STRATEGY_SKIP_BLOCK:
-				numBlanks = 1;
-				XLog1(pApp, _("padding single block"));
-				break;
+			/* go at the damage in smaller reads before giving up on it */
+			chunk_error(to_read, error_floor);
+			if (to_read > error_floor) {
+				XLog1(pApp, _("retrying %d blocks in smaller reads"), to_read - act_read);
+				STATS_ADD(retries, 1);
+				stats_phase_add(STATS_PHASE_RECOVERY, read_us);
+				DVDRecordExtent(title_set, domain, vob, offset, to_read - act_read, read_us, 0, DVDLOG_EXTENT_RETRIED);
+				if (progress || progress_fd >= 0) {
+					progress_error(offset, to_read - act_read, "retried");
+				}
+				continue;
+			}
 
-			case STRATEGY_SKIP_MULTIBLOCK:
-				numBlanks = to_read - act_read;
-				XLog1(pApp, _("padding %d blocks"), numBlanks);
-				break;
-#ifdef FIND_UNUSED
-			case STRATEGY_SKIP_UNUSED:
-				fprintf(stderr, "bad block, even when skipping unused. Falling back to skip multiblock.\n");
-#endif
-				break;
+			if ((numBlanks = DVDBlanks(errorstrat, to_read - act_read)) < 0) {
+				return DVDCopyBlocksFailed(deferred);
 			}
 
-			if (write(destination, buffer_zero, numBlanks * DVD_VIDEO_LB_LEN) != numBlanks * DVD_VIDEO_LB_LEN) {
+			if (DVDTimedWrite(destination, buffer_zero, numBlanks * DVD_VIDEO_LB_LEN, &write_us) != numBlanks * DVD_VIDEO_LB_LEN) {
 				XLog0(pApp, _("Error writing %s (padding)"), filename);
-				return 1;
+				return DVDCopyBlocksFailed(deferred);
+			}
+
+			report_add(title_set, domain, offset, numBlanks, REPORT_PADDED);
+			STATS_ADD(blocks_padded, numBlanks);
+			stats_phase_add(STATS_PHASE_RECOVERY, read_us + write_us);
+			DVDRecordExtent(title_set, domain, vob, offset, numBlanks, read_us, write_us, DVDLOG_EXTENT_PADDED);
+			PROBE4(pad, title_set, domain == DVD_READ_MENU_VOBS, offset, numBlanks);
+			if (progress || progress_fd >= 0) {
+				progress_error(offset, numBlanks, "padded");
 			}
 
 			/* pretend we read what we padded */
@@ -969,19 +1640,53 @@ static int DVDCopyBlocks(dvd_file_t* dvd_file, int destination, int offset, int
 			remaining -= numBlanks;
 		}
 
-		if(progress) {
-			int done = total - remaining; // blocks done
-			if(remaining < BUFFER_SIZE || (done % BUFFER_SIZE) == 0) { // don't print too often
-				float doneMiB = (float)(done) / 512.0f; // [MiB] done
-				XLog5(pApp, _("Copying %s: %.0f%% done (%.0f/%.0f MiB)"),
-						progressText, doneMiB / totalMiB * 100.0f, doneMiB, totalMiB);
-			}
+		if(progress || progress_fd >= 0) {
+			int done = total - remaining; // blocks done, including skipped ones
+			progress_update(progressText, done, total, got, done - reported - got - later);
+			reported = done;
+			got = later = 0;
 		}
 
 	}
 
-	if (remaining == 0) {
+	/* blocks seeked over at the end would leave the file short */
+	if ((end = lseek(destination, 0, SEEK_CUR)) < 0 || fstat(destination, &info) != 0
+			|| (info.st_size < end && ftruncate(destination, end) != 0)) {
+		XLog0(pApp, _("Error writing %s (padding)"), filename);
+		return DVDCopyBlocksFailed(deferred);
+	}
+
+	if (deadline > 0 && nr_of_deferred > 0) {
+		/* for DVDRecover, once everything else is copied */
+		if ((name = strdup(targetname)) == NULL) {
+			XLog0(pApp, _("Out of memory copying %s"), filename);
+			return DVDCopyBlocksFailed(deferred);
+		}
+		for (i = 0; i < nr_of_deferred; i++) {
+			deferred[i].targetname = name;
+			blocks_deferred += deferred[i].blocks;
+			if (DVDDefer(&recovery, &nr_of_recovery, &deferred[i]) != 0) {
+				XLog0(pApp, _("Out of memory copying %s"), filename);
+				return DVDCopyBlocksFailed(deferred);
+			}
+		}
+	} else {
+		/* the blocks the watchdog jumped over, this time without it */
+		for (i = 0; i < nr_of_deferred; i++) {
+			if (DVDCopyDeferred(dvd, dvd_file, destination, filename, errorstrat, &deferred[i], 0) != 0) {
+				return DVDCopyBlocksFailed(deferred);
+			}
+		}
+	}
+	free(deferred);
+
+	if (remaining == 0 && blocks_deferred == 0) {
 		XLog2(pApp, _("Success writing %s"), filename);
+	} else if (remaining == 0) {
+		XLog1(pApp, _("Wrote %s but for %d blocks left for later"), filename, blocks_deferred);
+	}
+	if (progress || progress_fd >= 0) {
+		progress_file_done(remaining == 0 && blocks_deferred == 0, blocks_deferred);
 	}
 
 	return 0;
@@ -989,6 +1694,151 @@ static int DVDCopyBlocks(dvd_file_t* dvd_file, int destination, int offset, int
 
 
 
+/* by VOB file, then by block */
+static int DVDCompareExtents(const void *a, const void *b) {
+	const deferred_extent_t *x = a, *y = b;
+	int order = strcmp(x->targetname, y->targetname);
+
+	if (order != 0) {
+		return order;
+	}
+	return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+/* Read the extents of list that unreferenced selects, or all of them if it
+ * is -1, while there is time. Returns 1 on errors and when errorstrat says
+ * to abort. */
+static int DVDRecoverPass(dvd_reader_t *dvd, read_error_strategy_t errorstrat,
+		deferred_extent_t *list, int nr_of_extents, int unreferenced, int once) {
+	int result = 0;
+	int destination;
+	int i;
+	dvd_file_t *dvd_file;
+	deferred_extent_t *extent;
+	const char *filename;
+
+	for (i = 0; i < nr_of_extents && result == 0 && !DVDPastDeadline(); i++) {
+		extent = &list[i];
+		if ((unreferenced >= 0 && extent->unreferenced != unreferenced) || extent->blocks == 0) {
+			continue;
+		}
+		filename = strrchr(extent->targetname, '/') + 1;
+
+		if ((destination = open(extent->targetname, O_WRONLY)) == -1) {
+			XLog0(pApp, _("Error opening %s"), extent->targetname);
+			return 1;
+		}
+		if ((dvd_file = reader_open_file(dvd, extent->title_set, extent->domain)) == NULL) {
+			XLog0(pApp, _("Failed opening %s on the DVD"), filename);
+			close(destination);
+			return 1;
+		}
+		result = DVDCopyDeferred(dvd, dvd_file, destination, filename, errorstrat, extent, once);
+		reader_close_file(dvd_file);
+		if (close(destination) != 0) {
+			XLog0(pApp, _("Error writing %s."), filename);
+			result = 1;
+		}
+	}
+
+	return result;
+}
+
+/* What there was no time for in list stays padded. Returns 0 on success. */
+static int DVDRecoverMissing(deferred_extent_t *list, int nr_of_extents) {
+	deferred_extent_t *extent;
+	int i;
+
+	for (i = 0; i < nr_of_extents; i++) {
+		extent = &list[i];
+		if (extent->blocks == 0) {
+			continue;
+		}
+		report_add(extent->title_set, extent->domain, extent->offset, extent->blocks, REPORT_PADDED);
+		STATS_ADD(blocks_padded, extent->blocks);
+		DVDRecordExtent(extent->title_set, extent->domain, extent->vob, extent->offset, extent->blocks, 0, 0, DVDLOG_EXTENT_PADDED);
+		if (DVDDefer(&missing, &nr_of_missing, extent) != 0) {
+			XLog0(pApp, _("Out of memory"));
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* With --deadline, read what the copies left for later while there is
+ * time: the blocks no PGC refers to once each, since they are likely to
+ * read at full speed, then the blocks that failed or were slow, and last
+ * what the first try at the unreferenced ones could not read. List what is
+ * still missing. Returns the number of blocks PGCs refer to that are
+ * missing, or -1 on errors and when errorstrat says to abort; unreferenced
+ * blocks that are missing are only listed. */
+long long DVDRecover(dvd_reader_t *dvd, read_error_strategy_t errorstrat) {
+	long long blocks_missing = 0;
+	long long blocks_unreferenced = 0;
+	int nr_of_unreferenced = 0;
+	int result;
+	int i;
+
+	result = DVDRecoverPass(dvd, errorstrat, recovery, nr_of_recovery, 1, 1);
+	if (result == 0) {
+		result = DVDRecoverPass(dvd, errorstrat, recovery, nr_of_recovery, 0, 0);
+	}
+	if (result == 0) {
+		result = DVDRecoverPass(dvd, errorstrat, requeued, nr_of_requeued, -1, 0);
+	}
+
+	if (result == 0) {
+		result = DVDRecoverMissing(recovery, nr_of_recovery) || DVDRecoverMissing(requeued, nr_of_requeued);
+	}
+
+	if (result == 0) {
+		if (nr_of_missing > 1) {
+			qsort(missing, nr_of_missing, sizeof(deferred_extent_t), DVDCompareExtents);
+		}
+		for (i = 0; i < nr_of_missing; i++) {
+			if (missing[i].unreferenced) {
+				blocks_unreferenced += missing[i].blocks;
+				nr_of_unreferenced++;
+			} else {
+				blocks_missing += missing[i].blocks;
+			}
+		}
+		if (nr_of_missing == 0) {
+			XLog2(pApp, _("Everything was read before the deadline"));
+		}
+		if (nr_of_missing > nr_of_unreferenced) {
+			XLog1(pApp, _("Missing at the deadline: %lld blocks in %d extents"),
+					blocks_missing, nr_of_missing - nr_of_unreferenced);
+		}
+		if (nr_of_unreferenced > 0) {
+			XLog1(pApp, _("Not read by the deadline, but no PGC refers to them: %lld blocks in %d extents"),
+					blocks_unreferenced, nr_of_unreferenced);
+		}
+		for (i = 0; i < nr_of_missing; i++) {
+			XLog1(pApp, "  %s  %d/%s:%d-%d%s", strrchr(missing[i].targetname, '/') + 1,
+					missing[i].title_set, missing[i].domain == DVD_READ_MENU_VOBS ? "menu" : "title",
+					missing[i].offset, missing[i].offset + missing[i].blocks - 1,
+					missing[i].unreferenced ? _(" (unreferenced)") : "");
+		}
+	}
+
+	for (i = 0; i < nr_of_recovery; i++) {
+		if (i == 0 || recovery[i].targetname != recovery[i - 1].targetname) {
+			free(recovery[i].targetname);
+		}
+	}
+	free(recovery);
+	free(requeued);
+	free(missing);
+	recovery = requeued = missing = NULL;
+	nr_of_recovery = nr_of_requeued = nr_of_missing = 0;
+
+	return result == 0 ? blocks_missing : -1;
+}
+
+
+
 static int DVDCopyTitleVobX(dvd_reader_t * dvd, title_set_info_t * title_set_info, int title_set, int vob, char * targetdir,char * title_name, read_error_strategy_t errorstrat) {
 
 	/* Loop variable */
@@ -1106,16 +1956,16 @@ static int DVDCopyTitleVobX(dvd_reader_t * dvd, title_set_info_t * title_set_inf
 		}
 	}
 
-	if ((dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_TITLE_VOBS))== 0) {
+	if ((dvd_file = reader_open_file(dvd, title_set, DVD_READ_TITLE_VOBS))== 0) {
 		XLog0(pApp, _("Failed opening TITLE VOB"));
 		close(streamout);
 		free(targetname);
 		return(1);
 	}
 
-	result = DVDCopyBlocks(dvd_file, streamout, offset, size, filename, errorstrat, dvd, title_set);
+	result = DVDCopyBlocks(dvd_file, streamout, offset, size, filename, targetname, errorstrat, dvd, title_set, DVD_READ_TITLE_VOBS, vob);
 
-	DVDCloseFile(dvd_file);
+	reader_close_file(dvd_file);
 	close(streamout);
 	free(targetname);
 	return result;
@@ -1160,7 +2010,7 @@ static int DVDCopyMenu(dvd_reader_t * dvd, title_set_info_t * title_set_info, in
 		}
 	}
 
-	if ((dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_MENU_VOBS))== 0) {
+	if ((dvd_file = reader_open_file(dvd, title_set, DVD_READ_MENU_VOBS))== 0) {
 		XLog0(pApp, _("Failed opening %s"), filename);
 		return(1);
 	}
@@ -1181,14 +2031,14 @@ static int DVDCopyMenu(dvd_reader_t * dvd, title_set_info_t * title_set_info, in
 		if (! S_ISREG(fileinfo.st_mode)) {
 			/* TRANSLATORS: The sentence starts with "The menu file %s is not valid[...]" */
 			XLog1(pApp, _("The %s %s is not valid, it may be a directory."), _("menu file"), targetname);
-			DVDCloseFile(dvd_file);
+			reader_close_file(dvd_file);
 			free(targetname);
 			return(1);
 		} else {
 			if ((streamout = open(targetname, O_WRONLY | O_TRUNC, 0666)) == -1) {
 				XLog0(pApp, _("Error opening %s"), targetname);
 				perror(PACKAGE);
-				DVDCloseFile(dvd_file);
+				reader_close_file(dvd_file);
 				free(targetname);
 				return(1);
 			}
@@ -1197,7 +2047,7 @@ static int DVDCopyMenu(dvd_reader_t * dvd, title_set_info_t * title_set_info, in
 		if ((streamout = open(targetname, O_WRONLY | O_CREAT, 0666)) == -1) {
 			XLog0(pApp, _("Error creating %s"), targetname);
 			perror(PACKAGE);
-			DVDCloseFile(dvd_file);
+			reader_close_file(dvd_file);
 			free(targetname);
 			return(1);
 		}
@@ -1207,9 +2057,9 @@ static int DVDCopyMenu(dvd_reader_t * dvd, title_set_info_t * title_set_info, in
 		strncpy(progressText, _("menu"), MAXNAME);
 	}
 
-	result = DVDCopyBlocks(dvd_file, streamout, 0, size, filename, errorstrat, dvd, title_set);
+	result = DVDCopyBlocks(dvd_file, streamout, 0, size, filename, targetname, errorstrat, dvd, title_set, DVD_READ_MENU_VOBS, 0);
 
-	DVDCloseFile(dvd_file);
+	reader_close_file(dvd_file);
 	close(streamout);
 	free(targetname);
 	return result;
@@ -1236,6 +2086,11 @@ static int DVDCopyIfoBup(dvd_reader_t* dvd, title_set_info_t* title_set_info, in
 	ifo_handle_t* ifo_file = NULL;
 	struct ifo_handle_private_s *ifop = NULL;
 
+#ifdef FIND_UNUSED
+	/* sectors dropped per title set, for VIDEO_TS.IFO */
+	int *title_set_dropped = NULL;
+#endif
+
 
 	if (title_set_info->number_of_title_sets + 1 < title_set) {
 		return(1);
@@ -1307,6 +2162,7 @@ static int DVDCopyIfoBup(dvd_reader_t* dvd, title_set_info_t* title_set_info, in
 		close(streamout_bup);
 		return 1;
 	}
+	PROBE3(file__open, targetname_ifo, title_set, 0);
 
 	if ((streamout_bup = open(targetname_bup, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
 		XLog1(pApp, _("Error creating %s"), targetname_bup);
@@ -1319,11 +2175,12 @@ static int DVDCopyIfoBup(dvd_reader_t* dvd, title_set_info_t* title_set_info, in
 		close(streamout_bup);
 		return 1;
 	}
+	PROBE3(file__open, targetname_bup, title_set, 0);
 
 	/* Copy VIDEO_TS.IFO, since it's a small file try to copy it in one shot */
 
 	if ((ifo_file = ifoOpen(dvd, title_set))== 0) {
-		fprintf(stderr, _("Failed opening IFO for title set %d\n"), title_set);
+		XLog0(pApp, _("Failed opening IFO for title set %d"), title_set);
 		ifoClose(ifo_file);
 		free(buffer);
 		free(targetname_ifo);
@@ -1361,6 +2218,29 @@ static int DVDCopyIfoBup(dvd_reader_t* dvd, title_set_info_t* title_set_info, in
 	}
 
 
+#ifdef FIND_UNUSED
+	/* before the maps of this title set, which stay cached for its VOBs */
+	if (compact && title_set == 0) {
+		title_set_dropped = DVDGetCompactDropped(dvd, title_set_info->number_of_title_sets);
+	}
+	if (compact && ((title_set == 0 && title_set_dropped == NULL) ||
+			compact_ifo(buffer, size, title_set,
+				DVDGetCompactMap(dvd, title_set, DVD_READ_MENU_VOBS),
+				DVDGetCompactMap(dvd, title_set, DVD_READ_TITLE_VOBS),
+				title_set_dropped) != 0)) {
+		XLog0(pApp, _("Cannot compact the IFO for title set %d"), title_set);
+		free(title_set_dropped);
+		ifoClose(ifo_file);
+		free(buffer);
+		free(targetname_ifo);
+		free(targetname_bup);
+		close(streamout_ifo);
+		close(streamout_bup);
+		return 1;
+	}
+	free(title_set_dropped);
+#endif
+
 	if (write(streamout_ifo,buffer,size) != size) {
 		XLog0(pApp, _("Error writing %s"),targetname_ifo);
 		ifoClose(ifo_file);
@@ -1389,6 +2269,17 @@ static int DVDCopyIfoBup(dvd_reader_t* dvd, title_set_info_t* title_set_info, in
 }
 
 
+/* announce the VOBs of a title set to the progress report */
+static void DVDProgressJobAdd(title_set_info_t* title_set_info, int title_set) {
+	off_t size = title_set_info->title_set[title_set].size_menu;
+	int i;
+
+	for (i = 0; i < title_set_info->title_set[title_set].number_of_vob_files; i++) {
+		size += title_set_info->title_set[title_set].size_vob[i];
+	}
+	progress_job_add(size / DVD_VIDEO_LB_LEN);
+}
+
 static int DVDMirrorTitleX(dvd_reader_t* dvd, title_set_info_t* title_set_info,
 		int title_set, char* targetdir, char* title_name,
 		read_error_strategy_t errorstrat) {
@@ -1397,7 +2288,16 @@ static int DVDMirrorTitleX(dvd_reader_t* dvd, title_set_info_t* title_set_info,
 	int i;
 	int n;
 
-	if ( DVDCopyIfoBup(dvd, title_set_info, title_set, targetdir, title_name) != 0 ) {
+	/* the VM simulation --compact starts there is timed on its own */
+	stats_timer_t timer;
+	int result;
+
+	PROBE1(ifo__begin, title_set);
+	stats_timer_start(&timer);
+	result = DVDCopyIfoBup(dvd, title_set_info, title_set, targetdir, title_name);
+	stats_timer_stop(&timer, STATS_PHASE_IFO);
+	PROBE2(ifo__end, title_set, result);
+	if ( result != 0 ) {
 		return(1);
 	}
 
@@ -1673,18 +2573,47 @@ static title_set_info_t* DVDGetFileSet(dvd_reader_t* dvd) {
 	return title_set_info;
 }
 
+/* DVDGetInfo and DVDGetFileSet, timed as IFO parsing */
+static titles_info_t* DVDTimedGetInfo(dvd_reader_t* dvd) {
+	stats_timer_t timer;
+	titles_info_t* titles_info;
+
+	stats_timer_start(&timer);
+	titles_info = DVDGetInfo(dvd);
+	stats_timer_stop(&timer, STATS_PHASE_IFO);
+
+	return titles_info;
+}
+
+static title_set_info_t* DVDTimedGetFileSet(dvd_reader_t* dvd) {
+	stats_timer_t timer;
+	title_set_info_t* title_set_info;
+
+	stats_timer_start(&timer);
+	title_set_info = DVDGetFileSet(dvd);
+	stats_timer_stop(&timer, STATS_PHASE_IFO);
+
+	return title_set_info;
+}
+
 
 int DVDMirror(dvd_reader_t * _dvd, char * targetdir,char * title_name, read_error_strategy_t errorstrat) {
 
 	int i;
 	title_set_info_t * title_set_info=NULL;
 
-	title_set_info = DVDGetFileSet(_dvd);
+	title_set_info = DVDTimedGetFileSet(_dvd);
 	if (!title_set_info) {
 		DVDClose(_dvd);
 		return(1);
 	}
 
+	if (progress || progress_fd >= 0) {
+		for ( i=0; i <= title_set_info->number_of_title_sets; i++) {
+			DVDProgressJobAdd(title_set_info, i);
+		}
+	}
+
 	for ( i=0; i <= title_set_info->number_of_title_sets; i++) {
 		if ( DVDMirrorTitleX(_dvd, title_set_info, i, targetdir, title_name, errorstrat) != 0 ) {
 			XLog0(pApp, _("Mirror of Title set %d failed"), i);
@@ -1705,7 +2634,7 @@ int DVDMirrorTitleSet(dvd_reader_t * _dvd, char * targetdir,char * title_name, i
 	XLog4(pApp, "In DVDMirrorTitleSet");
 #endif
 
-	title_set_info = DVDGetFileSet(_dvd);
+	title_set_info = DVDTimedGetFileSet(_dvd);
 
 	if (!title_set_info) {
 		DVDClose(_dvd);
@@ -1718,6 +2647,10 @@ int DVDMirrorTitleSet(dvd_reader_t * _dvd, char * targetdir,char * title_name, i
 		return(1);
 	}
 
+	if (progress || progress_fd >= 0) {
+		DVDProgressJobAdd(title_set_info, title_set);
+	}
+
 	if ( DVDMirrorTitleX(_dvd, title_set_info, title_set, targetdir, title_name, errorstrat) != 0 ) {
 		XLog0(pApp, _("Mirror of Title set %d failed"), title_set);
 		DVDFreeTitleSetInfo(title_set_info);
@@ -1735,18 +2668,22 @@ int DVDMirrorMainFeature(dvd_reader_t * _dvd, char * targetdir,char * title_name
 	titles_info_t * titles_info=NULL;
 
 
-	titles_info = DVDGetInfo(_dvd);
+	titles_info = DVDTimedGetInfo(_dvd);
 	if (!titles_info) {
 		XLog0(pApp, _("Guesswork of main feature film failed."));
 		return(1);
 	}
 
-	title_set_info = DVDGetFileSet(_dvd);
+	title_set_info = DVDTimedGetFileSet(_dvd);
 	if (!title_set_info) {
 		DVDFreeTitlesInfo(titles_info);
 		return(1);
 	}
 
+	if (progress || progress_fd >= 0) {
+		DVDProgressJobAdd(title_set_info, titles_info->main_title_set);
+	}
+
 	if ( DVDMirrorTitleX(_dvd, title_set_info, titles_info->main_title_set, targetdir, title_name, errorstrat) != 0 ) {
 		XLog0(pApp, _("Mirror of main feature file which is title set %d failed"), titles_info->main_title_set);
 		DVDFreeTitleSetInfo(title_set_info);
@@ -1776,13 +2713,13 @@ int DVDMirrorChapters(dvd_reader_t * _dvd, char * targetdir,char * title_name, i
 	int * cell_start_sector=NULL;
 	int * cell_end_sector=NULL;
 
-	titles_info = DVDGetInfo(_dvd);
+	titles_info = DVDTimedGetInfo(_dvd);
 	if (!titles_info) {
 		XLog0(pApp, _("Failed to obtain titles information"));
 		return(1);
 	}
 
-	title_set_info = DVDGetFileSet(_dvd);
+	title_set_info = DVDTimedGetFileSet(_dvd);
 	if (!title_set_info) {
 		DVDFreeTitlesInfo(titles_info);
 		return(1);
@@ -1938,7 +2875,7 @@ int DVDMirrorTitles(dvd_reader_t * _dvd, char * targetdir,char * title_name, int
 
 
 
-	titles_info = DVDGetInfo(_dvd);
+	titles_info = DVDTimedGetInfo(_dvd);
 	if (!titles_info) {
 		XLog0(pApp, _("Failed to obtain titles information"));
 		return(1);
@@ -2003,13 +2940,13 @@ int DVDDisplayInfo(dvd_reader_t* dvd, char* device) {
 	title_set_info_t* title_set_info = NULL;
 	titles_info_t* titles_info = NULL;
 
-	titles_info = DVDGetInfo(dvd);
+	titles_info = DVDTimedGetInfo(dvd);
 	if (!titles_info) {
 		XLog0(pApp, _("Guesswork of main feature film failed."));
 		return(1);
 	}
 
-	title_set_info = DVDGetFileSet(dvd);
+	title_set_info = DVDTimedGetFileSet(dvd);
 	if (!title_set_info) {
 		DVDFreeTitlesInfo(titles_info);
 		return(1);
@@ -36,6 +36,11 @@
 extern int verbose;
 extern int aspect;
 extern int progress;
+extern int compact;
+/* milliseconds a VOB read may take before the copy jumps ahead, 0 for no limit */
+extern int read_timeout;
+/* seconds for the whole copy with --deadline, 0 for no limit */
+extern int deadline;
 
 typedef enum {
 	STRATEGY_ABORT,
@@ -49,6 +54,7 @@ typedef enum {
 typedef struct app_data_s {
 	const char *program_name;
 	char *dev_path;
+	char *title_name;
 	pid_t pid;
 	int last_level;
 #ifdef ENABLE_LOGDB
@@ -66,5 +72,7 @@ int DVDMirrorChapters(dvd_reader_t*, char*, char*, int, int, int);
 int DVDMirrorMainFeature(dvd_reader_t*, char*, char*, read_error_strategy_t);
 int DVDMirrorTitles(dvd_reader_t*, char*, char*, int);
 int DVDMirrorTitleSet(dvd_reader_t*, char*, char*, int, read_error_strategy_t);
+void DVDSetDeadline(int);
+long long DVDRecover(dvd_reader_t*, read_error_strategy_t);
 
 #endif /* DVDBACKUP_H_ */
@@ -1,6 +1,8 @@
 #ifndef _DVDLOGGER_H_
 #define _DVDLOGGER_H_
 
+#include <time.h>
+
 #include <dvdread/dvd_reader.h>
 
 #include "dvdbackup.h"
@@ -10,15 +12,69 @@ typedef enum {
 	DVDBACKUP_LOGGER_LEVEL_PROGRESS
 } dvdbackup_logger_level_t;
 
+typedef enum {
+	DVDLOG_OVERFLOW_BLOCK,	/* wait for room, except for progress records */
+	DVDLOG_OVERFLOW_DROP	/* drop any record that does not fit */
+} dvdlog_overflow_t;
+
+typedef enum {
+	DVDLOG_EXTENT_OK,
+	DVDLOG_EXTENT_PADDED,
+	DVDLOG_EXTENT_SKIPPED,
+	DVDLOG_EXTENT_RETRIED,
+	DVDLOG_EXTENT_DEFERRED	/* left for a later pass */
+} dvdlog_extent_status_t;
+
+/* one run of blocks handled by the copy loop */
+typedef struct {
+	int title_set;
+	int menu;		/* 1 for the menu VOBs, 0 for the title VOBs */
+	int vob;		/* VOB file number, 0 for the menu */
+	int offset;		/* in blocks from the start of the domain */
+	int blocks;
+	long read_us;
+	long write_us;
+	dvdlog_extent_status_t status;
+	struct timespec when;	/* CLOCK_REALTIME */
+} dvdlog_extent_t;
+
+int DVDLogStart(unsigned int queue_size, dvdlog_overflow_t overflow);
+void DVDLogStop(void);
+void DVDLogSetFlush(void (*flush)(void *priv, int force), void *priv);
+void DVDLogSetExtent(void (*extent)(void *priv, const dvdlog_extent_t *extent), void *priv);
+void DVDLogExtent(const dvdlog_extent_t *extent);
+void DVDLogSetEventFd(int fd);
+void DVDLogEvent(int level, const char *fmt, ...);
 void DVDLog(void *priv, const dvd_logger_cb *logcb, int level, const char *fmt, ...);
 
-#define XLOG(ctx, level, ...) \
-  DVDLog(ctx, &ctx->logcb, level, __VA_ARGS__)
-#define XLog0(ctx, ...) XLOG(ctx, DVD_LOGGER_LEVEL_ERROR, __VA_ARGS__)
-#define XLog1(ctx, ...) XLOG(ctx, DVD_LOGGER_LEVEL_WARN,  __VA_ARGS__)
-#define XLog2(ctx, ...) XLOG(ctx, DVD_LOGGER_LEVEL_INFO,  __VA_ARGS__)
-#define XLog3(ctx, ...) XLOG(ctx, DVD_LOGGER_LEVEL_DEBUG, __VA_ARGS__)
-#define XLog4(ctx, ...) XLOG(ctx, DVDBACKUP_LOGGER_LEVEL_TRACE, __VA_ARGS__)
-#define XLog5(ctx, ...) XLOG(ctx, DVDBACKUP_LOGGER_LEVEL_PROGRESS, __VA_ARGS__)
+/* Ranks of the XLogN macros, most severe first. A message is formatted only
+ * if its rank is within both the ceiling fixed at build time and the
+ * minimum level chosen at run time; otherwise its arguments are not even
+ * evaluated. Progress messages are requested with -p and always pass. */
+#define DVDLOG_RANK_ERROR	0
+#define DVDLOG_RANK_WARN	1
+#define DVDLOG_RANK_INFO	2
+#define DVDLOG_RANK_DEBUG	3
+#define DVDLOG_RANK_TRACE	4
+
+#ifndef DVDLOG_CEILING
+#define DVDLOG_CEILING DVDLOG_RANK_TRACE
+#endif
+
+extern int dvdlog_level;
+
+int DVDLogParseLevel(const char *name);
+
+#define XLOG(ctx, rank, level, ...) \
+  do { \
+    if ((rank) <= DVDLOG_CEILING && (rank) <= dvdlog_level) \
+      DVDLog(ctx, &ctx->logcb, level, __VA_ARGS__); \
+  } while (0)
+#define XLog0(ctx, ...) XLOG(ctx, DVDLOG_RANK_ERROR, DVD_LOGGER_LEVEL_ERROR, __VA_ARGS__)
+#define XLog1(ctx, ...) XLOG(ctx, DVDLOG_RANK_WARN,  DVD_LOGGER_LEVEL_WARN,  __VA_ARGS__)
+#define XLog2(ctx, ...) XLOG(ctx, DVDLOG_RANK_INFO,  DVD_LOGGER_LEVEL_INFO,  __VA_ARGS__)
+#define XLog3(ctx, ...) XLOG(ctx, DVDLOG_RANK_DEBUG, DVD_LOGGER_LEVEL_DEBUG, __VA_ARGS__)
+#define XLog4(ctx, ...) XLOG(ctx, DVDLOG_RANK_TRACE, DVDBACKUP_LOGGER_LEVEL_TRACE, __VA_ARGS__)
+#define XLog5(ctx, ...) XLOG(ctx, DVDLOG_RANK_ERROR, DVDBACKUP_LOGGER_LEVEL_PROGRESS, __VA_ARGS__)
 
 #endif // _DVDLOGGER_H_
@@ -0,0 +1,436 @@
+/* find-sector-bench.c.
+ Times add_sector_range_list, find_next_sectors and the reachability bitmap built from their lists on synthetic cell lists (sorted, reversed, interleaved angles, heavy overlap) and on cell lists recorded from real discs, counts the allocations they make and checks every answer against a plain array of sectors.
+
+ A recorded list has one "first last" cell per line, as the vm-cell probe gives them:
+	bpftrace -e 'usdt:./dvdbackup:dvdbackup:vm-cell /arg0 == 1/ { printf("%d %d\n", arg3, arg4); }'
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include <dvdread/dvd_reader.h>
+
+#include "find-sector.h"
+#include "sector-bitmap.h"
+
+/* the copy loop asks for at most this many sectors at a time */
+#define QUERY_MAX 512
+
+/* largest domain a cell list may describe, a bit more than a dual layer disc */
+#define MAX_SECTORS (5 * 1024 * 1024)
+
+typedef struct cell_list
+{
+	const char *name;
+	int nr_of_cells;
+	int *first;
+	int *last;
+	int nr_of_sectors;
+} cell_list;
+
+static unsigned long long rng_state = 1;
+
+static unsigned long long rng_next(void)
+{
+	/* xorshift64*; the workloads only need to be the same every run */
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 2685821657736338717ULL;
+}
+
+static int rng_range(int lo, int hi)
+{
+	return lo + (int)(rng_next() % (unsigned long long)(hi - lo + 1));
+}
+
+/* Allocations, counted by wrapping the allocator. glibc lets a program
+ * replace malloc for every library it uses, GLib's list nodes included. */
+static long long nr_of_allocations = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size)
+{
+	nr_of_allocations++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	nr_of_allocations++;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+	if(p == NULL)
+		nr_of_allocations++;
+	return __libc_realloc(p, size);
+}
+#define ALLOCATIONS_COUNTED 1
+#else
+#define ALLOCATIONS_COUNTED 0
+#endif
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static cell_list *cell_list_new(const char *name, int nr_of_cells)
+{
+	cell_list *cells = calloc(1, sizeof(cell_list));
+
+	cells->name = name;
+	cells->first = calloc(nr_of_cells, sizeof(int));
+	cells->last = calloc(nr_of_cells, sizeof(int));
+	return cells;
+}
+
+static void cell_list_add(cell_list *cells, int first, int last)
+{
+	cells->first[cells->nr_of_cells] = first;
+	cells->last[cells->nr_of_cells] = last;
+	cells->nr_of_cells++;
+	if(last + 1 > cells->nr_of_sectors)
+		cells->nr_of_sectors = last + 1;
+}
+
+static void cell_list_free(cell_list *cells)
+{
+	free(cells->first);
+	free(cells->last);
+	free(cells);
+}
+
+/* one PGC: cells one after the other with a gap now and then */
+static cell_list *make_sorted(int nr_of_cells)
+{
+	cell_list *cells = cell_list_new("sorted", nr_of_cells);
+	int sector = 0, i, length;
+
+	for(i = 0; i < nr_of_cells; i++)
+	{
+		if(rng_range(0, 3) == 0)
+			sector += rng_range(1, 64);
+		length = rng_range(16, 1024);
+		cell_list_add(cells, sector, sector + length - 1);
+		sector += length;
+	}
+	return cells;
+}
+
+static cell_list *make_reversed(int nr_of_cells)
+{
+	cell_list *sorted = make_sorted(nr_of_cells);
+	cell_list *cells = cell_list_new("reversed", nr_of_cells);
+	int i;
+
+	for(i = nr_of_cells - 1; i >= 0; i--)
+		cell_list_add(cells, sorted->first[i], sorted->last[i]);
+	cell_list_free(sorted);
+	return cells;
+}
+
+/* angle blocks: each angle's cell spans the whole block it is
+ * interleaved with, as in the cell playback table */
+static cell_list *make_angles(int nr_of_blocks, int angles)
+{
+	cell_list *cells = cell_list_new("angles", nr_of_blocks * (angles + 2));
+	int sector = 0, block, a, ilvus, ilvu_size;
+
+	for(block = 0; block < nr_of_blocks; block++)
+	{
+		/* a normal cell before the block */
+		cell_list_add(cells, sector, sector + 255);
+		sector += 256 + rng_range(0, 8);
+
+		ilvus = rng_range(4, 32);
+		ilvu_size = rng_range(16, 128);
+		for(a = 0; a < angles; a++)
+			cell_list_add(cells, sector + a * ilvu_size, sector + ((ilvus - 1) * angles + a + 1) * ilvu_size - 1);
+		sector += ilvus * angles * ilvu_size;
+
+		cell_list_add(cells, sector, sector + 127);
+		sector += 128;
+	}
+	return cells;
+}
+
+/* many PGCs playing parts of the same material in any order */
+static cell_list *make_overlapping(int nr_of_cells, int nr_of_sectors)
+{
+	cell_list *cells = cell_list_new("overlapping", nr_of_cells);
+	int i, first, length;
+
+	for(i = 0; i < nr_of_cells; i++)
+	{
+		length = rng_range(1, 512);
+		first = rng_range(0, nr_of_sectors - length);
+		cell_list_add(cells, first, first + length - 1);
+	}
+	return cells;
+}
+
+static cell_list *read_cells(const char *filename)
+{
+	FILE *stream;
+	cell_list *cells;
+	int first, last, n = 0, size = 1024;
+	char line[128];
+
+	if((stream = fopen(filename, "r")) == NULL)
+	{
+		perror(filename);
+		return NULL;
+	}
+
+	cells = cell_list_new(filename, size);
+	while(fgets(line, sizeof(line), stream) != NULL)
+	{
+		if(sscanf(line, "%d %d", &first, &last) != 2)
+			continue;
+		if(first < 0 || last < first || last >= MAX_SECTORS)
+		{
+			fprintf(stderr, "%s: ignoring cell %d %d\n", filename, first, last);
+			continue;
+		}
+		if(n == size)
+		{
+			size *= 2;
+			cells->first = realloc(cells->first, size * sizeof(int));
+			cells->last = realloc(cells->last, size * sizeof(int));
+		}
+		cell_list_add(cells, first, last);
+		n++;
+	}
+	fclose(stream);
+
+	if(n == 0)
+	{
+		fprintf(stderr, "%s: no cells\n", filename);
+		cell_list_free(cells);
+		return NULL;
+	}
+	return cells;
+}
+
+static GSList *build(const cell_list *cells)
+{
+	GSList *range_list = NULL;
+	int i;
+
+	for(i = 0; i < cells->nr_of_cells; i++)
+		add_sector_range_list(&range_list, cells->first[i], cells->last[i]);
+	return range_list;
+}
+
+/* The reference: a byte per sector. Same contract as find_next_sectors. */
+static int reference_next(const unsigned char *used, int nr_of_sectors, int offset)
+{
+	int i;
+
+	if(offset < nr_of_sectors && used[offset])
+	{
+		for(i = offset; i < nr_of_sectors && used[i]; i++)
+			;
+		return i - offset;
+	}
+	for(i = offset; i < nr_of_sectors && !used[i]; i++)
+		;
+	return i < nr_of_sectors ? offset - i : -INT_MAX;
+}
+
+/* walk the domain as the -r u copy loop does; returns the number of queries */
+static long walk_list(GSList *range_list, int nr_of_sectors, long long *checksum)
+{
+	int offset = 0, next;
+	long queries = 0;
+
+	while(offset < nr_of_sectors)
+	{
+		next = find_next_sectors(range_list, offset);
+		queries++;
+		*checksum += next;
+		if(next == -INT_MAX)
+			break;
+		offset += next > 0 ? (next < QUERY_MAX ? next : QUERY_MAX) : -next;
+	}
+	return queries;
+}
+
+static long walk_bitmap(const sector_bitmap *bitmap, int nr_of_sectors, long long *checksum)
+{
+	int offset = 0, next;
+	long queries = 0;
+
+	while(offset < nr_of_sectors)
+	{
+		next = sector_bitmap_next_run(bitmap, offset, QUERY_MAX);
+		queries++;
+		*checksum += next;
+		if(next == -INT_MAX)
+			break;
+		offset += next > 0 ? next : -next;
+	}
+	return queries;
+}
+
+/* Compare the list and the bitmap with the reference; returns the number of
+ * differences, after printing the first few. */
+static int check(const cell_list *cells)
+{
+	GSList *range_list = build(cells), *node;
+	sector_bitmap *bitmap;
+	unsigned char *used;
+	int nr_of_sectors = cells->nr_of_sectors + QUERY_MAX;
+	int errors = 0, previous_end = -2, offset, expected, got, limited, i;
+
+	used = calloc(nr_of_sectors, 1);
+	for(i = 0; i < cells->nr_of_cells; i++)
+		memset(used + cells->first[i], 1, cells->last[i] - cells->first[i] + 1);
+
+	/* sorted, neither overlapping nor adjacent */
+	for(node = range_list; node != NULL; node = g_slist_next(node))
+	{
+		sector_range *range = node->data;
+
+		if(range->start > range->end || range->start <= previous_end + 1)
+		{
+			if(errors++ < 5)
+				fprintf(stderr, "%s: range %d-%d after one ending at %d\n", cells->name, range->start, range->end, previous_end);
+		}
+		previous_end = range->end;
+	}
+
+	bitmap = sector_bitmap_new(nr_of_sectors);
+	sector_bitmap_add_range_list(bitmap, range_list);
+
+	for(offset = 0; offset < nr_of_sectors; offset++)
+	{
+		expected = reference_next(used, nr_of_sectors, offset);
+		got = find_next_sectors(range_list, offset);
+		if(got != expected && errors++ < 5)
+			fprintf(stderr, "%s: find_next_sectors(%d) is %d, not %d\n", cells->name, offset, got, expected);
+
+		limited = expected > QUERY_MAX ? QUERY_MAX : expected;
+		got = sector_bitmap_next_run(bitmap, offset, QUERY_MAX);
+		if(got != limited && errors++ < 5)
+			fprintf(stderr, "%s: sector_bitmap_next_run(%d) is %d, not %d\n", cells->name, offset, got, limited);
+
+		/* the reference is slow on long runs; skip ahead inside them */
+		if(expected > 64 && offset + 1 < nr_of_sectors && used[offset + 1])
+			offset += expected - 2 > 0 ? (expected - 2) / 2 : 0;
+	}
+
+	sector_bitmap_free(bitmap);
+	free_sector_range_list(range_list);
+	free(used);
+	return errors;
+}
+
+static int bench(const cell_list *cells, int repeats)
+{
+	GSList *range_list;
+	sector_bitmap *bitmap;
+	long long allocations, checksum = 0;
+	long queries = 0;
+	double start, build_ns, list_ns, bitmap_ns;
+	int nr_of_ranges, errors, r;
+
+	errors = check(cells);
+
+	allocations = nr_of_allocations;
+	start = now_ns();
+	for(r = 0; r < repeats; r++)
+		free_sector_range_list(build(cells));
+	build_ns = (now_ns() - start) / repeats / cells->nr_of_cells;
+	allocations = (nr_of_allocations - allocations) / repeats;
+
+	range_list = build(cells);
+	nr_of_ranges = g_slist_length(range_list);
+
+	start = now_ns();
+	for(r = 0; r < repeats; r++)
+		queries = walk_list(range_list, cells->nr_of_sectors, &checksum);
+	list_ns = (now_ns() - start) / repeats / queries;
+
+	bitmap = sector_bitmap_new(cells->nr_of_sectors);
+	sector_bitmap_add_range_list(bitmap, range_list);
+	start = now_ns();
+	for(r = 0; r < repeats; r++)
+		queries = walk_bitmap(bitmap, cells->nr_of_sectors, &checksum);
+	bitmap_ns = (now_ns() - start) / repeats / queries;
+
+	printf("%-16.16s %7d %7d %10.1f ", cells->name, cells->nr_of_cells, nr_of_ranges, build_ns);
+	if(ALLOCATIONS_COUNTED)
+		printf("%10.2f ", (double)allocations / cells->nr_of_cells);
+	else
+		printf("%10s ", "-");
+	printf("%10.1f %10.1f %s\n", list_ns, bitmap_ns, errors ? "FAILED" : "ok");
+
+	/* keep the walks from being optimised away */
+	if(checksum == 42)
+		fputc(' ', stderr);
+
+	sector_bitmap_free(bitmap);
+	free_sector_range_list(range_list);
+	return errors;
+}
+
+int main(int argc, char *argv[])
+{
+	cell_list *cells;
+	int repeats = 10;
+	int errors = 0;
+	int i = 1;
+
+	if(argc > 2 && strcmp(argv[1], "-n") == 0)
+	{
+		repeats = atoi(argv[2]);
+		i = 3;
+	}
+	if(repeats < 1 || (i < argc && argv[i][0] == '-'))
+	{
+		fprintf(stderr, "Usage: %s [-n REPEATS] [CELL-LIST]...\n", argv[0]);
+		return 1;
+	}
+
+	printf("%-16s %7s %7s %10s %10s %10s %10s\n", "cells", "n", "ranges", "add ns", "allocs", "list ns", "bitmap ns");
+
+	errors += bench(cells = make_sorted(2000), repeats);
+	cell_list_free(cells);
+	errors += bench(cells = make_reversed(2000), repeats);
+	cell_list_free(cells);
+	errors += bench(cells = make_angles(200, 4), repeats);
+	cell_list_free(cells);
+	errors += bench(cells = make_overlapping(20000, 4 * 1024 * 1024), repeats);
+	cell_list_free(cells);
+
+	for(; i < argc; i++)
+	{
+		if((cells = read_cells(argv[i])) == NULL)
+		{
+			errors++;
+			continue;
+		}
+		errors += bench(cells, repeats);
+		cell_list_free(cells);
+	}
+
+	return errors ? 1 : 0;
+}
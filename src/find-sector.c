@@ -32,6 +32,9 @@ typedef struct remap_s remap_t;
 
 #include <config.h>
 
+#include "find-sector.h"
+#include "probes.h"
+
 #ifdef HAVE_DVDNAV_DVDDOMAIN_TYPE
 #define FP_DOMAIN DVD_DOMAIN_FirstPlay
 #define VTS_DOMAIN DVD_DOMAIN_VTSTitle
@@ -51,12 +54,6 @@ typedef struct remap_s remap_t;
 GSList *title_set_sector_ranges[100] = {0};
 int max_title_set = 0;
 
-typedef struct sector_range
-{
-	int start;
-	int end;
-} sector_range;
-
 /* This function add a range to a sorted list of ranges. If the range overlaps or is adjacent to existing ranges, the ranges are combined. */
 
 void add_sector_range_list( GSList **range_list, int start, int end)
@@ -72,90 +69,43 @@ void add_sector_range_list( GSList **range_list, int start, int end)
 	GSList *previous_node = NULL;
 
 	GSList *node = *range_list;
-	GSList *dummy;
+	GSList *next;
 
-	while(node != NULL)
+	// skip the ranges that end before this one starts, adjacent ones excepted
+	while(node != NULL && ((sector_range *)(node->data))->end + 1 < start)
 	{
-		// ends before this node
-		if(end + 1 < ((sector_range *)(node->data))->start)
-		{
-			// start overlaps or adjacent with prev node
-			if(previous_node != NULL && start  <= ((sector_range *)(previous_node->data))->end + 1)
-			{
-				((sector_range *)(previous_node->data))->end = end;
-//fprintf(stderr, "start\n");
-			}
-			else // not adjacent range before this one
-			{
-				range = malloc(sizeof(sector_range));
-				range->start = start;
-				range->end = end;
-
-				if(previous_node == NULL)
-					*range_list = g_slist_prepend(node, range);
-				else
-				{
-					//g_slist_insert_after(previous_node, range);
-					dummy = g_slist_insert_before(previous_node, node, range);
-					assert(dummy == previous_node);
-				}
-			}
-			break;
-		}
-		// ends adjadently or overlapping
-		else if (end  <= ((sector_range *)(node->data))->end)
-		{
-			// starts before this node
-			if(start < ((sector_range *)(node->data))->start)
-			{
-				// start is adjacent or overlapping with previous node
-				if(previous_node != NULL && start  <= ((sector_range *)(previous_node->data))->end + 1)
-				{
-					((sector_range *)(previous_node->data))->end = ((sector_range *)(node->data))->end;
-					if(node->data)
-					{
-						free(node->data);
-						node->data = NULL;
-					}
-					dummy = g_slist_delete_link(previous_node, node);
-					assert(dummy == previous_node);
-
-					node = previous_node;
-				}
-				else
-					((sector_range *)(node->data))->start = start;
-			}
-			break;
-		}
 		previous_node = node;
 		node = g_slist_next(node);
 	}
 
-	if(node == NULL)
+	// ends before the next range or there is none: a range of its own
+	if(node == NULL || end + 1 < ((sector_range *)(node->data))->start)
 	{
+		range = malloc(sizeof(sector_range));
+		range->start = start;
+		range->end = end;
+
 		if(previous_node == NULL)
-		{
-			range = malloc(sizeof(sector_range));
-			range->start = start;
-			range->end = end;
-			*range_list = g_slist_prepend(NULL, range);
-		}
+			*range_list = g_slist_prepend(node, range);
 		else
-		{
-			if(start  <= ((sector_range *)(previous_node->data))->end + 1)
-			{
-				((sector_range *)(previous_node->data))->end = end;
-			}
-			else
-			{
-				range = malloc(sizeof(sector_range));
-				range->start = start;
-				range->end = end;
-				//g_slist_insert_after(previous_node, range);
-				dummy = g_slist_insert_before(previous_node, node, range);
-				assert(dummy == previous_node);
-			}
-		}
+			previous_node->next = g_slist_prepend(node, range);
+		return;
+	}
+
+	// overlaps or is adjacent to node; grow it, then swallow the ranges
+	// after it that the new end reaches
+	range = node->data;
+	if(start < range->start)
+		range->start = start;
+	if(end > range->end)
+		range->end = end;
+
+	while((next = g_slist_next(node)) != NULL && ((sector_range *)(next->data))->start <= range->end + 1)
+	{
+		if(((sector_range *)(next->data))->end > range->end)
+			range->end = ((sector_range *)(next->data))->end;
+		free(next->data);
+		node->next = g_slist_delete_link(next, next);
 	}
 }
 
@@ -256,11 +206,14 @@ void create_titleset_range_list(dvd_reader_t *dvd, int titleset, GSList **range_
 	#endif
 	vm.dvd = 0x0;
 
+	PROBE1(vm__begin, titleset);
+
 	ifo_handle_t *vmg_ifo = ifoOpen( dvd, 0 );
 
 	if( !vmg_ifo )
 	{
 		fprintf( stderr, "Can't open VMG info.\n" );
+		PROBE1(vm__end, titleset);
 		return;
 	}
 
@@ -269,6 +222,7 @@ void create_titleset_range_list(dvd_reader_t *dvd, int titleset, GSList **range_
 	if( !vts_ifo )
 	{
 		fprintf( stderr, "Can't open VTS info.\n" );
+		PROBE1(vm__end, titleset);
 		return;
 	}
 
@@ -346,6 +300,7 @@ void create_titleset_range_list(dvd_reader_t *dvd, int titleset, GSList **range_
 				next_cell = cur_cell+1;
 
 				add_sector_range_list(range_list, cur_pgc->cell_playback[ cur_cell ].first_sector, cur_pgc->cell_playback[ cur_cell ].last_sector);
+				PROBE5(vm__cell, titleset, pgc_id, cur_cell + 1, cur_pgc->cell_playback[ cur_cell ].first_sector, cur_pgc->cell_playback[ cur_cell ].last_sector);
 #ifdef DUMP_CELL_INFO
 			fprintf(stderr, "ts, ttn, titleid,  c, cell, first, last =  %u, %u, %u, %u,  %u, %u %u \n",   tt_srpt->title[ titleid ].title_set_nr, ttn, titleid, c, cur_cell+1, cur_pgc->cell_playback[ cur_cell ].first_sector, cur_pgc->cell_playback[ cur_cell ].last_sector);
 #endif
@@ -414,6 +369,117 @@ void create_titleset_range_list(dvd_reader_t *dvd, int titleset, GSList **range_
 	}
 	ifoClose( vts_ifo );
 	ifoClose( vmg_ifo );
+	PROBE1(vm__end, titleset);
+}
+
+/* add the sectors of every cell in a pgc to the range list */
+static void add_pgc_range_list(GSList **range_list, pgc_t *pgc)
+{
+	int cell;
+
+	if(pgc == NULL || pgc->cell_playback == NULL)
+		return;
+
+	for(cell = 0; cell < pgc->nr_of_cells; cell++)
+	{
+		add_sector_range_list(range_list, pgc->cell_playback[ cell ].first_sector, pgc->cell_playback[ cell ].last_sector);
+#ifdef DUMP_CELL_INFO
+		fprintf(stderr, "menu cell, first, last =  %u, %u %u \n", cell+1, pgc->cell_playback[ cell ].first_sector, pgc->cell_playback[ cell ].last_sector);
+#endif
+	}
+}
+
+/* for a given dvd reference and title set, create a list that contains ranges of all sectors that are referenced by the menu domain.
+Title set 0 is the video manager, so the list describes VIDEO_TS.VOB (including the first play pgc), otherwise it describes VTS_XX_0.VOB.
+Sector numbers of menu cells are relative to the menu vobs, which is why they can not be mixed with the title domain list.
+Menu pgcs are entered through button commands that the vm can not follow ahead of time, so every cell of every pgc in every language unit is considered referenced.
+*/
+void create_menu_range_list(dvd_reader_t *dvd, int titleset, GSList **range_list)
+{
+	int lu;
+	int i;
+	pgcit_t *pgcit;
+
+	ifo_handle_t *ifo = ifoOpen( dvd, titleset );
+
+	if( !ifo )
+	{
+		fprintf( stderr, "Can't open %s info.\n", titleset ? "VTS" : "VMG" );
+		return;
+	}
+
+	if(titleset == 0)
+		add_pgc_range_list(range_list, ifo->first_play_pgc);
+
+	if(ifo->pgci_ut != NULL)
+	for(lu = 0; lu < ifo->pgci_ut->nr_of_lus; lu++)
+	{
+		pgcit = ifo->pgci_ut->lu[ lu ].pgcit;
+		if(pgcit == NULL)
+			continue;
+
+		for(i = 0; i < pgcit->nr_of_pgci_srp; i++)
+			add_pgc_range_list(range_list, pgcit->pgci_srp[ i ].pgc);
+	}
+
+	ifoClose( ifo );
+}
+
+/* for a given dvd reference, title set and domain, create a list that contains ranges of all sectors referenced by any pgc of the domain.
+Unlike create_titleset_range_list no commands are simulated, so this describes everything a player could be sent to, which is what a coverage report needs.
+*/
+void create_domain_range_list(dvd_reader_t *dvd, int titleset, dvd_read_domain_t domain, GSList **range_list)
+{
+	int i;
+	ifo_handle_t *vts_ifo;
+
+	if(domain == DVD_READ_MENU_VOBS)
+	{
+		create_menu_range_list(dvd, titleset, range_list);
+		return;
+	}
+
+	if(titleset == 0)
+		return;
+
+	vts_ifo = ifoOpen( dvd, titleset );
+
+	if( !vts_ifo )
+	{
+		fprintf( stderr, "Can't open VTS info.\n" );
+		return;
+	}
+
+	if(vts_ifo->vts_pgcit != NULL)
+	for(i = 0; i < vts_ifo->vts_pgcit->nr_of_pgci_srp; i++)
+		add_pgc_range_list(range_list, vts_ifo->vts_pgcit->pgci_srp[ i ].pgc);
+
+	ifoClose( vts_ifo );
+}
+
+/* for a given vts ifo and title number within the title set (vts_ttn), create a list that contains ranges of all sectors referenced by the pgcs of its chapters */
+void create_title_range_list(ifo_handle_t *vts_ifo, int ttn, GSList **range_list)
+{
+	int c;
+	int pgc_id;
+	int prev_pgc_id = -1;
+	ttu_t *ttu;
+
+	if(vts_ifo->vts_ptt_srpt == NULL || vts_ifo->vts_pgcit == NULL)
+		return;
+	if(ttn < 1 || ttn > vts_ifo->vts_ptt_srpt->nr_of_srpts)
+		return;
+
+	ttu = &vts_ifo->vts_ptt_srpt->title[ ttn - 1 ];
+	for(c = 0; c < ttu->nr_of_ptts; c++)
+	{
+		pgc_id = ttu->ptt[ c ].pgcn;
+		if(pgc_id == 0 || pgc_id > vts_ifo->vts_pgcit->nr_of_pgci_srp || pgc_id == prev_pgc_id)
+			continue;
+
+		add_pgc_range_list(range_list, vts_ifo->vts_pgcit->pgci_srp[ pgc_id - 1 ].pgc);
+		prev_pgc_id = pgc_id;
+	}
 }
 
 /* Starting at offset, find, return count of consecutive known sectors.
@@ -460,6 +526,14 @@ int main(int argc, char *argv[])
 		free_sector_range_list(range_list);
 		range_list = NULL;
 	}
+	for( i = 0; i <= vmg_nr_of_title_sets; i++)
+	{
+		fprintf(stderr, "menu ts = %d\n", i);
+		create_menu_range_list(dvd, i, &range_list);
+		dump_sector_range_list(range_list);
+		free_sector_range_list(range_list);
+		range_list = NULL;
+	}
 	DVDClose( dvd );
 	return 0;
 }
@@ -2,7 +2,21 @@
 #define FIND_SECTORS_H
 
 #include <glib.h>
+
+#include <dvdread/ifo_types.h>
+
+typedef struct sector_range
+{
+	int start;
+	int end;
+} sector_range;
+
+void add_sector_range_list(GSList **range_list, int start, int end);
 void create_titleset_range_list(dvd_reader_t *dvd, int titleset,  GSList **range_list);
+void create_menu_range_list(dvd_reader_t *dvd, int titleset, GSList **range_list);
+void create_domain_range_list(dvd_reader_t *dvd, int titleset, dvd_read_domain_t domain, GSList **range_list);
+void create_title_range_list(ifo_handle_t *vts_ifo, int ttn, GSList **range_list);
+void free_sector_range_list(GSList *range_list);
 int find_next_sectors(GSList *range_list, int offset);
 
 #endif
@@ -0,0 +1,317 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Read latency heatmap. Every read the copy loops make is put in a bucket of
+ * HEATMAP_BUCKET sectors by its position on the disc, which libdvdread's UDF
+ * lookup gives for the first file of each domain. Slow zones tend to turn into
+ * unreadable ones, so the map, together with the padded extents, tells how
+ * healthy disc and drive are.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+/* C standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* libdvdread */
+#include <dvdread/dvd_reader.h>
+#include <dvdread/dvd_udf.h>
+
+/* internationalisation */
+#include "gettext.h"
+#define _(String) gettext(String)
+
+#include "dvdbackup.h"
+#include "dvdlogger.h"
+#include "heatmap.h"
+
+#define MAX_TITLE_SETS 100
+
+/* sectors per bucket (8 MiB) and buckets per line of the text map */
+#define HEATMAP_BUCKET 4096
+#define HEATMAP_COLUMNS 64
+
+/* Flag for heatmap mode */
+int heatmap = 0;
+
+typedef struct {
+	long long blocks;
+	long long reads;	/* counted in the bucket they start in */
+	double us;		/* read time, shared out by blocks between buckets */
+	long max_us;
+	long long padded;
+	int approximate;	/* holds a domain placed by guesswork */
+} heatmap_bucket_t;
+
+static heatmap_bucket_t *buckets = NULL;
+static int nr_of_buckets = 0;
+
+/* [title set][0 = menu VOB, 1 = title VOBs], sector of the domain's first
+ * file plus one, so 0 is "not looked up yet" */
+static uint32_t domain_start[MAX_TITLE_SETS][2];
+
+/* domains placed by guesswork, indexed like domain_start */
+static char domain_guessed[MAX_TITLE_SETS][2];
+
+/* set when a domain had to be placed by guesswork */
+static int approximate = 0;
+
+
+static int domain_index(dvd_read_domain_t domain) {
+	return domain == DVD_READ_MENU_VOBS ? 0 : 1;
+}
+
+
+/* Find where a domain starts on the disc; repeated calls for the same domain
+ * are no-ops. */
+void heatmap_open_domain(dvd_reader_t *dvd, int title_set, dvd_read_domain_t domain) {
+	char filename[32];
+	uint32_t size;
+	uint32_t start;
+
+	if (title_set < 0 || title_set >= MAX_TITLE_SETS || domain_start[title_set][domain_index(domain)] != 0) {
+		return;
+	}
+
+	if (title_set == 0) {
+		strcpy(filename, "/VIDEO_TS/VIDEO_TS.VOB");
+	} else {
+		/* the title VOBs follow each other on the disc */
+		snprintf(filename, sizeof(filename), "/VIDEO_TS/VTS_%02d_%d.VOB",
+				title_set, domain == DVD_READ_MENU_VOBS ? 0 : 1);
+	}
+
+	start = UDFFindFile(dvd, filename, &size);
+	if (start == 0) {
+		/* not a disc or image; put the domain after everything seen so far */
+		start = nr_of_buckets * HEATMAP_BUCKET;
+		if (!approximate) {
+			XLog1(pApp, _("Cannot find %s on the disc; heatmap positions are approximate"), filename);
+		}
+		approximate = 1;
+		domain_guessed[title_set][domain_index(domain)] = 1;
+	}
+
+	domain_start[title_set][domain_index(domain)] = start + 1;
+}
+
+
+/* Record a read of count sectors at offset in a domain that took read_us;
+ * padded is set if the read failed and the sectors were padded. */
+void heatmap_add(int title_set, dvd_read_domain_t domain, int offset, int count, long read_us, int padded) {
+	heatmap_bucket_t *b;
+	long long lba, end;
+	int first, last, i;
+
+	if (count <= 0 || title_set < 0 || title_set >= MAX_TITLE_SETS
+			|| domain_start[title_set][domain_index(domain)] == 0) {
+		return;
+	}
+
+	lba = domain_start[title_set][domain_index(domain)] - 1 + (long long)offset;
+	end = lba + count;
+	first = lba / HEATMAP_BUCKET;
+	last = (end - 1) / HEATMAP_BUCKET;
+
+	if (last >= nr_of_buckets) {
+		b = realloc(buckets, (last + 1) * sizeof(heatmap_bucket_t));
+		if (b == NULL) {
+			return;
+		}
+		memset(b + nr_of_buckets, 0, (last + 1 - nr_of_buckets) * sizeof(heatmap_bucket_t));
+		buckets = b;
+		nr_of_buckets = last + 1;
+	}
+
+	/* a read that crosses buckets is shared between them by sectors */
+	buckets[first].reads++;
+	for (i = first; i <= last; i++) {
+		long long from = lba > (long long)i * HEATMAP_BUCKET ? lba : (long long)i * HEATMAP_BUCKET;
+		long long to = end < (long long)(i + 1) * HEATMAP_BUCKET ? end : (long long)(i + 1) * HEATMAP_BUCKET;
+
+		b = &buckets[i];
+		b->approximate |= domain_guessed[title_set][domain_index(domain)];
+		if (read_us > b->max_us) {
+			b->max_us = read_us;
+		}
+		if (padded) {
+			b->padded += to - from;
+		} else {
+			b->blocks += to - from;
+			b->us += (double)read_us * (to - from) / count;
+		}
+	}
+}
+
+
+static int compare_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+/* median time per sector over the buckets that were read */
+static double heatmap_median(void) {
+	double *per_block;
+	double median = 0;
+	int n = 0, i;
+
+	if ((per_block = malloc(nr_of_buckets * sizeof(double) + 1)) == NULL) {
+		return 0;
+	}
+	for (i = 0; i < nr_of_buckets; i++) {
+		if (buckets[i].blocks > 0) {
+			per_block[n++] = buckets[i].us / buckets[i].blocks;
+		}
+	}
+	if (n > 0) {
+		qsort(per_block, n, sizeof(double), compare_double);
+		median = per_block[n / 2];
+	}
+	free(per_block);
+
+	return median;
+}
+
+
+static char heatmap_cell(const heatmap_bucket_t *b, double median) {
+	double ratio;
+
+	if (b->padded > 0) {
+		return 'X';
+	}
+	if (b->blocks == 0) {
+		return ' ';
+	}
+	if (median <= 0) {
+		return '.';
+	}
+
+	ratio = b->us / b->blocks / median;
+	if (ratio <= 1.5) {
+		return '.';
+	} else if (ratio <= 2) {
+		return ':';
+	} else if (ratio <= 4) {
+		return '+';
+	} else if (ratio <= 8) {
+		return '*';
+	}
+	return '#';
+}
+
+
+static int heatmap_write_csv(const char *filename) {
+	FILE *stream;
+	heatmap_bucket_t *b;
+	int i;
+
+	if ((stream = fopen(filename, "w")) == NULL) {
+		XLog0(pApp, _("Error creating %s"), filename);
+		return 1;
+	}
+
+	fprintf(stream, "lba,sectors,reads,us_per_sector,max_read_us,mib_per_s,padded,approximate\n");
+	for (i = 0; i < nr_of_buckets; i++) {
+		b = &buckets[i];
+		if (b->blocks == 0 && b->padded == 0) {
+			continue;
+		}
+		fprintf(stream, "%lld,%lld,%lld,%.1f,%ld,%.2f,%lld,%d\n",
+				(long long)i * HEATMAP_BUCKET, b->blocks, b->reads,
+				b->blocks > 0 ? b->us / b->blocks : 0.0, b->max_us,
+				b->us > 0 ? b->blocks * (double)DVD_VIDEO_LB_LEN / b->us * 1e6 / (1024 * 1024) : 0.0,
+				b->padded, b->approximate);
+	}
+
+	if (fclose(stream) != 0) {
+		XLog0(pApp, _("Error writing %s"), filename);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+static int heatmap_write_text(const char *filename) {
+	FILE *stream;
+	double median = heatmap_median();
+	int i;
+
+	if ((stream = fopen(filename, "w")) == NULL) {
+		XLog0(pApp, _("Error creating %s"), filename);
+		return 1;
+	}
+
+	fprintf(stream, _("Read latency heatmap of %s in %s\n"),
+			pApp->title_name ? pApp->title_name : "", pApp->dev_path ? pApp->dev_path : "");
+	fprintf(stream, _("Each cell is %d sectors; median %.1f us per sector\n"), HEATMAP_BUCKET, median);
+	fprintf(stream, _("'.' up to 1.5x the median, ':' 2x, '+' 4x, '*' 8x, '#' slower, 'X' padded\n"));
+	if (approximate) {
+		fprintf(stream, _("Positions are approximate\n"));
+	}
+
+	for (i = 0; i < nr_of_buckets; i++) {
+		if (i % HEATMAP_COLUMNS == 0) {
+			fprintf(stream, "%s%10lld |", i > 0 ? "|\n" : "\n", (long long)i * HEATMAP_BUCKET);
+		}
+		fputc(heatmap_cell(&buckets[i], median), stream);
+	}
+	if (nr_of_buckets > 0) {
+		fprintf(stream, "%*s|\n", (HEATMAP_COLUMNS - nr_of_buckets % HEATMAP_COLUMNS) % HEATMAP_COLUMNS, "");
+	}
+
+	if (fclose(stream) != 0) {
+		XLog0(pApp, _("Error writing %s"), filename);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/* Write prefix.csv, one row per bucket, and prefix.txt, the map. */
+int heatmap_write(const char *prefix) {
+	char *filename;
+	size_t length = strlen(prefix) + sizeof(".csv");
+	int result;
+
+	if ((filename = malloc(length)) == NULL) {
+		XLog0(pApp, _("Failed to allocate %zu bytes for a filename."), length);
+		return 1;
+	}
+
+	snprintf(filename, length, "%s.csv", prefix);
+	result = heatmap_write_csv(filename);
+	snprintf(filename, length, "%s.txt", prefix);
+	result |= heatmap_write_text(filename);
+
+	free(filename);
+	return result;
+}
+
+
+void heatmap_free(void) {
+	free(buckets);
+	buckets = NULL;
+	nr_of_buckets = 0;
+	memset(domain_start, 0, sizeof(domain_start));
+	memset(domain_guessed, 0, sizeof(domain_guessed));
+	approximate = 0;
+}
@@ -0,0 +1,13 @@
+#ifndef HEATMAP_H_
+#define HEATMAP_H_
+
+#include <dvdread/dvd_reader.h>
+
+extern int heatmap;
+
+void heatmap_open_domain(dvd_reader_t *dvd, int title_set, dvd_read_domain_t domain);
+void heatmap_add(int title_set, dvd_read_domain_t domain, int offset, int count, long read_us, int padded);
+int heatmap_write(const char *prefix);
+void heatmap_free(void);
+
+#endif /* HEATMAP_H_ */
@@ -1,7 +1,15 @@
-#include <alloca.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <pwd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 
 #include <dvdread/dvd_reader.h>
 
@@ -9,88 +17,896 @@
 
 #include "dvdbackup.h"
 #include "dvdlogger.h"
+#include "logdb.h"
+#include "probes.h"
 
-#define CONNINFO_MAX_SZ 128
+#define CONNINFO_MAX_SZ 256
+
+/* a batch is sent once it has this many rows ... */
+#define LOGDB_BATCH_ROWS 500
+/* ... or this many bytes ... */
+#define LOGDB_BATCH_BYTES (256 * 1024)
+/* ... or its oldest row has waited this long, in milliseconds */
+#define LOGDB_BATCH_MS 1000
+
+/* longest a batch may take to send before the server is given up on, in
+ * milliseconds; the logging thread never waits on the socket for longer */
+#define LOGDB_SEND_MS 2000
+
+/* reconnect attempts back off from the first to the last, in seconds */
+#define LOGDB_BACKOFF_MIN 1
+#define LOGDB_BACKOFF_MAX 60
+
+/* connecting and noticing a dead peer must not take long; the logging
+ * thread is the one waiting */
+#define LOGDB_CONNINFO "port=5432 dbname=%s connect_timeout=5 keepalives=1 " \
+	"keepalives_idle=10 keepalives_interval=5 keepalives_count=3"
+
+/* in the order batches are sent, so a run is stored before its extents */
+typedef enum {
+	LOGDB_TABLE_RUN,
+	LOGDB_TABLE_EXTENT,
+	LOGDB_TABLE_LOG,
+	LOGDB_NR_OF_TABLES
+} logdb_table_t;
+
+/* rows are spooled as "<table>\t<COPY row>" lines, so the replay knows
+ * where each one goes */
+static const struct {
+	const char *table;
+	const char *copy;
+} logdb_tables[LOGDB_NR_OF_TABLES] = {
+	{ "dvdbackup_run", "COPY dvdbackup_run (run_id, pid, host, device, disc, started) FROM STDIN" },
+	{ "dvdbackup_extent", "COPY dvdbackup_extent (run_id, title_set, domain, vob, lba, blocks, "
+			"read_us, write_us, status, dt) FROM STDIN" },
+	{ "dvdbackup_tbl", "COPY dvdbackup_tbl (pid, lvl, msg, dt) FROM STDIN" }
+};
+
+/*
+ * Rows are collected in COPY text format and sent with one COPY per batch
+ * instead of one INSERT round trip per message. Only the logging thread
+ * touches the batches.
+ */
+typedef struct {
+	char *buf;
+	size_t len;
+	size_t size;
+	int rows;
+	struct timespec first;
+} logdb_batch_t;
+
+static logdb_batch_t batches[LOGDB_NR_OF_TABLES];
+
+/* the run the extents belong to; its row is sent with the first extent,
+ * once the device and disc are known */
+static struct {
+	char id[128];
+	char host[64];
+	struct timespec started;
+	int stored;
+} run;
+
+/* how a COPY went */
+typedef enum {
+	LOGDB_SENT,
+	LOGDB_LOST,		/* the server went away; send again once it is back */
+	LOGDB_REFUSED,		/* the COPY itself failed, e.g. for a missing table */
+	LOGDB_REJECTED		/* the server did not take some of the rows */
+} logdb_result_t;
+
+typedef enum {
+	LOGDB_UP,
+	LOGDB_DOWN,		/* waiting for retry_at */
+	LOGDB_RESETTING		/* PQresetStart done, polling */
+} logdb_state_t;
+
+/*
+ * While the server is unreachable batches go to an append-only spool file
+ * and the connection is reset in the background, one non-blocking step per
+ * tick. Once it is back the spool is replayed.
+ *
+ * Every run of a user shares the spool, kept in $XDG_RUNTIME_DIR or else
+ * ~/.cache unless DVDBACKUP_LOGDB_SPOOL names it. Appending holds a shared
+ * flock on the lock file, and the replay takes it exclusively to move the
+ * spool aside, so no append lands in a file that is being replayed. The
+ * moved spool is flocked while it is replayed, so only one run sends it.
+ * Rows the server does not take go to the rejected file instead of coming
+ * back on every reconnect.
+ */
+static struct {
+	logdb_state_t state;
+	int backoff;
+	struct timespec retry_at;
+	int replay;
+	char spool[PATH_MAX];
+	char replaying[PATH_MAX + sizeof(".replay")];
+	char lock[PATH_MAX + sizeof(".lock")];
+	char rejected[PATH_MAX + sizeof(".rejected")];
+} server;
+
+static void server_down(PGconn *conn) {
+	clock_gettime(CLOCK_MONOTONIC, &server.retry_at);
+	server.retry_at.tv_sec += server.backoff;
+
+	if (server.state == LOGDB_UP) {
+		fprintf(stderr, "%s:%d\t lost the log database (%s); spooling to %s\n",
+				__FILE__, __LINE__, PQerrorMessage(conn), server.spool);
+	}
+	server.state = LOGDB_DOWN;
+
+	server.backoff *= 2;
+	if (server.backoff > LOGDB_BACKOFF_MAX) {
+		server.backoff = LOGDB_BACKOFF_MAX;
+	}
+}
+
+static void server_poll(PGconn *conn) {
+	struct timespec now;
+
+	switch (server.state) {
+		case LOGDB_UP:
+			return;
+		case LOGDB_DOWN:
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (now.tv_sec < server.retry_at.tv_sec ||
+					(now.tv_sec == server.retry_at.tv_sec && now.tv_nsec < server.retry_at.tv_nsec)) {
+				return;
+			}
+			if (PQresetStart(conn)) {
+				server.state = LOGDB_RESETTING;
+			} else {
+				server_down(conn);
+			}
+			return;
+		case LOGDB_RESETTING:
+			switch (PQresetPoll(conn)) {
+				case PGRES_POLLING_OK:
+					fprintf(stderr, "%s:%d\t reconnected to the log database\n", __FILE__, __LINE__);
+					PQsetnonblocking(conn, 1);
+					server.state = LOGDB_UP;
+					server.backoff = LOGDB_BACKOFF_MIN;
+					server.replay = 1;
+					break;
+				case PGRES_POLLING_FAILED:
+					server.state = LOGDB_DOWN;
+					server_down(conn);
+					break;
+				default:
+					/* still connecting; poll again on the next tick */
+					break;
+			}
+			return;
+	}
+}
 
 void dvdbackup_logdb_init(PGconn **conn) {
 	char conninfo[CONNINFO_MAX_SZ];
+	const char *dir;
 
 	uid_t uid = geteuid();
 	struct passwd *pw = getpwuid(uid);
 
-	snprintf(conninfo, CONNINFO_MAX_SZ, "port=5432 dbname=%s", pw ? pw->pw_name : "BAD_USER");
+	snprintf(conninfo, CONNINFO_MAX_SZ, LOGDB_CONNINFO, pw ? pw->pw_name : "BAD_USER");
 	*conn = PQconnectdb(conninfo);
+
+	/* not in a directory other users can write to, see spool_open */
+	if ((dir = getenv("DVDBACKUP_LOGDB_SPOOL")) != NULL) {
+		snprintf(server.spool, sizeof(server.spool), "%s", dir);
+	} else if ((dir = getenv("XDG_RUNTIME_DIR")) != NULL && dir[0] == '/') {
+		snprintf(server.spool, sizeof(server.spool), "%s/dvdbackup-logdb.spool", dir);
+	} else {
+		if ((dir = getenv("HOME")) == NULL || dir[0] != '/') {
+			dir = pw ? pw->pw_dir : "";
+		}
+		snprintf(server.spool, sizeof(server.spool), "%s/.cache", dir);
+		mkdir(server.spool, 0700);
+		snprintf(server.spool, sizeof(server.spool), "%s/.cache/dvdbackup-logdb.spool", dir);
+	}
+	snprintf(server.replaying, sizeof(server.replaying), "%s.replay", server.spool);
+	snprintf(server.lock, sizeof(server.lock), "%s.lock", server.spool);
+	snprintf(server.rejected, sizeof(server.rejected), "%s.rejected", server.spool);
+
+	clock_gettime(CLOCK_REALTIME, &run.started);
+	if (gethostname(run.host, sizeof(run.host)) != 0) {
+		strcpy(run.host, "localhost");
+	}
+	run.host[sizeof(run.host) - 1] = '\0';
+	snprintf(run.id, sizeof(run.id), "%s-%d-%ld", run.host, (int)getpid(), (long)run.started.tv_sec);
+	run.stored = 0;
+
+	server.state = LOGDB_UP;
+	server.backoff = LOGDB_BACKOFF_MIN;
+	server.replay = access(server.spool, F_OK) == 0 || access(server.replaying, F_OK) == 0;
+
+	if (*conn != NULL && PQstatus(*conn) == CONNECTION_OK) {
+		/* the copy loop must never wait on a dead server, see copy_rows */
+		PQsetnonblocking(*conn, 1);
+	} else if (*conn != NULL) {
+		fprintf(stderr, "%s:%d\t failed to connect to the log database (%s); spooling to %s\n",
+				__FILE__, __LINE__, PQerrorMessage(*conn), server.spool);
+		server.state = LOGDB_DOWN;
+		server_down(*conn);
+	}
 }
 
 void dvdbackup_logdb_exit(PGconn *conn) {
+	int i;
+
+	dvdbackup_logdb_flush(pApp, 1);
 	PQfinish(conn);
+	for (i = 0; i < LOGDB_NR_OF_TABLES; i++) {
+		free(batches[i].buf);
+		batches[i].buf = NULL;
+		batches[i].len = batches[i].size = 0;
+	}
+}
+
+static int batch_reserve(logdb_batch_t *batch, size_t n) {
+	char *buf;
+	size_t size = batch->size ? batch->size : 4096;
+
+	if (batch->len + n <= batch->size) {
+		return 0;
+	}
+	while (size < batch->len + n) {
+		size *= 2;
+	}
+	if ((buf = realloc(batch->buf, size)) == NULL) {
+		return 1;
+	}
+	batch->buf = buf;
+	batch->size = size;
+	return 0;
+}
+
+/* append text, escaped for a COPY text format column */
+static void batch_append_escaped(logdb_batch_t *batch, const char *s) {
+	for (; *s; s++) {
+		switch (*s) {
+			case '\\':
+				batch->buf[batch->len++] = '\\';
+				batch->buf[batch->len++] = '\\';
+				break;
+			case '\t':
+				batch->buf[batch->len++] = '\\';
+				batch->buf[batch->len++] = 't';
+				break;
+			case '\n':
+				batch->buf[batch->len++] = '\\';
+				batch->buf[batch->len++] = 'n';
+				break;
+			case '\r':
+				batch->buf[batch->len++] = '\\';
+				batch->buf[batch->len++] = 'r';
+				break;
+			default:
+				batch->buf[batch->len++] = *s;
+		}
+	}
+}
+
+static long elapsed_ms(const struct timespec *since) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec) * 1000L + (now.tv_nsec - since->tv_nsec) / 1000000L;
+}
+
+/* Wait until the socket of conn is ready for events, but not past until.
+ * Returns the events that are ready, 0 on timeout or error. */
+static int wait_socket(PGconn *conn, short events, const struct timespec *until) {
+	struct pollfd pfd;
+	long ms;
+	int n;
+
+	if ((pfd.fd = PQsocket(conn)) < 0) {
+		return 0;
+	}
+	pfd.events = events;
+
+	for (;;) {
+		if ((ms = -elapsed_ms(until)) <= 0) {
+			return 0;
+		}
+		if ((n = poll(&pfd, 1, (int)ms)) > 0) {
+			return pfd.revents;
+		}
+		if (n == 0 || errno != EINTR) {
+			return 0;
+		}
+	}
+}
+
+/* Send what libpq has buffered. Returns 0 once it is all sent. */
+static int flush_output(PGconn *conn, const struct timespec *until) {
+	int result, ready;
+
+	while ((result = PQflush(conn)) == 1) {
+		if ((ready = wait_socket(conn, POLLIN | POLLOUT, until)) == 0) {
+			return 1;
+		}
+		/* the server may be waiting for us to read before it reads */
+		if ((ready & POLLIN) && !PQconsumeInput(conn)) {
+			return 1;
+		}
+	}
+
+	return result == 0 ? 0 : 1;
 }
 
-void dvdbackup_logdb(void *priv, int lvl, const char *fmt, va_list ap_) {
-	char loglevel[9];
-	char pid_s[10];
-	const char * values[3];
+/* The next result of the command in flight, or NULL when there are no more
+ * or, with *stuck set, when none came before until. */
+static PGresult *get_result(PGconn *conn, const struct timespec *until, int *stuck) {
+	while (PQisBusy(conn)) {
+		if (wait_socket(conn, POLLIN, until) == 0 || !PQconsumeInput(conn)) {
+			*stuck = 1;
+			return NULL;
+		}
+	}
+
+	return PQgetResult(conn);
+}
+
+/*
+ * Send rows with one COPY.
+ *
+ * The connection is non-blocking and no step may wait past LOGDB_SEND_MS,
+ * so a server that stops answering costs the logging thread that long once
+ * and is then given up on; the ring it drains never fills up behind a
+ * blocked send.
+ */
+static logdb_result_t copy_rows(PGconn *conn, const char *copy, const char *rows, size_t len) {
 	PGresult *res;
-	app_data_t *pApp = priv;
-	char *buf = NULL;
-	int bufsz = 0;
+	struct timespec until;
+	int ok, result, stuck = 0;
 
-	va_list ap;
+	clock_gettime(CLOCK_MONOTONIC, &until);
+	until.tv_sec += LOGDB_SEND_MS / 1000;
+	until.tv_nsec += (LOGDB_SEND_MS % 1000) * 1000000L;
+	if (until.tv_nsec >= 1000000000L) {
+		until.tv_sec++;
+		until.tv_nsec -= 1000000000L;
+	}
 
-	va_copy(ap, ap_);
-	bufsz = vsnprintf(buf, 0, fmt, ap);
-	va_end(ap);
+	if (!PQsendQuery(conn, copy) || flush_output(conn, &until) != 0) {
+		stuck = 1;
+		ok = 0;
+	} else {
+		res = get_result(conn, &until, &stuck);
+		ok = PQresultStatus(res) == PGRES_COPY_IN;
+		PQclear(res);
+	}
+	if (!ok) {
+		fprintf(stderr, "%s:%d\t failed to start COPY: %s", __FILE__, __LINE__,
+				stuck ? "no answer from the log database\n" : PQerrorMessage(conn));
+		/* whatever else came back */
+		while (!stuck && (res = get_result(conn, &until, &stuck)) != NULL) {
+			PQclear(res);
+		}
+		if (stuck || PQstatus(conn) != CONNECTION_OK) {
+			server_down(conn);
+			return LOGDB_LOST;
+		}
+		return LOGDB_REFUSED;
+	}
+
+	/* 0 means the output buffer is full */
+	while ((result = PQputCopyData(conn, rows, (int)len)) == 0 && flush_output(conn, &until) == 0)
+		;
+	if (result != 1) {
+		ok = 0;
+		while ((result = PQputCopyEnd(conn, "dvdbackup: failed to send log batch")) == 0 &&
+				flush_output(conn, &until) == 0)
+			;
+	} else {
+		while ((result = PQputCopyEnd(conn, NULL)) == 0 && flush_output(conn, &until) == 0)
+			;
+	}
+	if (result != 1 || flush_output(conn, &until) != 0) {
+		stuck = 1;
+	}
+
+	while (!stuck && (res = get_result(conn, &until, &stuck)) != NULL) {
+		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+			fprintf(stderr, "%s:%d\t failed to store log rows: %s", __FILE__, __LINE__, PQerrorMessage(conn));
+			ok = 0;
+		}
+		PQclear(res);
+	}
+	if (stuck) {
+		fprintf(stderr, "%s:%d\t no answer from the log database\n", __FILE__, __LINE__);
+	}
+	if (stuck || (!ok && PQstatus(conn) != CONNECTION_OK)) {
+		server_down(conn);
+		return LOGDB_LOST;
+	}
+
+	return ok ? LOGDB_SENT : LOGDB_REJECTED;
+}
+
+/* Open one of the spool files, creating it with O_CREAT in flags. A
+ * symlink, or a file another user owns or may write to, is refused rather
+ * than appended to or replayed into the database. Returns the descriptor or
+ * -1. */
+static int spool_open(const char *file, int flags) {
+	struct stat statbuf;
+	int fd;
+
+	if ((fd = open(file, flags | O_NOFOLLOW, 0600)) == -1) {
+		if (errno == ELOOP) {
+			fprintf(stderr, "%s:%d\t refusing %s: it is a symbolic link\n", __FILE__, __LINE__, file);
+		}
+		return -1;
+	}
+	if (fstat(fd, &statbuf) != 0 || !S_ISREG(statbuf.st_mode) || statbuf.st_uid != getuid()
+			|| (statbuf.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+		fprintf(stderr, "%s:%d\t refusing %s: not a private file of this user\n", __FILE__, __LINE__, file);
+		close(fd);
+		errno = EPERM;
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Take the spool lock, LOCK_SH or LOCK_EX. Returns the descriptor to give
+ * to spool_unlock, or -1 if there is no lock to be had. */
+static int spool_lock(int operation) {
+	int fd;
+
+	if ((fd = spool_open(server.lock, O_RDWR | O_CREAT)) == -1) {
+		return -1;
+	}
+	while (flock(fd, operation) == -1) {
+		if (errno != EINTR) {
+			close(fd);
+			return -1;
+		}
+	}
+
+	return fd;
+}
+
+static void spool_unlock(int fd) {
+	if (fd != -1) {
+		flock(fd, LOCK_UN);
+		close(fd);
+	}
+}
+
+/* Append already prefixed spool lines to file with a single write, so
+ * concurrent runs sharing it do not interleave. Returns 0 on success. */
+static int spool_write(const char *file, const char *lines, size_t len) {
+	ssize_t n;
+	int fd, lock;
+
+	lock = spool_lock(LOCK_SH);
+	fd = spool_open(file, O_WRONLY | O_CREAT | O_APPEND);
+	if (fd == -1) {
+		spool_unlock(lock);
+		return 1;
+	}
+	while (len > 0 && (n = write(fd, lines, len)) > 0) {
+		lines += n;
+		len -= n;
+	}
+	close(fd);
+	spool_unlock(lock);
+
+	return len > 0 ? 1 : 0;
+}
+
+/* append rows of table to file, the spool or the rejected file */
+static void spool_rows(const char *file, const char *table, const char *rows, size_t len) {
+	size_t table_len = strlen(table);
+	char *lines, *p;
+	const char *eol;
+	int nr_of_rows = 0;
 
-	if (bufsz < 0) {
-		fprintf(stderr, "%s:%d\t failed to calculate buffer size\n", __FILE__, __LINE__);
+	for (p = memchr(rows, '\n', len); p != NULL; p = memchr(p + 1, '\n', rows + len - p - 1)) {
+		nr_of_rows++;
+	}
+
+	lines = malloc(len + (nr_of_rows + 1) * (table_len + 1));
+	if (lines == NULL) {
+		fprintf(stderr, "%s:%d\t failed to allocate buffer; %d log rows lost\n", __FILE__, __LINE__, nr_of_rows);
 		return;
 	}
 
-	bufsz++;
-	buf = alloca(bufsz);
-	if (!buf) {
-		fprintf(stderr, "%s:%d\t failed to allocate buffer\n", __FILE__, __LINE__);
+	p = lines;
+	while (len > 0) {
+		eol = memchr(rows, '\n', len);
+		eol = eol ? eol + 1 : rows + len;
+		memcpy(p, table, table_len);
+		p += table_len;
+		*p++ = '\t';
+		memcpy(p, rows, eol - rows);
+		p += eol - rows;
+		len -= eol - rows;
+		rows = eol;
+	}
+
+	PROBE2(logdb__spool, table, nr_of_rows);
+	if (spool_write(file, lines, p - lines) != 0) {
+		fprintf(stderr, "%s:%d\t failed to write %s; %d log rows lost\n", __FILE__, __LINE__, file, nr_of_rows);
+	}
+	free(lines);
+}
+
+static const char *table_copy(const char *table) {
+	size_t i;
+
+	for (i = 0; i < sizeof(logdb_tables) / sizeof(logdb_tables[0]); i++) {
+		if (strcmp(logdb_tables[i].table, table) == 0) {
+			return logdb_tables[i].copy;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Send rows of a table. Rows the server does not take go to the rejected
+ * file; a batch it rejects is sent again row by row to find them. What is
+ * left when the server goes away is spooled. Returns 1 if it went away.
+ */
+static int send_rows(PGconn *conn, const char *table, const char *copy, const char *rows, size_t len) {
+	const char *eol;
+	size_t row_len;
+	int rejected = 0;
+	logdb_result_t result;
+
+	result = copy_rows(conn, copy, rows, len);
+	PROBE3(logdb__send, table, len, result);
+	switch (result) {
+		case LOGDB_SENT:
+			return 0;
+		case LOGDB_LOST:
+			spool_rows(server.spool, table, rows, len);
+			return 1;
+		case LOGDB_REFUSED:
+			fprintf(stderr, "%s:%d\t log rows for %s refused; kept in %s\n", __FILE__, __LINE__, table, server.rejected);
+			spool_rows(server.rejected, table, rows, len);
+			return 0;
+		case LOGDB_REJECTED:
+			break;
+	}
+
+	/* a single row needs no second try */
+	eol = memchr(rows, '\n', len);
+	if (eol == NULL || eol + 1 == rows + len) {
+		fprintf(stderr, "%s:%d\t a log row for %s was rejected; kept in %s\n", __FILE__, __LINE__, table, server.rejected);
+		spool_rows(server.rejected, table, rows, len);
+		return 0;
+	}
+
+	while (len > 0) {
+		eol = memchr(rows, '\n', len);
+		row_len = eol ? (size_t)(eol + 1 - rows) : len;
+		switch (copy_rows(conn, copy, rows, row_len)) {
+			case LOGDB_SENT:
+				break;
+			case LOGDB_LOST:
+				spool_rows(server.spool, table, rows, len);
+				return 1;
+			default:
+				spool_rows(server.rejected, table, rows, row_len);
+				rejected++;
+				break;
+		}
+		rows += row_len;
+		len -= row_len;
+	}
+
+	fprintf(stderr, "%s:%d\t %d log rows for %s rejected; kept in %s\n", __FILE__, __LINE__, rejected, table, server.rejected);
+	return 0;
+}
+
+/*
+ * Move the spool aside and send it table by table in batches. Whatever can
+ * not be sent goes back to the spool. A spool left over from an earlier
+ * replay is sent first, unless another run is sending it.
+ */
+static void spool_replay(PGconn *conn) {
+	FILE *fp;
+	struct stat statbuf;
+	int fd, lock;
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t line_len;
+	char *rows = NULL;
+	size_t rows_len = 0, rows_size = 0;
+	char table[64] = "";
+	char *tab;
+	int failed = 0;
+
+	server.replay = 0;
+
+	/* no run may be appending while the spool is moved */
+	lock = spool_lock(LOCK_EX);
+	if ((fd = spool_open(server.replaying, O_RDONLY)) == -1) {
+		if (errno != ENOENT || rename(server.spool, server.replaying) != 0) {
+			spool_unlock(lock);
+			return;
+		}
+		fd = spool_open(server.replaying, O_RDONLY);
+	}
+	if (fd == -1) {
+		fprintf(stderr, "%s:%d\t failed to open %s\n", __FILE__, __LINE__, server.replaying);
+		spool_unlock(lock);
+		return;
+	}
+	/* another run is sending it, or has just sent and removed it */
+	if (flock(fd, LOCK_EX | LOCK_NB) != 0 || fstat(fd, &statbuf) != 0 || statbuf.st_nlink == 0) {
+		close(fd);
+		spool_unlock(lock);
+		server.replay = 1;
 		return;
 	}
+	spool_unlock(lock);
 
-	va_copy(ap, ap_);
-	bufsz = vsnprintf(buf, bufsz, fmt, ap);
-	va_end(ap);
+	if ((fp = fdopen(fd, "r")) == NULL) {
+		close(fd);
+		return;
+	}
+
+	for (;;) {
+		line_len = getline(&line, &line_size, fp);
+
+		tab = line_len > 0 ? memchr(line, '\t', line_len) : NULL;
+
+		/* send what we have when the table changes, the batch is full,
+		 * or at the end of the spool */
+		if (rows_len > 0 && (tab == NULL || rows_len >= LOGDB_BATCH_BYTES ||
+				(size_t)(tab - line) != strlen(table) || strncmp(line, table, tab - line) != 0)) {
+			if (table_copy(table) == NULL) {
+				fprintf(stderr, "%s:%d\t dropping spooled rows for unknown table %s\n", __FILE__, __LINE__, table);
+			} else if (send_rows(conn, table, table_copy(table), rows, rows_len) != 0) {
+				failed = 1;
+			}
+			rows_len = 0;
+		}
+
+		if (line_len <= 0) {
+			break;
+		}
+		if (failed) {
+			if (spool_write(server.spool, line, line_len) != 0) {
+				fprintf(stderr, "%s:%d\t failed to write %s; log rows lost\n", __FILE__, __LINE__, server.spool);
+			}
+			continue;
+		}
+		if (tab == NULL) {
+			/* not a spool line */
+			continue;
+		}
+
+		snprintf(table, sizeof(table), "%.*s", (int)(tab - line), line);
+		tab++;
+		if (rows_len + (line + line_len - tab) > rows_size) {
+			char *p;
+			size_t size = rows_size ? rows_size : 4096;
+
+			while (size < rows_len + (line + line_len - tab)) {
+				size *= 2;
+			}
+			if ((p = realloc(rows, size)) == NULL) {
+				fprintf(stderr, "%s:%d\t failed to allocate buffer\n", __FILE__, __LINE__);
+				failed = 1;
+				spool_rows(server.spool, table, rows, rows_len);
+				rows_len = 0;
+				spool_write(server.spool, line, line_len);
+				continue;
+			}
+			rows = p;
+			rows_size = size;
+		}
+		memcpy(rows + rows_len, tab, line + line_len - tab);
+		rows_len += line + line_len - tab;
+	}
+
+	/* while it is still locked, see above */
+	unlink(server.replaying);
+	fclose(fp);
+	free(line);
+	free(rows);
+
+	if (!failed && access(server.spool, F_OK) == 0) {
+		/* the leftover went first; the current spool is next */
+		server.replay = 1;
+	}
+}
+
+/* Send a batch, or spool it while the server is away. */
+static void batch_send(PGconn *conn, logdb_table_t table) {
+	logdb_batch_t *batch = &batches[table];
+
+	if (server.state == LOGDB_UP) {
+		send_rows(conn, logdb_tables[table].table, logdb_tables[table].copy, batch->buf, batch->len);
+	} else {
+		spool_rows(server.spool, logdb_tables[table].table, batch->buf, batch->len);
+	}
+	batch->len = 0;
+	batch->rows = 0;
+}
 
-	if (bufsz < 0) {
-		fprintf(stderr, "%s:%d \t failed to copy format string\n", __FILE__, __LINE__);
+/* Append a row of nr_of_fields columns, NULL for SQL NULL. The batch is
+ * sent at once when it is full. */
+static void batch_add(logdb_table_t table, int nr_of_fields, const char *const *fields) {
+	logdb_batch_t *batch = &batches[table];
+	size_t n = 1;
+	int i;
+
+	/* escaping at most doubles a field */
+	for (i = 0; i < nr_of_fields; i++) {
+		n += 2 * (fields[i] ? strlen(fields[i]) : 1) + 1;
+	}
+	if (batch_reserve(batch, n) != 0) {
+		fprintf(stderr, "%s:%d\t failed to allocate buffer\n", __FILE__, __LINE__);
 		return;
 	}
 
+	if (batch->rows == 0) {
+		clock_gettime(CLOCK_MONOTONIC, &batch->first);
+	}
+
+	for (i = 0; i < nr_of_fields; i++) {
+		if (i > 0) {
+			batch->buf[batch->len++] = '\t';
+		}
+		if (fields[i]) {
+			batch_append_escaped(batch, fields[i]);
+		} else {
+			batch->buf[batch->len++] = '\\';
+			batch->buf[batch->len++] = 'N';
+		}
+	}
+	batch->buf[batch->len++] = '\n';
+	batch->rows++;
+
+	if (batch->rows >= LOGDB_BATCH_ROWS || batch->len >= LOGDB_BATCH_BYTES) {
+		batch_send(pApp->conn, table);
+	}
+}
+
+/* Send the batches that are due, or all of them if force is set. Called
+ * by the logging thread on every tick. */
+void dvdbackup_logdb_flush(void *priv, int force) {
+	app_data_t *pApp = priv;
+	logdb_batch_t *batch;
+	int i;
+
+	server_poll(pApp->conn);
+	if (server.state == LOGDB_UP && server.replay) {
+		spool_replay(pApp->conn);
+	}
+
+	for (i = 0; i < LOGDB_NR_OF_TABLES; i++) {
+		batch = &batches[i];
+		if (batch->rows == 0) {
+			continue;
+		}
+		if (!force && batch->rows < LOGDB_BATCH_ROWS && batch->len < LOGDB_BATCH_BYTES &&
+				elapsed_ms(&batch->first) < LOGDB_BATCH_MS) {
+			continue;
+		}
+		batch_send(pApp->conn, i);
+	}
+}
+
+static void format_timestamp(char *dt, size_t size, const struct timespec *ts) {
+	struct tm tm;
+
+	localtime_r(&ts->tv_sec, &tm);
+	strftime(dt, size, "%Y-%m-%d %H:%M:%S", &tm);
+	snprintf(dt + strlen(dt), size - strlen(dt), ".%06ld", ts->tv_nsec / 1000);
+}
+
+static const char *level_name(int lvl) {
 	switch (lvl) {
 		case DVD_LOGGER_LEVEL_INFO:
-			strncpy(loglevel, "INFO", 9);
-			break;
+			return "INFO";
 		case DVD_LOGGER_LEVEL_ERROR:
-			strncpy(loglevel, "ERROR", 9);
-			break;
+			return "ERROR";
 		case DVD_LOGGER_LEVEL_WARN:
-			strncpy(loglevel, "WARN", 9);
-			break;
+			return "WARN";
 		case DVD_LOGGER_LEVEL_DEBUG:
-			strncpy(loglevel, "DEBUG", 9);
-			break;
+			return "DEBUG";
 		case DVDBACKUP_LOGGER_LEVEL_TRACE:
-			strncpy(loglevel, "TRACE", 9);
-			break;
+			return "TRACE";
 		case DVDBACKUP_LOGGER_LEVEL_PROGRESS:
-			strncpy(loglevel, "PROGRESS", 9);
-			break;
+			return "PROGRESS";
 		default:
-			strncpy(loglevel, "UNK", 9);
+			return "UNK";
+	}
+}
+
+void dvdbackup_logdb(void *priv, dvd_logger_level_t lvl, const char *fmt, va_list ap_) {
+	char msg[1024];
+	char dt[40];
+	char pid_s[16];
+	const char *fields[4];
+	app_data_t *pApp = priv;
+	struct timespec now;
+
+	va_list ap;
+
+	va_copy(ap, ap_);
+	if (vsnprintf(msg, sizeof(msg), fmt, ap) < 0) {
+		va_end(ap);
+		fprintf(stderr, "%s:%d\t failed to format log message\n", __FILE__, __LINE__);
+		return;
 	}
+	va_end(ap);
 
-	snprintf(pid_s, 10, "%d", pApp->pid);
+	/* the row is stamped when it is logged, not when the batch is sent */
+	clock_gettime(CLOCK_REALTIME, &now);
+	format_timestamp(dt, sizeof(dt), &now);
 
-	values[0] = pid_s;
-	values[1] = loglevel;
-	values[2] = buf;
-	res = PQexecParams(pApp->conn, "INSERT INTO dvdbackup_tbl (pid, lvl, msg) VALUES ($1::integer, $2::text, $3::text)", 3, NULL, values, NULL, NULL, 0);
+	snprintf(pid_s, sizeof(pid_s), "%d", pApp->pid);
 
+	fields[0] = pid_s;
+	fields[1] = level_name(lvl);
+	fields[2] = msg;
+	fields[3] = dt;
+	batch_add(LOGDB_TABLE_LOG, 4, fields);
 }
 
+static const char *extent_status_name(dvdlog_extent_status_t status) {
+	switch (status) {
+		case DVDLOG_EXTENT_OK:
+			return "ok";
+		case DVDLOG_EXTENT_PADDED:
+			return "padded";
+		case DVDLOG_EXTENT_SKIPPED:
+			return "skipped";
+		case DVDLOG_EXTENT_RETRIED:
+			return "retried";
+		case DVDLOG_EXTENT_DEFERRED:
+			return "deferred";
+		default:
+			return "unknown";
+	}
+}
+
+void dvdbackup_logdb_extent(void *priv, const dvdlog_extent_t *extent) {
+	char pid_s[16], title_set_s[16], vob_s[16], lba_s[16], blocks_s[16];
+	char read_us_s[24], write_us_s[24];
+	char dt[40];
+	const char *fields[10];
+	app_data_t *pApp = priv;
+
+	if (!run.stored) {
+		snprintf(pid_s, sizeof(pid_s), "%d", pApp->pid);
+		format_timestamp(dt, sizeof(dt), &run.started);
+
+		fields[0] = run.id;
+		fields[1] = pid_s;
+		fields[2] = run.host;
+		fields[3] = pApp->dev_path;
+		fields[4] = pApp->title_name;
+		fields[5] = dt;
+		batch_add(LOGDB_TABLE_RUN, 6, fields);
+		run.stored = 1;
+	}
+
+	snprintf(title_set_s, sizeof(title_set_s), "%d", extent->title_set);
+	snprintf(vob_s, sizeof(vob_s), "%d", extent->vob);
+	snprintf(lba_s, sizeof(lba_s), "%d", extent->offset);
+	snprintf(blocks_s, sizeof(blocks_s), "%d", extent->blocks);
+	snprintf(read_us_s, sizeof(read_us_s), "%ld", extent->read_us);
+	snprintf(write_us_s, sizeof(write_us_s), "%ld", extent->write_us);
+	format_timestamp(dt, sizeof(dt), &extent->when);
+
+	fields[0] = run.id;
+	fields[1] = title_set_s;
+	fields[2] = extent->menu ? "menu" : "title";
+	fields[3] = vob_s;
+	fields[4] = lba_s;
+	fields[5] = blocks_s;
+	fields[6] = read_us_s;
+	fields[7] = write_us_s;
+	fields[8] = extent_status_name(extent->status);
+	fields[9] = dt;
+	batch_add(LOGDB_TABLE_EXTENT, 10, fields);
+}
@@ -4,8 +4,12 @@
 #include <dvdread/dvd_reader.h>
 #include <libpq-fe.h>
 
+#include "dvdlogger.h"
+
 void dvdbackup_logdb_init(PGconn **);
 void dvdbackup_logdb_exit(PGconn *);
+void dvdbackup_logdb_flush(void *, int);
 void dvdbackup_logdb(void *, dvd_logger_level_t, const char *, va_list);
+void dvdbackup_logdb_extent(void *, const dvdlog_extent_t *);
 
 #endif // LOGDB_H_
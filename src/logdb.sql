@@ -8,3 +8,70 @@ CREATE TABLE dvdbackup_tbl (
 );
 
 
+
+-- one row per dvdbackup invocation that copied anything
+CREATE TABLE dvdbackup_run (
+    run_id text PRIMARY KEY,        -- <host>-<pid>-<start epoch>
+    pid integer,
+    host text,
+    device text,
+    disc text,                      -- the title name the backup is stored under
+    started timestamp
+);
+
+CREATE INDEX dvdbackup_run_device_idx ON dvdbackup_run (device);
+CREATE INDEX dvdbackup_run_disc_idx ON dvdbackup_run (disc);
+
+-- one row per run of blocks handled by the copy loop
+CREATE TABLE dvdbackup_extent (
+    run_id text NOT NULL,
+    title_set integer,
+    domain text,                    -- 'menu' or 'title'
+    vob integer,                    -- VOB file number, 0 for the menu
+    lba integer,                    -- in blocks from the start of the domain
+    blocks integer,
+    read_us bigint,
+    write_us bigint,
+    status text,                    -- 'ok', 'padded', 'skipped', 'retried' or 'deferred'
+    dt timestamp
+);
+
+CREATE INDEX dvdbackup_extent_run_idx ON dvdbackup_extent (run_id, title_set, domain, lba);
+CREATE INDEX dvdbackup_extent_dt_idx ON dvdbackup_extent (dt);
+CREATE INDEX dvdbackup_extent_status_idx ON dvdbackup_extent (status) WHERE status <> 'ok';
+
+CREATE VIEW dvdbackup_run_throughput AS
+SELECT r.run_id, r.device, r.disc, r.started,
+       sum(e.blocks) FILTER (WHERE e.status = 'ok') AS blocks_copied,
+       sum(e.blocks) FILTER (WHERE e.status = 'padded') AS blocks_padded,
+       sum(e.blocks) FILTER (WHERE e.status = 'skipped') AS blocks_skipped,
+       sum(e.read_us) AS read_us,
+       sum(e.write_us) AS write_us,
+       sum(e.blocks) FILTER (WHERE e.status = 'ok') * 2048.0 / 1048576
+           / nullif(sum(e.read_us) FILTER (WHERE e.status = 'ok'), 0) * 1000000 AS read_mib_s,
+       sum(e.blocks) FILTER (WHERE e.status = 'ok') * 2048.0 / 1048576
+           / nullif(sum(e.write_us) FILTER (WHERE e.status = 'ok'), 0) * 1000000 AS write_mib_s
+FROM dvdbackup_run r JOIN dvdbackup_extent e USING (run_id)
+GROUP BY r.run_id, r.device, r.disc, r.started;
+
+CREATE VIEW dvdbackup_drive_throughput AS
+SELECT device,
+       count(*) AS runs,
+       sum(blocks_copied) AS blocks_copied,
+       sum(blocks_padded) AS blocks_padded,
+       sum(blocks_copied) * 2048.0 / 1048576 / nullif(sum(read_us), 0) * 1000000 AS read_mib_s,
+       min(read_mib_s) AS worst_run_read_mib_s,
+       max(read_mib_s) AS best_run_read_mib_s
+FROM dvdbackup_run_throughput
+GROUP BY device;
+
+CREATE VIEW dvdbackup_disc_throughput AS
+SELECT disc,
+       count(*) AS runs,
+       count(DISTINCT device) AS devices,
+       sum(blocks_copied) AS blocks_copied,
+       sum(blocks_padded) AS blocks_padded,
+       sum(blocks_copied) * 2048.0 / 1048576 / nullif(sum(read_us), 0) * 1000000 AS read_mib_s,
+       max(started) AS last_run
+FROM dvdbackup_run_throughput
+GROUP BY disc;
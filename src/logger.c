@@ -1,9 +1,66 @@
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
 
 #include <dvdread/dvd_reader.h>
 
 #include "dvdlogger.h"
+#include "probes.h"
+
+/* maximum length of a preformatted log message, longer ones are truncated */
+#define DVDLOG_MSG_MAX 1024
+
+/* the drain thread wakes up at least this often, in milliseconds */
+#define DVDLOG_TICK_MS 100
+
+/*
+ * Log records are formatted on the calling thread straight into a slot of a
+ * bounded lock-free ring (a multi-producer, single-consumer variant of
+ * Vyukov's bounded queue) and written out by a dedicated thread, so the copy
+ * loop never waits on a terminal or a database.
+ */
+typedef enum {
+	DVDLOG_RECORD_MESSAGE,
+	DVDLOG_RECORD_EXTENT,
+	DVDLOG_RECORD_EVENT
+} dvdlog_record_kind_t;
+
+typedef struct {
+	size_t sequence;
+	dvdlog_record_kind_t kind;
+	void *priv;
+	const dvd_logger_cb *logcb;
+	int level;
+	dvdlog_extent_t extent;
+	char msg[DVDLOG_MSG_MAX];
+} dvdlog_record_t;
+
+static struct {
+	dvdlog_record_t *records;
+	size_t mask;
+	size_t enqueue_pos;
+	size_t dequeue_pos;
+	dvdlog_overflow_t overflow;
+	sem_t wakeup;
+	pthread_t thread;
+	int running;
+	int stop;
+	unsigned long dropped_progress;
+	unsigned long dropped;
+	void (*flush)(void *priv, int force);
+	void *flush_priv;
+	void (*extent)(void *priv, const dvdlog_extent_t *extent);
+	void *extent_priv;
+	int events;
+	int event_fd;
+} ring;
 
 static void DVDLogProgress(FILE *stream, const char *fmt, va_list ap_) {
 	va_list ap;
@@ -31,10 +88,9 @@ static void DVDLogDefault(FILE *stream, const char *fmt, va_list ap_) {
 	fprintf(stream, "\n");
 }
 
-void DVDLog(void *priv, const dvd_logger_cb *logcb, int level, const char *fmt, ... )
+/* hand a message to the sinks, on whichever thread owns them */
+static void DVDLogWrite(void *priv, const dvd_logger_cb *logcb, int level, const char *fmt, va_list ap)
 {
-	va_list ap;
-	va_start(ap, fmt);
 	if(logcb && logcb->pf_log)
 		logcb->pf_log(priv, level, fmt, ap);
 	else
@@ -57,5 +113,345 @@ void DVDLog(void *priv, const dvd_logger_cb *logcb, int level, const char *fmt,
 				DVDLogDefault(stdout, fmt, ap);
 		}
 	}
+}
+
+static void DVDLogEmit(void *priv, const dvd_logger_cb *logcb, int level, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	DVDLogWrite(priv, logcb, level, fmt, ap);
+	va_end(ap);
+}
+
+/* Claim a free slot, or return NULL if the record has to be dropped. Progress
+ * records are only queued while at least a quarter of the ring is free, so
+ * they are the first to go when the sinks fall behind. */
+static dvdlog_record_t *DVDLogClaim(int level, size_t *claimed)
+{
+	dvdlog_record_t *record;
+	size_t pos, seq;
+	size_t capacity = ring.mask + 1;
+	int spins = 0;
+
+	pos = __atomic_load_n(&ring.enqueue_pos, __ATOMIC_RELAXED);
+	for (;;) {
+		if (level == DVDBACKUP_LOGGER_LEVEL_PROGRESS &&
+				pos - __atomic_load_n(&ring.dequeue_pos, __ATOMIC_RELAXED) >= capacity - capacity / 4) {
+			__atomic_fetch_add(&ring.dropped_progress, 1, __ATOMIC_RELAXED);
+			PROBE1(log__drop, level);
+			return NULL;
+		}
+
+		record = &ring.records[pos & ring.mask];
+		seq = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&ring.enqueue_pos, &pos, pos + 1, 1,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				*claimed = pos;
+				return record;
+			}
+			/* pos was reloaded by the failed exchange */
+		} else if ((long)(seq - pos) < 0) {
+			/* full */
+			if (ring.overflow == DVDLOG_OVERFLOW_DROP || level == DVDBACKUP_LOGGER_LEVEL_PROGRESS) {
+				__atomic_fetch_add(level == DVDBACKUP_LOGGER_LEVEL_PROGRESS ? &ring.dropped_progress : &ring.dropped,
+						1, __ATOMIC_RELAXED);
+				PROBE1(log__drop, level);
+				return NULL;
+			}
+			sem_post(&ring.wakeup);
+			if (++spins < 64) {
+				sched_yield();
+			} else {
+				struct timespec ts = { 0, 1000000 };
+				nanosleep(&ts, NULL);
+			}
+			pos = __atomic_load_n(&ring.enqueue_pos, __ATOMIC_RELAXED);
+		} else {
+			pos = __atomic_load_n(&ring.enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+/* write one event line, giving up on the descriptor once it fails */
+static void DVDLogWriteEvent(const char *line)
+{
+	size_t len = strlen(line);
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(ring.event_fd, line, len);
+		if (n == -1 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			__atomic_store_n(&ring.events, 0, __ATOMIC_RELAXED);
+			DVDLogEmit(pApp, NULL, DVD_LOGGER_LEVEL_WARN, "writing progress events to descriptor %d failed; no more events are sent", ring.event_fd);
+			return;
+		}
+		line += n;
+		len -= n;
+	}
+}
+
+static int DVDLogDrain(void)
+{
+	dvdlog_record_t *record;
+	size_t pos;
+	int n = 0;
+
+	for (;;) {
+		pos = ring.dequeue_pos;
+		record = &ring.records[pos & ring.mask];
+		if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) != pos + 1) {
+			break;
+		}
+
+		if (record->kind == DVDLOG_RECORD_EXTENT) {
+			ring.extent(ring.extent_priv, &record->extent);
+		} else if (record->kind == DVDLOG_RECORD_EVENT) {
+			if (__atomic_load_n(&ring.events, __ATOMIC_RELAXED)) {
+				DVDLogWriteEvent(record->msg);
+			}
+		} else {
+			PROBE2(log__message, record->level, record->msg);
+			DVDLogEmit(record->priv, record->logcb, record->level, "%s", record->msg);
+		}
+
+		__atomic_store_n(&record->sequence, pos + ring.mask + 1, __ATOMIC_RELEASE);
+		__atomic_store_n(&ring.dequeue_pos, pos + 1, __ATOMIC_RELAXED);
+		n++;
+	}
+
+	return n;
+}
+
+static void *DVDLogThread(void *arg)
+{
+	struct timespec deadline;
+
+	(void)arg;
+
+	for (;;) {
+		DVDLogDrain();
+		if (__atomic_load_n(&ring.stop, __ATOMIC_ACQUIRE)) {
+			/* producers are done; pick up whatever is left */
+			DVDLogDrain();
+			if (ring.flush) {
+				ring.flush(ring.flush_priv, 1);
+			}
+			break;
+		}
+		if (ring.flush) {
+			ring.flush(ring.flush_priv, 0);
+		}
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_nsec += DVDLOG_TICK_MS * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		while (sem_timedwait(&ring.wakeup, &deadline) == -1 && errno == EINTR)
+			;
+	}
+
+	return NULL;
+}
+
+/* Register a hook the logging thread calls on every tick, so sinks that
+ * batch their output can honour a time bound; force is set on the last
+ * call before the thread exits. */
+void DVDLogSetFlush(void (*flush)(void *priv, int force), void *priv)
+{
+	ring.flush = flush;
+	ring.flush_priv = priv;
+}
+
+/* least severe rank that is written, see --log-level */
+int dvdlog_level = DVDLOG_RANK_TRACE;
+
+/* Map a --log-level name to its rank, or -1 if there is no such level. */
+int DVDLogParseLevel(const char *name)
+{
+	static const char *names[] = { "error", "warn", "info", "debug", "trace" };
+	int i;
+
+	for (i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++) {
+		if (strcmp(name, names[i]) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/* Register the sink for extent records; without one DVDLogExtent does
+ * nothing. */
+void DVDLogSetExtent(void (*extent)(void *priv, const dvdlog_extent_t *extent), void *priv)
+{
+	ring.extent = extent;
+	ring.extent_priv = priv;
+}
+
+/* Send the lines queued with DVDLogEvent to fd. */
+void DVDLogSetEventFd(int fd)
+{
+	ring.event_fd = fd;
+	__atomic_store_n(&ring.events, 1, __ATOMIC_RELAXED);
+}
+
+/* Start the logging thread with a ring of at least queue_size records.
+ * Until it runs, and if it can not be started, messages are written
+ * synchronously. Returns 0 on success. */
+int DVDLogStart(unsigned int queue_size, dvdlog_overflow_t overflow)
+{
+	size_t capacity = 16;
+	size_t i;
+
+	if (ring.running) {
+		return 0;
+	}
+
+	while (capacity < queue_size && capacity < (1u << 20)) {
+		capacity <<= 1;
+	}
+
+	ring.records = malloc(capacity * sizeof(dvdlog_record_t));
+	if (ring.records == NULL) {
+		return 1;
+	}
+	for (i = 0; i < capacity; i++) {
+		ring.records[i].sequence = i;
+	}
+	ring.mask = capacity - 1;
+	ring.enqueue_pos = 0;
+	ring.dequeue_pos = 0;
+	ring.overflow = overflow;
+	ring.stop = 0;
+
+	if (sem_init(&ring.wakeup, 0, 0) != 0) {
+		free(ring.records);
+		ring.records = NULL;
+		return 1;
+	}
+
+	if (pthread_create(&ring.thread, NULL, DVDLogThread, NULL) != 0) {
+		sem_destroy(&ring.wakeup);
+		free(ring.records);
+		ring.records = NULL;
+		return 1;
+	}
+
+	__atomic_store_n(&ring.running, 1, __ATOMIC_RELEASE);
+	atexit(DVDLogStop);
+	return 0;
+}
+
+/* Flush all queued records and stop the logging thread. */
+void DVDLogStop(void)
+{
+	if (!__atomic_load_n(&ring.running, __ATOMIC_ACQUIRE)) {
+		return;
+	}
+
+	__atomic_store_n(&ring.stop, 1, __ATOMIC_RELEASE);
+	sem_post(&ring.wakeup);
+	pthread_join(ring.thread, NULL);
+	__atomic_store_n(&ring.running, 0, __ATOMIC_RELEASE);
+
+	if (pApp->last_level == DVDBACKUP_LOGGER_LEVEL_PROGRESS) {
+		fprintf(stderr, "\n");
+		pApp->last_level = -1;
+	}
+	if (ring.dropped > 0) {
+		DVDLogEmit(pApp, NULL, DVD_LOGGER_LEVEL_WARN, "%lu log messages were dropped", ring.dropped);
+	}
+	if (ring.dropped_progress > 0) {
+		DVDLogEmit(pApp, NULL, DVD_LOGGER_LEVEL_INFO, "%lu progress updates were dropped", ring.dropped_progress);
+	}
+
+	sem_destroy(&ring.wakeup);
+	free(ring.records);
+	ring.records = NULL;
+}
+
+void DVDLogExtent(const dvdlog_extent_t *extent)
+{
+	dvdlog_record_t *record;
+	size_t pos;
+
+	if (ring.extent == NULL) {
+		return;
+	}
+
+	if (!__atomic_load_n(&ring.running, __ATOMIC_ACQUIRE) || __atomic_load_n(&ring.stop, __ATOMIC_ACQUIRE)) {
+		ring.extent(ring.extent_priv, extent);
+	} else if ((record = DVDLogClaim(DVD_LOGGER_LEVEL_INFO, &pos)) != NULL) {
+		record->kind = DVDLOG_RECORD_EXTENT;
+		record->extent = *extent;
+		/* publish */
+		__atomic_store_n(&record->sequence, pos + 1, __ATOMIC_RELEASE);
+		sem_post(&ring.wakeup);
+	}
+}
+
+/* Queue one line for the event descriptor; a newline is added. Periodic
+ * events should use the progress level so they are the first to go when
+ * the ring runs short. */
+void DVDLogEvent(int level, const char *fmt, ...)
+{
+	dvdlog_record_t *record;
+	char line[DVDLOG_MSG_MAX];
+	size_t pos;
+	va_list ap;
+	int len;
+
+	if (!__atomic_load_n(&ring.events, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	va_start(ap, fmt);
+	if (!__atomic_load_n(&ring.running, __ATOMIC_ACQUIRE) || __atomic_load_n(&ring.stop, __ATOMIC_ACQUIRE)) {
+		len = vsnprintf(line, DVDLOG_MSG_MAX - 1, fmt, ap);
+		if (len >= 0) {
+			len = len < DVDLOG_MSG_MAX - 2 ? len : DVDLOG_MSG_MAX - 2;
+			line[len] = '\n';
+			line[len + 1] = '\0';
+			DVDLogWriteEvent(line);
+		}
+	} else if ((record = DVDLogClaim(level, &pos)) != NULL) {
+		record->kind = DVDLOG_RECORD_EVENT;
+		len = vsnprintf(record->msg, DVDLOG_MSG_MAX - 1, fmt, ap);
+		len = len < 0 ? 0 : len < DVDLOG_MSG_MAX - 2 ? len : DVDLOG_MSG_MAX - 2;
+		record->msg[len] = '\n';
+		record->msg[len + 1] = '\0';
+		/* publish */
+		__atomic_store_n(&record->sequence, pos + 1, __ATOMIC_RELEASE);
+		sem_post(&ring.wakeup);
+	}
+	va_end(ap);
+}
+
+void DVDLog(void *priv, const dvd_logger_cb *logcb, int level, const char *fmt, ... )
+{
+	dvdlog_record_t *record;
+	size_t pos;
+	va_list ap;
+
+	va_start(ap, fmt);
+	if (!__atomic_load_n(&ring.running, __ATOMIC_ACQUIRE) || __atomic_load_n(&ring.stop, __ATOMIC_ACQUIRE)) {
+		DVDLogWrite(priv, logcb, level, fmt, ap);
+	} else if ((record = DVDLogClaim(level, &pos)) != NULL) {
+		record->kind = DVDLOG_RECORD_MESSAGE;
+		record->priv = priv;
+		record->logcb = logcb;
+		record->level = level;
+		vsnprintf(record->msg, DVDLOG_MSG_MAX, fmt, ap);
+		/* publish */
+		__atomic_store_n(&record->sequence, pos + 1, __ATOMIC_RELEASE);
+		sem_post(&ring.wakeup);
+	}
 	va_end(ap);
 }
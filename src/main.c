@@ -22,6 +22,14 @@
 #include "dvdbackup.h"
 #include "dvdlogger.h"
 
+#include "report.h"
+#include "heatmap.h"
+#include "progress.h"
+#include "prom.h"
+#include "reader.h"
+#include "chunk.h"
+#include "stats.h"
+
 #ifdef ENABLE_LOGDB
 #include "logdb.h"
 #endif
@@ -31,8 +39,10 @@
 #define _(String) gettext(String)
 
 /* C standard libraries */
+#include <fcntl.h>
 #include <limits.h>
 #include <locale.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -51,6 +61,55 @@
 /* app data */
 app_data_t app, *pApp;
 
+/* long options without a short equivalent */
+enum {
+	OPT_REPORT = CHAR_MAX + 1,
+	OPT_REPORT_JSON,
+	OPT_COMPACT,
+	OPT_LOG_QUEUE,
+	OPT_LOG_OVERFLOW,
+	OPT_LOG_LEVEL,
+	OPT_PROGRESS_RATE,
+	OPT_PROGRESS_FD,
+	OPT_PROM_FILE,
+	OPT_HEATMAP,
+	OPT_STATS,
+	OPT_STATS_JSON,
+	OPT_FAULT_SCRIPT,
+	OPT_READ_TRACE,
+	OPT_REPLAY_TRACE,
+	OPT_READ_SIZE,
+	OPT_READ_TIMEOUT,
+	OPT_DEADLINE
+};
+
+
+/* seconds in "90", "90s", "30m" or "2h"; 0 for anything else */
+static int parse_duration(const char *arg) {
+	char *end;
+	long n = strtol(arg, &end, 10);
+
+	if (end == arg || n <= 0 || n > INT_MAX / 3600) {
+		return 0;
+	}
+	switch (*end) {
+	case '\0':
+		return n;
+	case 's':
+		break;
+	case 'm':
+		n *= 60;
+		break;
+	case 'h':
+		n *= 3600;
+		break;
+	default:
+		return 0;
+	}
+
+	return end[1] == '\0' ? n : 0;
+}
+
 
 static void print_version() {
 	printf("%s\n", PACKAGE_STRING);
@@ -107,7 +166,58 @@ Print a friendly, customizable greeting.\n"), stdout); */
                            present\n\
   -r, --error={a,b,m,u}    select read error handling: a=abort, b=skip block,\n\
                            m=skip multiple blocks (default), u=skip unused blocks\n\
-  -p, --progress           print progress information while copying VOBs\n\n"));
+  -p, --progress           print progress information while copying VOBs\n\
+      --progress-rate=HZ   print at most HZ progress updates a second\n\
+                           (default 4)\n\
+      --progress-fd=N      write progress as JSON lines to file descriptor N\n\n"));
+
+	printf(_("\
+      --prom-file=FILE     keep FILE up to date with metrics for the Prometheus\n\
+                           node exporter's textfile collector\n\
+      --stats              print time spent per phase, counters and resource\n\
+                           usage at exit\n\
+      --stats-json=FILE    write the same as JSON to FILE (- for stdout)\n\n"));
+
+	printf(_("\
+      --report=FILE        write a sector coverage and waste report to FILE\n\
+      --report-json=FILE   write the coverage report as JSON to FILE\n\
+      --heatmap=PREFIX     write read latency by disc position to PREFIX.csv\n\
+                           and as a map to PREFIX.txt\n\n"));
+
+	printf(_("\
+      --fault-script=FILE  make VOB reads fail, come back short or slow down as\n\
+                           FILE says, to try the -r strategies on an image\n\
+      --read-trace=FILE    record every VOB read with its result and time\n\
+      --replay-trace=FILE  give VOB reads of an image the results and times\n\
+                           of the drive that FILE was recorded from\n\n"));
+
+	printf(_("\
+      --read-size=MIN[-MAX]\n\
+                           read VOBs MIN to MAX KiB at a time, trying sizes in\n\
+                           between for the fastest (default 64-8192)\n\
+      --read-timeout=MS    after a read that took longer than MS milliseconds,\n\
+                           jump ahead and read what was jumped over at the end\n\
+                           of the file\n\
+      --deadline=TIME      copy what can be read quickly first, then retry bad\n\
+                           blocks until TIME (e.g. 30m, 2h, 90s) has passed\n\
+                           and list what is missing (with -M, -F and -T only)\n\n"));
+
+	printf(_("\
+      --compact            leave out sectors no PGC refers to and rewrite the\n\
+                           IFO files to match (with -M, -F and -T only)\n\n"));
+
+	printf(_("\
+      --log-queue=N        queue up to N log messages for the logging thread\n\
+                           (default 1024)\n\
+      --log-overflow={block,drop}\n\
+                           when the log queue is full, wait for room (default)\n\
+                           or drop messages; progress messages are always\n\
+                           dropped first\n\n"));
+
+	printf(_("\
+      --log-level={error,warn,info,debug,trace}\n\
+                           write messages down to this level (default trace);\n\
+                           levels below the build's ceiling are never written\n\n"));
 
 	printf(_("\
   -a is option to the -F switch and has no effect on other options\n\
@@ -123,6 +233,24 @@ Print a friendly, customizable greeting.\n"), stdout); */
 }
 
 
+/* Leave before anything is copied, shutting down what the job started: the
+ * published state ends as done or failed, and the logging thread writes
+ * out what is still queued. */
+static void exit_early(dvd_reader_t *dvd, int return_code) {
+	progress_job_done(return_code == 0);
+	stats_close(return_code == 0);
+	prom_stop();
+	if (dvd != NULL) {
+		DVDClose(dvd);
+	}
+	DVDLogStop();
+#ifdef ENABLE_LOGDB
+	dvdbackup_logdb_exit(app.conn);
+#endif
+	exit(return_code);
+}
+
+
 void init_i18n() {
 	setlocale(LC_ALL, "");
 	bindtextdomain(PACKAGE, LOCALEDIR);
@@ -155,6 +283,7 @@ int main(int argc, char* argv[]) {
 	read_error_strategy_t errorstrat = STRATEGY_SKIP_MULTIBLOCK;
 
 	int return_code = 0;
+	stats_timer_t open_timer;
 
 	/* DVD Video device */
 	char* dvd = "/dev/dvd";
@@ -167,6 +296,28 @@ int main(int argc, char* argv[]) {
 	char* title_set_temp = NULL;
 	char* errorstrat_temp = NULL;
 
+	/* Coverage report files */
+	char* report_file = NULL;
+	char* report_json_file = NULL;
+
+	/* Read latency heatmap files */
+	char* heatmap_prefix = NULL;
+
+	/* Metrics for the textfile collector */
+	char* prom_file = NULL;
+
+	/* Faults to inject into VOB reads, reads to record or play back */
+	char* fault_script = NULL;
+	char* read_trace = NULL;
+	char* replay_trace = NULL;
+
+	/* Summary at exit */
+	bool print_stats = false;
+	char* stats_json_file = NULL;
+
+	/* Logging thread */
+	unsigned int log_queue = 1024;
+	dvdlog_overflow_t log_overflow = DVDLOG_OVERFLOW_BLOCK;
 
 	/* Title of the DVD */
 	char title_name[33] = "";
@@ -203,6 +354,24 @@ int main(int argc, char* argv[]) {
 		{"aspect", required_argument, NULL, 'a'},
 		{"error", required_argument, NULL, 'r'},
 		{"progress", no_argument, NULL, 'p'},
+		{"report", required_argument, NULL, OPT_REPORT},
+		{"report-json", required_argument, NULL, OPT_REPORT_JSON},
+		{"heatmap", required_argument, NULL, OPT_HEATMAP},
+		{"compact", no_argument, NULL, OPT_COMPACT},
+		{"log-queue", required_argument, NULL, OPT_LOG_QUEUE},
+		{"log-overflow", required_argument, NULL, OPT_LOG_OVERFLOW},
+		{"log-level", required_argument, NULL, OPT_LOG_LEVEL},
+		{"progress-rate", required_argument, NULL, OPT_PROGRESS_RATE},
+		{"progress-fd", required_argument, NULL, OPT_PROGRESS_FD},
+		{"prom-file", required_argument, NULL, OPT_PROM_FILE},
+		{"stats", no_argument, NULL, OPT_STATS},
+		{"stats-json", required_argument, NULL, OPT_STATS_JSON},
+		{"fault-script", required_argument, NULL, OPT_FAULT_SCRIPT},
+		{"read-trace", required_argument, NULL, OPT_READ_TRACE},
+		{"replay-trace", required_argument, NULL, OPT_REPLAY_TRACE},
+		{"read-size", required_argument, NULL, OPT_READ_SIZE},
+		{"read-timeout", required_argument, NULL, OPT_READ_TIMEOUT},
+		{"deadline", required_argument, NULL, OPT_DEADLINE},
 		{NULL, 0, NULL, 0}
 	};
 	const char* shortopts = "hVIMFT:t:s:e:i:o:vn:a:r:p";
@@ -212,16 +381,19 @@ int main(int argc, char* argv[]) {
 	app = (app_data_t) {
 		.program_name = argv[0],
 		.pid = getpid(),
-		.dev_path = "/dev/dvd",
 		.last_level = -1
 	};
 #ifdef ENABLE_LOGDB
 	dvdbackup_logdb_init(&app.conn);
+	/* an unreachable server is retried in the background; only a missing
+	 * connection object disables the sink */
 	if (!app.conn) {
 		fprintf(stderr, "failed to connect to database\n");
 		app.logcb = (dvd_logger_cb) { .pf_log = NULL };
 	} else {
 		app.logcb = (dvd_logger_cb) { .pf_log = dvdbackup_logdb };
+		DVDLogSetFlush(dvdbackup_logdb_flush, &app);
+		DVDLogSetExtent(dvdbackup_logdb_extent, &app);
 	}
 #endif
 	pApp = &app;
@@ -282,6 +454,91 @@ int main(int argc, char* argv[]) {
 		case 'p':
 			progress = 1;
 			break;
+		case OPT_REPORT:
+			report_file = optarg;
+			report = 1;
+			break;
+		case OPT_REPORT_JSON:
+			report_json_file = optarg;
+			report = 1;
+			break;
+		case OPT_COMPACT:
+#ifdef FIND_UNUSED
+			compact = 1;
+#else
+			fprintf(stderr, "compaction not enabled in this version\n");
+#endif
+			break;
+		case OPT_LOG_QUEUE:
+			if (atoi(optarg) < 1) {
+				lose = true;
+			}
+			log_queue = atoi(optarg);
+			break;
+		case OPT_LOG_OVERFLOW:
+			if (strcmp(optarg, "block") == 0) {
+				log_overflow = DVDLOG_OVERFLOW_BLOCK;
+			} else if (strcmp(optarg, "drop") == 0) {
+				log_overflow = DVDLOG_OVERFLOW_DROP;
+			} else {
+				lose = true;
+			}
+			break;
+		case OPT_PROGRESS_RATE:
+			progress_rate = strtod(optarg, NULL);
+			if (progress_rate <= 0) {
+				lose = true;
+			}
+			break;
+		case OPT_PROGRESS_FD:
+			progress_fd = atoi(optarg);
+			if (progress_fd < 0 || fcntl(progress_fd, F_GETFD) == -1) {
+				lose = true;
+			}
+			break;
+		case OPT_HEATMAP:
+			heatmap_prefix = optarg;
+			heatmap = 1;
+			break;
+		case OPT_STATS:
+			print_stats = true;
+			break;
+		case OPT_STATS_JSON:
+			stats_json_file = optarg;
+			break;
+		case OPT_PROM_FILE:
+			prom_file = optarg;
+			break;
+		case OPT_FAULT_SCRIPT:
+			fault_script = optarg;
+			break;
+		case OPT_READ_TRACE:
+			read_trace = optarg;
+			break;
+		case OPT_REPLAY_TRACE:
+			replay_trace = optarg;
+			break;
+		case OPT_READ_SIZE:
+			if (chunk_parse(optarg) != 0) {
+				lose = true;
+			}
+			break;
+		case OPT_READ_TIMEOUT:
+			read_timeout = atoi(optarg);
+			if (read_timeout < 1) {
+				lose = true;
+			}
+			break;
+		case OPT_DEADLINE:
+			if ((deadline = parse_duration(optarg)) == 0) {
+				lose = true;
+			}
+			break;
+		case OPT_LOG_LEVEL:
+			if ((dvdlog_level = DVDLogParseLevel(optarg)) < 0) {
+				lose = true;
+			}
+			break;
 
 		default:
 			lose = true;
@@ -298,6 +555,9 @@ int main(int argc, char* argv[]) {
 		exit (EXIT_FAILURE);
 	}
 
+	/* the device the run reads, given or not, for the logs and progress */
+	app.dev_path = dvd;
+
 	if(errorstrat_temp != NULL) {
 		if(errorstrat_temp[0]=='a') {
 			errorstrat=STRATEGY_ABORT;
@@ -390,34 +650,80 @@ int main(int argc, char* argv[]) {
 		print_help();
 		exit(1);
 	}
+
+	/* titles and chapters are written without IFO files to rewrite */
+	if (compact && (do_titles || do_chapter)) {
+		fprintf(stderr, _("%s: --compact works with -M, -F and -T only\n"), app.program_name);
+		fprintf(stderr, _("Try `%s --help' for more information.\n"), app.program_name);
+		exit(EXIT_FAILURE);
+	}
+	/* nor through DVDCopyBlocks */
+	if (deadline > 0 && (do_titles || do_chapter)) {
+		fprintf(stderr, _("%s: --deadline works with -M, -F and -T only\n"), app.program_name);
+		fprintf(stderr, _("Try `%s --help' for more information.\n"), app.program_name);
+		exit(EXIT_FAILURE);
+	}
+	if (fault_script != NULL && reader_load_faults(fault_script) != 0) {
+		exit(1);
+	}
+	if (replay_trace != NULL && reader_load_replay(replay_trace) != 0) {
+		exit(1);
+	}
+	if (read_trace != NULL && reader_start_trace(read_trace) != 0) {
+		exit(1);
+	}
+	if (chunk_init() != 0) {
+		exit(1);
+	}
+	if (deadline > 0) {
+		DVDSetDeadline(deadline);
+	}
+	if (progress_fd >= 0) {
+		/* a controller that goes away must not take the copy with it */
+		signal(SIGPIPE, SIG_IGN);
+		DVDLogSetEventFd(progress_fd);
+	}
+
+	if (DVDLogStart(log_queue, log_overflow) != 0) {
+		fprintf(stderr, _("Failed to start the logging thread; logging synchronously\n"));
+	}
+
 #ifdef DEBUG
 	XLog4(pApp, "After args");
 #endif
 
 
+	/* dashboards can follow the job with dvdbackup-stat */
+	if (stats_open(dvd) != 0) {
+		XLog3(pApp, _("Cannot publish live statistics"));
+	}
+	if (prom_file != NULL && prom_start(prom_file) != 0) {
+		fprintf(stderr, _("Failed to start writing metrics to %s\n"), prom_file);
+	}
+
+	/* includes the CSS authentication */
+	stats_timer_start(&open_timer);
 	_dvd = DVDOpen(dvd);
+	stats_timer_stop(&open_timer, STATS_PHASE_OPEN);
 	if (!_dvd) {
 		fprintf(stderr,_("Cannot open specified device %s - check your DVD device\n"), dvd);
-		exit(-1);
+		exit_early(NULL, -1);
 	}
 
 	if (do_info) {
 		DVDDisplayInfo(_dvd, dvd);
-		DVDClose(_dvd);
-		exit(0);
+		exit_early(_dvd, 0);
 	}
 
 
 	if(provided_title_name == NULL) {
 		if (DVDGetTitleName(dvd,title_name) != 0) {
 			fprintf(stderr,_("You must provide a title name when you read your DVD-Video structure direct from the HD\n"));
-			DVDClose(_dvd);
-			exit(1);
+			exit_early(_dvd, 1);
 		}
 		if (strstr(title_name, "DVD_VIDEO") != NULL) {
 			fprintf(stderr,_("The DVD-Video title on the disk is DVD_VIDEO, which is too generic; please provide a title with the -n switch\n"));
-			DVDClose(_dvd);
-			exit(2);
+			exit_early(_dvd, 2);
 		}
 
 	} else {
@@ -429,14 +735,15 @@ int main(int argc, char* argv[]) {
 			strcpy(title_name,provided_title_name);
 		}
 	}
+	app.title_name = title_name;
+	stats_set_disc(title_name);
 
 	// Reserve space for "<targetdir>/<title_name>/VIDEO_TS" and terminating "\0"
 	targetname_length = strlen(targetdir) + strlen(title_name) + 11;
 	targetname = malloc(targetname_length);
 	if (targetname == NULL) {
 		fprintf(stderr, _("Failed to allocate %zu bytes for a filename.\n"), targetname_length);
-		DVDClose(_dvd);
-		return 1;
+		exit_early(_dvd, 1);
 	}
 	snprintf(targetname, targetname_length, "%s", targetdir);
 
@@ -448,8 +755,7 @@ int main(int argc, char* argv[]) {
 		if (mkdir(targetname, 0777) != 0) {
 			fprintf(stderr,_("Failed creating target directory %s\n"), targetname);
 			perror("");
-			DVDClose(_dvd);
-			exit(-1);
+			exit_early(_dvd, -1);
 		}
 	}
 
@@ -464,8 +770,7 @@ int main(int argc, char* argv[]) {
 		if (mkdir(targetname, 0777) != 0) {
 			fprintf(stderr,_("Failed creating title directory\n"));
 			perror("");
-			DVDClose(_dvd);
-			exit(-1);
+			exit_early(_dvd, -1);
 		}
 	}
 
@@ -479,8 +784,7 @@ int main(int argc, char* argv[]) {
 		if (mkdir(targetname, 0777) != 0) {
 			fprintf(stderr,_("Failed creating VIDEO_TS directory\n"));
 			perror("");
-			DVDClose(_dvd);
-			exit(-1);
+			exit_early(_dvd, -1);
 		}
 	}
 
@@ -547,9 +851,48 @@ int main(int argc, char* argv[]) {
 	}
 
 
+	/* the time that is left goes to what the copy left for later */
+	if (deadline > 0 && return_code == 0) {
+		long long blocks_missing = DVDRecover(_dvd, errorstrat);
+
+		if (blocks_missing < 0) {
+			return_code = -1;
+		} else if (blocks_missing > 0) {
+			return_code = 3;
+		}
+	}
+
+	if (report_file != NULL && report_write(report_file, REPORT_FORMAT_TEXT) != 0) {
+		return_code = -1;
+	}
+	if (report_json_file != NULL && report_write(report_json_file, REPORT_FORMAT_JSON) != 0) {
+		return_code = -1;
+	}
+	report_free();
+	if (heatmap_prefix != NULL && heatmap_write(heatmap_prefix) != 0) {
+		return_code = -1;
+	}
+	heatmap_free();
+	reader_free();
+	chunk_free();
+
+	progress_job_done(return_code == 0);
+	stats_close(return_code == 0);
+	prom_stop();
+
 	DVDClose(_dvd);
+	/* the logging thread may still be feeding the database */
+	DVDLogStop();
 #ifdef ENABLE_LOGDB
 	dvdbackup_logdb_exit(app.conn);
 #endif
+
+	/* after the logging thread, so nothing is printed in between */
+	if (print_stats) {
+		stats_summary();
+	}
+	if (stats_json_file != NULL && stats_write_json(stats_json_file) != 0) {
+		return_code = -1;
+	}
 	exit(return_code);
 }
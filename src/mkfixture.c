@@ -0,0 +1,1231 @@
+/*
+ * mkfixture - write a synthetic DVD-Video file set for tests and benchmarks
+ *
+ * The VIDEO_TS directory written here has IFO and BUP files libdvdread
+ * parses, menu and title VOBs made of VOBUs that start with a NAV pack,
+ * unreferenced decoy ranges between cells, interleaved angle blocks and
+ * title VOBs split at any size. The same seed and options always give the
+ * same bytes. The picture data is noise; nothing here is meant to play.
+ *
+ * With --iso the directory is also mastered into an image by genisoimage,
+ * which lays the files out where the IFOs say they are.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+/* C standard libraries */
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* C POSIX libraries */
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* ...and getopt_long */
+#include <getopt.h>
+
+#define BLOCK 2048
+#define MAX_VOB_PARTS 9
+#define MAX_TITLE_SETS 99
+
+/* 90 kHz ticks per VOBU, which is half a second */
+#define VOBU_TICKS 45000
+
+/* sizes of the IFO tables, see libdvdread's ifo_types.h */
+#define MAT_SIZE 0x400
+#define PGC_SIZE 0xEC
+#define CELL_PLAYBACK_SIZE 24
+#define CELL_POSITION_SIZE 4
+#define CELL_ADR_SIZE 12
+#define VTS_ATTRIBUTES_SIZE 542
+#define COMMAND_SIZE 8
+
+/* offsets in a NAV pack */
+#define NAV_PCI 0x26
+#define NAV_PCI_DATA 0x2D
+#define NAV_DSI 0x400
+#define NAV_DSI_DATA 0x407
+
+typedef struct {
+	int title_sets;
+	int titles;
+	int pgcs;
+	int cells;
+	int angles;
+	int vobus;
+	int vobu_blocks;
+	int vob_size_blocks;
+	int decoys;
+	int menus;
+	const char *name;
+} options_t;
+
+typedef struct {
+	uint32_t start;
+	uint32_t blocks;
+	uint16_t vob_id;	/* 0 for decoys */
+	uint8_t cell_id;
+	uint32_t ilvu_next;	/* interleaved: distance to the angle's next ILVU, or 0 */
+	int ilvu;
+} vobu_t;
+
+typedef struct {
+	uint32_t first;
+	uint32_t first_ilvu_end;
+	uint32_t last_vobu_start;
+	uint32_t last;
+	uint16_t vob_id;
+	uint8_t cell_id;
+	uint8_t block;		/* byte 0 of the cell playback entry */
+	int nr_of_vobus;
+} cell_t;
+
+typedef struct {
+	int nr_of_cells;
+	cell_t *cells;
+	int nr_of_programs;
+	uint8_t *program_map;	/* first cell of each program, from 1 */
+	uint8_t entry_id;
+	uint16_t next_pgc_nr;
+	uint16_t prev_pgc_nr;
+	int nr_of_pre;
+	int nr_of_post;
+	uint8_t commands[2][COMMAND_SIZE];
+	int nr_of_vobus;
+} fixture_pgc_t;
+
+/* the VOBs of one menu or title domain */
+typedef struct {
+	vobu_t *vobus;
+	int nr_of_vobus;
+	uint32_t blocks;
+	fixture_pgc_t *pgcs;
+	int nr_of_pgcs;
+	int angles;
+} domain_t;
+
+/* a growing, zero filled byte buffer for IFO tables */
+typedef struct {
+	unsigned char *data;
+	size_t size;
+} bytes_t;
+
+static uint64_t rng_state;
+
+
+/* splitmix64; good enough and the same everywhere */
+static uint64_t rng_next(void) {
+	uint64_t z = (rng_state += 0x9E3779B97F4A7C15ULL);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/* a number from lo to hi inclusive */
+static int rng_range(int lo, int hi) {
+	if (hi <= lo) {
+		return lo;
+	}
+	return lo + (int)(rng_next() % (uint64_t)(hi - lo + 1));
+}
+
+
+static void* xcalloc(size_t n, size_t size) {
+	void *p = calloc(n > 0 ? n : 1, size);
+
+	if (p == NULL) {
+		fprintf(stderr, "mkfixture: out of memory\n");
+		exit(1);
+	}
+	return p;
+}
+
+static void bytes_grow(bytes_t *b, size_t size) {
+	unsigned char *data;
+
+	if (size <= b->size) {
+		return;
+	}
+	if ((data = realloc(b->data, size)) == NULL) {
+		fprintf(stderr, "mkfixture: out of memory\n");
+		exit(1);
+	}
+	memset(data + b->size, 0, size - b->size);
+	b->data = data;
+	b->size = size;
+}
+
+static void put8(bytes_t *b, size_t at, uint8_t v) {
+	bytes_grow(b, at + 1);
+	b->data[at] = v;
+}
+
+static void put16(bytes_t *b, size_t at, uint16_t v) {
+	bytes_grow(b, at + 2);
+	b->data[at] = v >> 8;
+	b->data[at + 1] = v;
+}
+
+static void put32(bytes_t *b, size_t at, uint32_t v) {
+	bytes_grow(b, at + 4);
+	b->data[at] = v >> 24;
+	b->data[at + 1] = v >> 16;
+	b->data[at + 2] = v >> 8;
+	b->data[at + 3] = v;
+}
+
+static void put_bytes(bytes_t *b, size_t at, const void *src, size_t n) {
+	bytes_grow(b, at + n);
+	memcpy(b->data + at, src, n);
+}
+
+/* Append src at the next sector boundary of b; returns that sector. */
+static uint32_t put_table(bytes_t *b, const bytes_t *src) {
+	uint32_t sector = (b->size + BLOCK - 1) / BLOCK;
+
+	put_bytes(b, (size_t)sector * BLOCK, src->data, src->size);
+	bytes_grow(b, ((b->size + BLOCK - 1) / BLOCK) * BLOCK);
+	return sector;
+}
+
+static uint32_t sectors(size_t bytes) {
+	return (bytes + BLOCK - 1) / BLOCK;
+}
+
+
+/* Lay out the VOBUs of one cell at the end of the domain. */
+static void layout_cell(domain_t *d, cell_t *cell, uint16_t vob_id, uint8_t cell_id, int nr_of_vobus, int vobu_blocks) {
+	vobu_t *v;
+	int i;
+
+	d->vobus = realloc(d->vobus, (d->nr_of_vobus + nr_of_vobus) * sizeof(vobu_t));
+	if (d->vobus == NULL) {
+		fprintf(stderr, "mkfixture: out of memory\n");
+		exit(1);
+	}
+
+	cell->first = d->blocks;
+	cell->vob_id = vob_id;
+	cell->cell_id = cell_id;
+	cell->nr_of_vobus = nr_of_vobus;
+	for (i = 0; i < nr_of_vobus; i++) {
+		v = &d->vobus[d->nr_of_vobus++];
+		memset(v, 0, sizeof(vobu_t));
+		v->start = d->blocks;
+		/* a NAV pack and at least one more */
+		v->blocks = rng_range(vobu_blocks / 2 > 2 ? vobu_blocks / 2 : 2, vobu_blocks * 3 / 2 > 2 ? vobu_blocks * 3 / 2 : 2);
+		v->vob_id = vob_id;
+		v->cell_id = cell_id;
+		cell->last_vobu_start = v->start;
+		d->blocks += v->blocks;
+	}
+	cell->first_ilvu_end = 0;
+	cell->last = d->blocks - 1;
+}
+
+/* Lay out an angle block of cells, one per angle, interleaved in units of
+ * one VOBU of ilvu_blocks each. */
+static void layout_angle_block(domain_t *d, cell_t *cells, int angles, uint16_t vob_id, uint8_t first_cell_id,
+		int nr_of_ilvus, int ilvu_blocks) {
+	uint32_t base = d->blocks;
+	vobu_t *v;
+	int a, i;
+
+	d->vobus = realloc(d->vobus, (d->nr_of_vobus + angles * nr_of_ilvus) * sizeof(vobu_t));
+	if (d->vobus == NULL) {
+		fprintf(stderr, "mkfixture: out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < nr_of_ilvus; i++) {
+		for (a = 0; a < angles; a++) {
+			v = &d->vobus[d->nr_of_vobus++];
+			memset(v, 0, sizeof(vobu_t));
+			v->start = d->blocks;
+			v->blocks = ilvu_blocks;
+			v->vob_id = vob_id;
+			v->cell_id = first_cell_id + a;
+			v->ilvu = 1;
+			v->ilvu_next = i < nr_of_ilvus - 1 ? (uint32_t)angles * ilvu_blocks : 0;
+			d->blocks += ilvu_blocks;
+		}
+	}
+
+	for (a = 0; a < angles; a++) {
+		cells[a].first = base + a * ilvu_blocks;
+		cells[a].first_ilvu_end = cells[a].first + ilvu_blocks - 1;
+		cells[a].last_vobu_start = base + ((nr_of_ilvus - 1) * angles + a) * ilvu_blocks;
+		cells[a].last = cells[a].last_vobu_start + ilvu_blocks - 1;
+		cells[a].vob_id = vob_id;
+		cells[a].cell_id = first_cell_id + a;
+		cells[a].nr_of_vobus = nr_of_ilvus;
+		/* interleaved, seamless angle; first, middle or last in the block */
+		cells[a].block = (a == 0 ? 0x40 : a == angles - 1 ? 0xC0 : 0x80) | 0x10 | 0x04 | 0x01;
+	}
+}
+
+/* Lay out decoy VOBUs no cell refers to. */
+static void layout_decoy(domain_t *d, int vobu_blocks) {
+	cell_t decoy;
+
+	layout_cell(d, &decoy, 0, 0, rng_range(1, 4), vobu_blocks);
+}
+
+/* Lay out a PGC of nr_of_cells programs, one of them an angle block if
+ * angles > 1, with a decoy before any cell at the given odds. */
+static void layout_pgc(domain_t *d, fixture_pgc_t *pgc, uint16_t vob_id, int nr_of_cells, int angles,
+		int vobus, int vobu_blocks, int decoy_percent) {
+	int angle_program = angles > 1 ? rng_range(0, nr_of_cells - 1) : -1;
+	int program, cell = 0;
+
+	pgc->nr_of_programs = nr_of_cells;
+	pgc->nr_of_cells = nr_of_cells + (angles > 1 ? angles - 1 : 0);
+	pgc->cells = xcalloc(pgc->nr_of_cells, sizeof(cell_t));
+	pgc->program_map = xcalloc(pgc->nr_of_programs, 1);
+
+	for (program = 0; program < nr_of_cells; program++) {
+		if (rng_range(1, 100) <= decoy_percent) {
+			layout_decoy(d, vobu_blocks);
+		}
+		pgc->program_map[program] = cell + 1;
+		if (program == angle_program) {
+			/* ILVUs need one size; keep each a whole VOBU */
+			layout_angle_block(d, pgc->cells + cell, angles, vob_id, cell + 1,
+					rng_range(2, vobus > 2 ? vobus : 2), vobu_blocks);
+			cell += angles;
+		} else {
+			layout_cell(d, &pgc->cells[cell], vob_id, cell + 1, rng_range(1, vobus * 2 - 1), vobu_blocks);
+			cell++;
+		}
+	}
+
+	for (cell = 0; cell < pgc->nr_of_cells; cell++) {
+		pgc->nr_of_vobus += pgc->cells[cell].nr_of_vobus;
+	}
+}
+
+
+/* MPEG-2 pack header with the given system clock reference */
+static void pack_header(unsigned char *p, uint64_t scr) {
+	p[0] = 0x00;
+	p[1] = 0x00;
+	p[2] = 0x01;
+	p[3] = 0xBA;
+	p[4] = 0x44 | ((scr >> 27) & 0x38) | ((scr >> 28) & 0x03);
+	p[5] = scr >> 20;
+	p[6] = 0x04 | ((scr >> 12) & 0xF8) | ((scr >> 13) & 0x03);
+	p[7] = scr >> 5;
+	p[8] = 0x04 | ((scr << 3) & 0xF8);
+	p[9] = 0x01;
+	/* 10.08 Mbit/s */
+	p[10] = 0x01;
+	p[11] = 0x89;
+	p[12] = 0xC3;
+	p[13] = 0xF8;
+}
+
+static void set32(unsigned char *p, uint32_t v) {
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+static void set16(unsigned char *p, uint16_t v) {
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+/* NAV pack of a VOBU: PCI and DSI with the fields dvdbackup and players
+ * look at filled in. */
+static void nav_pack(unsigned char *p, const domain_t *d, int index, uint64_t scr, uint32_t pts) {
+	static const unsigned char system_header[24] = {
+		0x00, 0x00, 0x01, 0xBB, 0x00, 0x12, 0x80, 0xC4, 0xE1, 0x00, 0xE1, 0xFF,
+		0xB9, 0xE0, 0xE8, 0xB8, 0xC0, 0x20, 0xBD, 0xE0, 0x3A, 0xBF, 0xE0, 0x02
+	};
+	const vobu_t *v = &d->vobus[index];
+	unsigned char *pci = p + NAV_PCI_DATA;
+	unsigned char *dsi = p + NAV_DSI_DATA;
+
+	memset(p, 0, BLOCK);
+	pack_header(p, scr);
+	memcpy(p + 14, system_header, sizeof(system_header));
+
+	/* private stream 2: PCI, then DSI */
+	set32(p + NAV_PCI, 0x000001BF);
+	set16(p + NAV_PCI + 4, 0x03D4);
+	p[NAV_PCI + 6] = 0x00;
+	set32(p + NAV_DSI, 0x000001BF);
+	set16(p + NAV_DSI + 4, 0x03FA);
+	p[NAV_DSI + 6] = 0x01;
+
+	/* pci_gi: nv_pck_lbn, vobu_s_ptm, vobu_e_ptm */
+	set32(pci, v->start);
+	set32(pci + 0x0C, pts);
+	set32(pci + 0x10, pts + VOBU_TICKS);
+
+	/* dsi_gi: nv_pck_scr, nv_pck_lbn, vobu_ea, vob and cell id */
+	set32(dsi, (uint32_t)scr);
+	set32(dsi + 0x04, v->start);
+	set32(dsi + 0x08, v->blocks - 1);
+	set16(dsi + 0x18, v->vob_id);
+	dsi[0x1B] = v->cell_id;
+
+	/* sml_pbi: an interleaved unit of one VOBU */
+	if (v->ilvu) {
+		set16(dsi + 0x20, 0x7000);
+		set32(dsi + 0x22, v->blocks - 1);
+		set32(dsi + 0x26, v->ilvu_next);
+		set16(dsi + 0x2A, v->blocks);
+	}
+
+	/* vobu_sri: next and previous VOBU of the same cell */
+	if (index + 1 < d->nr_of_vobus && d->vobus[index + 1].cell_id == v->cell_id
+			&& d->vobus[index + 1].vob_id == v->vob_id && !v->ilvu) {
+		set32(dsi + 0xEA + 0x4C + 0x04, 0x80000000u | v->blocks);
+	} else {
+		set32(dsi + 0xEA + 0x4C + 0x04, 0x3FFFFFFF);
+	}
+	if (index > 0 && d->vobus[index - 1].cell_id == v->cell_id
+			&& d->vobus[index - 1].vob_id == v->vob_id && !v->ilvu) {
+		set32(dsi + 0xEA + 0x4C + 0x08, 0x80000000u | d->vobus[index - 1].blocks);
+	} else {
+		set32(dsi + 0xEA + 0x4C + 0x08, 0x3FFFFFFF);
+	}
+}
+
+/* a video pack of noise */
+static void video_pack(unsigned char *p, uint64_t scr) {
+	uint64_t r;
+	int i;
+
+	pack_header(p, scr);
+	set32(p + 14, 0x000001E0);
+	set16(p + 18, BLOCK - 20);
+	p[20] = 0x81;
+	p[21] = 0x00;
+	p[22] = 0x00;
+	for (i = 23; i < BLOCK; i += 8) {
+		r = rng_next();
+		memcpy(p + i, &r, BLOCK - i < 8 ? BLOCK - i : 8);
+	}
+}
+
+
+/* writes a domain's VOBs, starting a new file every limit blocks */
+typedef struct {
+	const char *dir;
+	int title_set;
+	int menu;
+	int part;
+	int fd;
+	uint32_t written;
+	uint32_t limit;
+} vob_writer_t;
+
+static int vob_name(char *name, size_t size, const char *dir, int title_set, int part) {
+	if (title_set == 0) {
+		return snprintf(name, size, "%s/VIDEO_TS/VIDEO_TS.VOB", dir);
+	}
+	return snprintf(name, size, "%s/VIDEO_TS/VTS_%02d_%d.VOB", dir, title_set, part);
+}
+
+static int vob_write(vob_writer_t *w, const unsigned char *block) {
+	char name[PATH_MAX];
+	ssize_t n;
+
+	if (w->fd == -1 || (!w->menu && w->written == w->limit)) {
+		if (w->fd != -1) {
+			close(w->fd);
+		}
+		w->part++;
+		if (w->part > MAX_VOB_PARTS) {
+			fprintf(stderr, "mkfixture: title set %d needs more than %d VOB files; raise --vob-size\n",
+					w->title_set, MAX_VOB_PARTS);
+			return 1;
+		}
+		vob_name(name, sizeof(name), w->dir, w->title_set, w->menu ? 0 : w->part);
+		if ((w->fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+			fprintf(stderr, "mkfixture: cannot create %s: %s\n", name, strerror(errno));
+			return 1;
+		}
+		w->written = 0;
+	}
+
+	n = write(w->fd, block, BLOCK);
+	if (n != BLOCK) {
+		fprintf(stderr, "mkfixture: writing VOB: %s\n", n < 0 ? strerror(errno) : "short write");
+		return 1;
+	}
+	w->written++;
+	return 0;
+}
+
+static int write_domain(const domain_t *d, const char *dir, int title_set, int menu, uint32_t limit) {
+	vob_writer_t w = { dir, title_set, menu, 0, -1, 0, limit };
+	unsigned char block[BLOCK];
+	uint64_t scr = 0;
+	uint32_t pts = VOBU_TICKS;
+	uint32_t i;
+	int v;
+
+	for (v = 0; v < d->nr_of_vobus; v++) {
+		nav_pack(block, d, v, scr, pts);
+		if (vob_write(&w, block) != 0) {
+			close(w.fd);
+			return 1;
+		}
+		for (i = 1; i < d->vobus[v].blocks; i++) {
+			/* about the time a pack takes at the mux rate */
+			scr += 1800;
+			video_pack(block, scr);
+			if (vob_write(&w, block) != 0) {
+				close(w.fd);
+				return 1;
+			}
+		}
+		scr += 1800;
+		pts += VOBU_TICKS;
+	}
+
+	if (w.fd != -1 && close(w.fd) != 0) {
+		fprintf(stderr, "mkfixture: writing VOB: %s\n", strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+
+/* BCD playback time at 25 frames a second */
+static void put_time(bytes_t *b, size_t at, int vobus) {
+	int seconds = vobus / 2;
+
+	put8(b, at, ((seconds / 3600 / 10) << 4) | (seconds / 3600 % 10));
+	put8(b, at + 1, ((seconds / 60 % 60 / 10) << 4) | (seconds / 60 % 10));
+	put8(b, at + 2, ((seconds % 60 / 10) << 4) | (seconds % 10));
+	put8(b, at + 3, 0x40 | (vobus % 2 ? 0x12 : 0x00));
+}
+
+/* one PGC with its command table, program map, cell playback and position */
+static void table_pgc(bytes_t *b, size_t at, const fixture_pgc_t *pgc, int audio, int subp) {
+	size_t offset = PGC_SIZE;
+	int i;
+
+	put8(b, at + 0x02, pgc->nr_of_programs);
+	put8(b, at + 0x03, pgc->nr_of_cells);
+	put_time(b, at + 0x04, pgc->nr_of_vobus);
+	for (i = 0; i < audio; i++) {
+		put16(b, at + 0x0C + 2 * i, 0x8000 | (i << 8));
+	}
+	for (i = 0; i < subp; i++) {
+		put32(b, at + 0x1C + 4 * i, 0x80000000u | ((uint32_t)i << 24) | (i << 16) | (i << 8) | i);
+	}
+	put16(b, at + 0x9C, pgc->next_pgc_nr);
+	put16(b, at + 0x9E, pgc->prev_pgc_nr);
+	for (i = 0; i < 16; i++) {
+		put32(b, at + 0xA4 + 4 * i, 0x00108080);
+	}
+
+	if (pgc->nr_of_pre + pgc->nr_of_post > 0) {
+		put16(b, at + 0xE4, offset);
+		put16(b, at + offset, pgc->nr_of_pre);
+		put16(b, at + offset + 2, pgc->nr_of_post);
+		put16(b, at + offset + 4, 0);
+		put16(b, at + offset + 6, 8 + COMMAND_SIZE * (pgc->nr_of_pre + pgc->nr_of_post) - 1);
+		for (i = 0; i < pgc->nr_of_pre + pgc->nr_of_post; i++) {
+			put_bytes(b, at + offset + 8 + COMMAND_SIZE * i, pgc->commands[i], COMMAND_SIZE);
+		}
+		offset += 8 + COMMAND_SIZE * (pgc->nr_of_pre + pgc->nr_of_post);
+	}
+
+	if (pgc->nr_of_programs > 0) {
+		put16(b, at + 0xE6, offset);
+		put_bytes(b, at + offset, pgc->program_map, pgc->nr_of_programs);
+		offset += (pgc->nr_of_programs + 1) & ~1;
+	}
+
+	if (pgc->nr_of_cells > 0) {
+		put16(b, at + 0xE8, offset);
+		for (i = 0; i < pgc->nr_of_cells; i++) {
+			const cell_t *c = &pgc->cells[i];
+			size_t e = at + offset + CELL_PLAYBACK_SIZE * i;
+
+			put8(b, e, c->block);
+			put_time(b, e + 4, c->nr_of_vobus);
+			put32(b, e + 8, c->first);
+			put32(b, e + 12, c->first_ilvu_end);
+			put32(b, e + 16, c->last_vobu_start);
+			put32(b, e + 20, c->last);
+		}
+		offset += CELL_PLAYBACK_SIZE * pgc->nr_of_cells;
+
+		put16(b, at + 0xEA, offset);
+		for (i = 0; i < pgc->nr_of_cells; i++) {
+			put16(b, at + offset + CELL_POSITION_SIZE * i, pgc->cells[i].vob_id);
+			put8(b, at + offset + CELL_POSITION_SIZE * i + 3, pgc->cells[i].cell_id);
+		}
+	}
+
+	/* make sure the last structure is in the buffer */
+	bytes_grow(b, at + offset + CELL_POSITION_SIZE * pgc->nr_of_cells);
+}
+
+/* PGCIT at the start of b */
+static void table_pgcit(bytes_t *b, size_t at, const domain_t *d, int audio, int subp) {
+	size_t offset = 8 + 8 * d->nr_of_pgcs;
+	int i;
+
+	put16(b, at, d->nr_of_pgcs);
+	for (i = 0; i < d->nr_of_pgcs; i++) {
+		put8(b, at + 8 + 8 * i, d->pgcs[i].entry_id);
+		put32(b, at + 8 + 8 * i + 4, offset);
+		table_pgc(b, at + offset, &d->pgcs[i], audio, subp);
+		offset = b->size - at;
+		offset = (offset + 3) & ~(size_t)3;
+	}
+	bytes_grow(b, at + offset);
+	put32(b, at + 4, offset - 1);
+}
+
+/* PGCI_UT with one English language unit */
+static void table_pgci_ut(bytes_t *b, const domain_t *d, uint8_t exists, int audio, int subp) {
+	put16(b, 0, 1);
+	put16(b, 8, 0x656E);
+	put8(b, 11, exists);
+	put32(b, 12, 16);
+	table_pgcit(b, 16, d, audio, subp);
+	put32(b, 4, b->size - 1);
+}
+
+/* cell address table: every contiguous run of a cell's VOBUs */
+static void table_c_adt(bytes_t *b, const domain_t *d) {
+	int n = 0, max_vob_id = 0, v = 0, end;
+
+	while (v < d->nr_of_vobus) {
+		end = v;
+		while (end + 1 < d->nr_of_vobus && d->vobus[end + 1].vob_id == d->vobus[v].vob_id
+				&& d->vobus[end + 1].cell_id == d->vobus[v].cell_id) {
+			end++;
+		}
+		if (d->vobus[v].vob_id != 0) {
+			put16(b, 8 + CELL_ADR_SIZE * n, d->vobus[v].vob_id);
+			put8(b, 8 + CELL_ADR_SIZE * n + 2, d->vobus[v].cell_id);
+			put32(b, 8 + CELL_ADR_SIZE * n + 4, d->vobus[v].start);
+			put32(b, 8 + CELL_ADR_SIZE * n + 8, d->vobus[end].start + d->vobus[end].blocks - 1);
+			if (d->vobus[v].vob_id > max_vob_id) {
+				max_vob_id = d->vobus[v].vob_id;
+			}
+			n++;
+		}
+		v = end + 1;
+	}
+
+	put16(b, 0, max_vob_id);
+	put32(b, 4, 8 + CELL_ADR_SIZE * n - 1);
+}
+
+/* VOBU address map, decoys included */
+static void table_vobu_admap(bytes_t *b, const domain_t *d) {
+	int v;
+
+	for (v = 0; v < d->nr_of_vobus; v++) {
+		put32(b, 4 + 4 * v, d->vobus[v].start);
+	}
+	put32(b, 0, 4 + 4 * d->nr_of_vobus - 1);
+}
+
+static void put_video_attr(bytes_t *b, size_t at, int wide) {
+	/* MPEG-2, PAL, 16:9 or 4:3 */
+	put8(b, at, wide ? 0x5C : 0x53);
+	put8(b, at + 1, 0x00);
+}
+
+static void put_audio_attr(bytes_t *b, size_t at) {
+	/* AC-3 stereo, English */
+	put8(b, at, 0x04);
+	put8(b, at + 1, 0x01);
+	put16(b, at + 2, 0x656E);
+}
+
+static void put_subp_attr(bytes_t *b, size_t at) {
+	put8(b, at, 0x01);
+	put16(b, at + 2, 0x656E);
+}
+
+static void vts_attributes(bytes_t *b, size_t at, int wide) {
+	put32(b, at, VTS_ATTRIBUTES_SIZE - 1);
+	put_video_attr(b, at + 8, wide);
+	put8(b, at + 11, 1);
+	put_audio_attr(b, at + 12);
+	put8(b, at + 93, 1);
+	put_subp_attr(b, at + 94);
+	put_video_attr(b, at + 264, wide);
+	put8(b, at + 267, 1);
+	put_audio_attr(b, at + 268);
+	put8(b, at + 349, 1);
+	put_subp_attr(b, at + 350);
+}
+
+static int write_file(const char *dir, const char *name, const bytes_t *b) {
+	char path[PATH_MAX];
+	FILE *stream;
+
+	snprintf(path, sizeof(path), "%s/VIDEO_TS/%s", dir, name);
+	if ((stream = fopen(path, "wb")) == NULL) {
+		fprintf(stderr, "mkfixture: cannot create %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	if (fwrite(b->data, 1, b->size, stream) != b->size || fclose(stream) != 0) {
+		fprintf(stderr, "mkfixture: cannot write %s\n", path);
+		return 1;
+	}
+	return 0;
+}
+
+/* Write VTS_nn_0.IFO and .BUP; returns the IFO size in sectors or 0. */
+static uint32_t write_vtsi(const char *dir, int title_set, const domain_t *menu, const domain_t *titles, int wide,
+		const int *titles_pgcs, int nr_of_titles) {
+	bytes_t ifo = { NULL, 0 }, table = { NULL, 0 };
+	char name[24];
+	uint32_t ifo_sectors, offset;
+	int t, p, pgc;
+
+	/* MAT, filled in below once the table sectors are known */
+	bytes_grow(&ifo, MAT_SIZE);
+
+	/* PTT_SRPT: each title's chapters are the programs of its PGCs */
+	offset = 8 + 4 * nr_of_titles;
+	put16(&table, 0, nr_of_titles);
+	for (t = 0, pgc = 0; t < nr_of_titles; t++) {
+		int end = pgc + titles_pgcs[t];
+
+		put32(&table, 8 + 4 * t, offset);
+		for (; pgc < end; pgc++) {
+			for (p = 0; p < titles->pgcs[pgc].nr_of_programs; p++) {
+				put16(&table, offset, pgc + 1);
+				put16(&table, offset + 2, p + 1);
+				offset += 4;
+			}
+		}
+	}
+	put32(&table, 4, offset - 1);
+	put32(&ifo, 0xC8, put_table(&ifo, &table));
+	free(table.data);
+	table.data = NULL;
+	table.size = 0;
+
+	table_pgcit(&table, 0, titles, 1, 1);
+	put32(&ifo, 0xCC, put_table(&ifo, &table));
+	free(table.data);
+	table.data = NULL;
+	table.size = 0;
+
+	if (menu->nr_of_vobus > 0) {
+		table_pgci_ut(&table, menu, 0x80, 1, 1);
+		put32(&ifo, 0xD0, put_table(&ifo, &table));
+		free(table.data);
+		table.data = NULL;
+		table.size = 0;
+
+		table_c_adt(&table, menu);
+		put32(&ifo, 0xD8, put_table(&ifo, &table));
+		free(table.data);
+		table.data = NULL;
+		table.size = 0;
+
+		table_vobu_admap(&table, menu);
+		put32(&ifo, 0xDC, put_table(&ifo, &table));
+		free(table.data);
+		table.data = NULL;
+		table.size = 0;
+	}
+
+	table_c_adt(&table, titles);
+	put32(&ifo, 0xE0, put_table(&ifo, &table));
+	free(table.data);
+	table.data = NULL;
+	table.size = 0;
+
+	table_vobu_admap(&table, titles);
+	put32(&ifo, 0xE4, put_table(&ifo, &table));
+	free(table.data);
+
+	ifo_sectors = sectors(ifo.size);
+
+	put_bytes(&ifo, 0, "DVDVIDEO-VTS", 12);
+	put32(&ifo, 0x0C, 2 * ifo_sectors + menu->blocks + titles->blocks - 1);
+	put32(&ifo, 0x1C, ifo_sectors - 1);
+	put8(&ifo, 0x21, 0x11);
+	put32(&ifo, 0x80, MAT_SIZE - 1);
+	put32(&ifo, 0xC0, menu->nr_of_vobus > 0 ? ifo_sectors : 0);
+	put32(&ifo, 0xC4, ifo_sectors + menu->blocks);
+	put_video_attr(&ifo, 0x100, wide);
+	put8(&ifo, 0x103, 1);
+	put_audio_attr(&ifo, 0x104);
+	put8(&ifo, 0x155, 1);
+	put_subp_attr(&ifo, 0x156);
+	put_video_attr(&ifo, 0x200, wide);
+	put8(&ifo, 0x203, 1);
+	put_audio_attr(&ifo, 0x204);
+	put8(&ifo, 0x255, 1);
+	put_subp_attr(&ifo, 0x256);
+
+	snprintf(name, sizeof(name), "VTS_%02d_0.IFO", title_set);
+	if (write_file(dir, name, &ifo) != 0) {
+		free(ifo.data);
+		return 0;
+	}
+	snprintf(name, sizeof(name), "VTS_%02d_0.BUP", title_set);
+	if (write_file(dir, name, &ifo) != 0) {
+		free(ifo.data);
+		return 0;
+	}
+
+	free(ifo.data);
+	return ifo_sectors;
+}
+
+
+typedef struct {
+	domain_t menu;
+	domain_t titles;
+	int *title_pgcs;	/* PGCs of each title */
+	int nr_of_titles;
+	int wide;
+	uint32_t ifo_sectors;
+} title_set_t;
+
+static void free_domain(domain_t *d) {
+	int i;
+
+	for (i = 0; i < d->nr_of_pgcs; i++) {
+		free(d->pgcs[i].cells);
+		free(d->pgcs[i].program_map);
+	}
+	free(d->pgcs);
+	free(d->vobus);
+}
+
+/* Lay out a menu domain of one or two still menus and maybe a decoy. */
+static void layout_menu(domain_t *d, uint8_t entry_id, const options_t *o) {
+	int i;
+
+	d->nr_of_pgcs = rng_range(1, 2);
+	d->pgcs = xcalloc(d->nr_of_pgcs, sizeof(fixture_pgc_t));
+	for (i = 0; i < d->nr_of_pgcs; i++) {
+		layout_pgc(d, &d->pgcs[i], i + 1, rng_range(1, 2), 1, 2, o->vobu_blocks, o->decoys > 0 ? 30 : 0);
+	}
+	d->pgcs[0].entry_id = entry_id;
+	if (o->decoys > 0) {
+		layout_decoy(d, o->vobu_blocks);
+	}
+}
+
+static void layout_title_set(title_set_t *ts, const options_t *o) {
+	domain_t *d = &ts->titles;
+	int nr_of_cells = o->titles * o->pgcs * o->cells;
+	int decoy_percent = nr_of_cells > 0 ? (o->decoys * 100 + nr_of_cells - 1) / nr_of_cells : 0;
+	int t, p, pgc;
+
+	if (o->menus) {
+		layout_menu(&ts->menu, 0x83, o);
+	}
+
+	ts->wide = rng_range(0, 1);
+	ts->nr_of_titles = o->titles;
+	ts->title_pgcs = xcalloc(o->titles, sizeof(int));
+	d->nr_of_pgcs = o->titles * o->pgcs;
+	d->pgcs = xcalloc(d->nr_of_pgcs, sizeof(fixture_pgc_t));
+	d->angles = o->angles;
+
+	for (t = 0, pgc = 0; t < o->titles; t++) {
+		ts->title_pgcs[t] = o->pgcs;
+		for (p = 0; p < o->pgcs; p++, pgc++) {
+			fixture_pgc_t *cur = &d->pgcs[pgc];
+
+			layout_pgc(d, cur, pgc + 1, o->cells, o->angles, o->vobus, o->vobu_blocks, decoy_percent);
+			if (p == 0) {
+				cur->entry_id = 0x80 | (t + 1);
+			} else {
+				cur->prev_pgc_nr = pgc;
+			}
+			if (p < o->pgcs - 1) {
+				/* LinkPGCN to the title's next PGC */
+				static const unsigned char link[COMMAND_SIZE] = { 0x20, 0x04, 0, 0, 0, 0, 0, 0 };
+
+				cur->next_pgc_nr = pgc + 2;
+				memcpy(cur->commands[0], link, COMMAND_SIZE);
+				cur->commands[0][7] = pgc + 2;
+				cur->nr_of_post = 1;
+			}
+		}
+	}
+
+	/* whatever decoys the odds left out go at the end */
+	if (o->decoys > 0) {
+		layout_decoy(d, o->vobu_blocks);
+	}
+}
+
+static int write_vmg(const char *dir, title_set_t *sets, const options_t *o, const domain_t *menu) {
+	bytes_t ifo = { NULL, 0 }, table = { NULL, 0 };
+	fixture_pgc_t first_play;
+	uint32_t ifo_sectors, sector, tt_srpt;
+	int nr_of_titles = 0, i, t, title;
+	size_t fp_size;
+
+	/* first play: JumpTT 1 */
+	memset(&first_play, 0, sizeof(first_play));
+	first_play.nr_of_pre = 1;
+	first_play.commands[0][0] = 0x30;
+	first_play.commands[0][1] = 0x02;
+	first_play.commands[0][5] = 0x01;
+	table_pgc(&ifo, MAT_SIZE, &first_play, 0, 0);
+	fp_size = ifo.size - MAT_SIZE;
+
+	for (i = 0; i < o->title_sets; i++) {
+		nr_of_titles += sets[i].nr_of_titles;
+	}
+
+	/* TT_SRPT, with each title set's start sector filled in below */
+	put16(&table, 0, nr_of_titles);
+	put32(&table, 4, 8 + 12 * nr_of_titles - 1);
+	bytes_grow(&table, 8 + 12 * nr_of_titles);
+	tt_srpt = put_table(&ifo, &table);
+	put32(&ifo, 0xC4, tt_srpt);
+	free(table.data);
+	table.data = NULL;
+	table.size = 0;
+
+	if (menu->nr_of_vobus > 0) {
+		table_pgci_ut(&table, menu, 0x80, 1, 1);
+		put32(&ifo, 0xC8, put_table(&ifo, &table));
+		free(table.data);
+		table.data = NULL;
+		table.size = 0;
+	}
+
+	/* VTS_ATRT */
+	put16(&table, 0, o->title_sets);
+	for (i = 0; i < o->title_sets; i++) {
+		put32(&table, 8 + 4 * i, 8 + 4 * o->title_sets + VTS_ATTRIBUTES_SIZE * i);
+		vts_attributes(&table, 8 + 4 * o->title_sets + VTS_ATTRIBUTES_SIZE * i, sets[i].wide);
+	}
+	put32(&table, 4, table.size - 1);
+	put32(&ifo, 0xD0, put_table(&ifo, &table));
+	free(table.data);
+	table.data = NULL;
+	table.size = 0;
+
+	if (menu->nr_of_vobus > 0) {
+		table_c_adt(&table, menu);
+		put32(&ifo, 0xD8, put_table(&ifo, &table));
+		free(table.data);
+		table.data = NULL;
+		table.size = 0;
+
+		table_vobu_admap(&table, menu);
+		put32(&ifo, 0xDC, put_table(&ifo, &table));
+		free(table.data);
+		table.data = NULL;
+		table.size = 0;
+	}
+
+	ifo_sectors = sectors(ifo.size);
+
+	/* where each title set starts, counted from VIDEO_TS.IFO */
+	sector = 2 * ifo_sectors + menu->blocks;
+	title = 0;
+	for (i = 0; i < o->title_sets; i++) {
+		for (t = 0; t < sets[i].nr_of_titles; t++, title++) {
+			size_t e = (size_t)tt_srpt * BLOCK + 8 + 12 * title;
+			int nr_of_ptts = 0, p;
+
+			for (p = t * o->pgcs; p < (t + 1) * o->pgcs; p++) {
+				nr_of_ptts += sets[i].titles.pgcs[p].nr_of_programs;
+			}
+			put8(&ifo, e, 0x3C | (o->pgcs > 1 ? 0x40 : 0x00));
+			put8(&ifo, e + 1, o->angles);
+			put16(&ifo, e + 2, nr_of_ptts);
+			put8(&ifo, e + 6, i + 1);
+			put8(&ifo, e + 7, t + 1);
+			put32(&ifo, e + 8, sector);
+		}
+		sector += 2 * sets[i].ifo_sectors + sets[i].menu.blocks + sets[i].titles.blocks;
+	}
+
+	put_bytes(&ifo, 0, "DVDVIDEO-VMG", 12);
+	put32(&ifo, 0x0C, 2 * ifo_sectors + menu->blocks - 1);
+	put32(&ifo, 0x1C, ifo_sectors - 1);
+	put8(&ifo, 0x21, 0x11);
+	put16(&ifo, 0x26, 1);
+	put16(&ifo, 0x28, 1);
+	put8(&ifo, 0x2A, 1);
+	put16(&ifo, 0x3E, o->title_sets);
+	put_bytes(&ifo, 0x40, "DVDBACKUP FIXTURE", 17);
+	put32(&ifo, 0x80, MAT_SIZE + fp_size - 1);
+	put32(&ifo, 0x84, MAT_SIZE);
+	put32(&ifo, 0xC0, menu->nr_of_vobus > 0 ? ifo_sectors : 0);
+	put_video_attr(&ifo, 0x100, 0);
+	put8(&ifo, 0x103, 1);
+	put_audio_attr(&ifo, 0x104);
+	put8(&ifo, 0x155, 1);
+	put_subp_attr(&ifo, 0x156);
+
+	if (write_file(dir, "VIDEO_TS.IFO", &ifo) != 0 || write_file(dir, "VIDEO_TS.BUP", &ifo) != 0) {
+		free(ifo.data);
+		return 1;
+	}
+
+	free(ifo.data);
+	return 0;
+}
+
+
+/* Master dir into an ISO image with genisoimage. */
+static int write_iso(const char *dir, const char *iso, const char *name) {
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid == -1) {
+		fprintf(stderr, "mkfixture: fork: %s\n", strerror(errno));
+		return 1;
+	}
+	if (pid == 0) {
+		/* -dvd-video puts the files in the order the IFOs expect */
+		execlp("genisoimage", "genisoimage", "-quiet", "-dvd-video", "-V", name, "-o", iso, dir, (char *)NULL);
+		fprintf(stderr, "mkfixture: cannot run genisoimage: %s\n", strerror(errno));
+		_exit(127);
+	}
+
+	if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "mkfixture: genisoimage failed\n");
+		return 1;
+	}
+	return 0;
+}
+
+
+static int make_dir(const char *path) {
+	if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "mkfixture: cannot create %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+
+static void print_help(const char *program_name) {
+	printf("Usage: %s [OPTION]... DIRECTORY\n", program_name);
+	printf("\n");
+	printf("Write a synthetic DVD-Video file set to DIRECTORY/VIDEO_TS.\n\n");
+	printf("\
+  -s, --seed=N             seed for every choice and byte (default 1)\n\
+  -T, --title-sets=N       number of title sets (default 2)\n\
+  -t, --titles=N           titles per title set (default 2)\n\
+  -p, --pgcs=N             PGCs per title (default 1)\n\
+  -c, --cells=N            programs per PGC (default 4)\n\
+  -a, --angles=N           angles of one program in each PGC (default 1)\n\
+  -v, --vobus=N            average VOBUs per cell (default 8)\n\
+  -b, --vobu-blocks=N      average blocks per VOBU (default 32)\n\
+  -S, --vob-size=N         blocks per title VOB file (default 524288)\n\
+  -d, --decoys=N           unreferenced ranges per title set (default 2)\n\
+  -M, --no-menus           leave out the menu VOBs\n\
+  -n, --name=NAME          volume name of the ISO image (default FIXTURE)\n\
+  -i, --iso=FILE           also master the set into the ISO image FILE\n\
+  -h, --help               display this help and exit\n");
+}
+
+
+static int parse_number(const char *arg, int min, int max, int *value) {
+	char *end;
+	long n;
+
+	errno = 0;
+	n = strtol(arg, &end, 10);
+	if (errno != 0 || *end != '\0' || end == arg || n < min || n > max) {
+		fprintf(stderr, "mkfixture: %s is not a number from %d to %d\n", arg, min, max);
+		return 1;
+	}
+	*value = n;
+	return 0;
+}
+
+
+int main(int argc, char *argv[]) {
+	options_t o = { 2, 2, 1, 4, 1, 8, 32, 524288, 2, 1, "FIXTURE" };
+	const char *iso = NULL;
+	const char *dir;
+	char path[PATH_MAX];
+	unsigned long long seed = 1;
+	domain_t vmgm;
+	title_set_t *sets;
+	char *end;
+	int result = 0;
+	int flags;
+	int i;
+
+	struct option longopts[] = {
+		{"seed", required_argument, NULL, 's'},
+		{"title-sets", required_argument, NULL, 'T'},
+		{"titles", required_argument, NULL, 't'},
+		{"pgcs", required_argument, NULL, 'p'},
+		{"cells", required_argument, NULL, 'c'},
+		{"angles", required_argument, NULL, 'a'},
+		{"vobus", required_argument, NULL, 'v'},
+		{"vobu-blocks", required_argument, NULL, 'b'},
+		{"vob-size", required_argument, NULL, 'S'},
+		{"decoys", required_argument, NULL, 'd'},
+		{"no-menus", no_argument, NULL, 'M'},
+		{"name", required_argument, NULL, 'n'},
+		{"iso", required_argument, NULL, 'i'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+	while ((flags = getopt_long(argc, argv, "s:T:t:p:c:a:v:b:S:d:Mn:i:h", longopts, NULL)) != -1) {
+		switch (flags) {
+		case 's':
+			errno = 0;
+			seed = strtoull(optarg, &end, 0);
+			if (errno != 0 || *end != '\0' || end == optarg) {
+				fprintf(stderr, "mkfixture: %s is not a seed\n", optarg);
+				return(1);
+			}
+			break;
+		case 'T':
+			result |= parse_number(optarg, 1, MAX_TITLE_SETS, &o.title_sets);
+			break;
+		case 't':
+			result |= parse_number(optarg, 1, 99, &o.titles);
+			break;
+		case 'p':
+			result |= parse_number(optarg, 1, 32, &o.pgcs);
+			break;
+		case 'c':
+			result |= parse_number(optarg, 1, 99, &o.cells);
+			break;
+		case 'a':
+			result |= parse_number(optarg, 1, 9, &o.angles);
+			break;
+		case 'v':
+			result |= parse_number(optarg, 1, 10000, &o.vobus);
+			break;
+		case 'b':
+			result |= parse_number(optarg, 2, 1024, &o.vobu_blocks);
+			break;
+		case 'S':
+			result |= parse_number(optarg, 1, 524288, &o.vob_size_blocks);
+			break;
+		case 'd':
+			result |= parse_number(optarg, 0, 1000, &o.decoys);
+			break;
+		case 'M':
+			o.menus = 0;
+			break;
+		case 'n':
+			o.name = optarg;
+			break;
+		case 'i':
+			iso = optarg;
+			break;
+		case 'h':
+			print_help(argv[0]);
+			return(0);
+		default:
+			print_help(argv[0]);
+			return(1);
+		}
+	}
+
+	if (result != 0) {
+		return(1);
+	}
+	if (optind != argc - 1) {
+		print_help(argv[0]);
+		return(1);
+	}
+	if (o.angles > 1 && o.cells > 99 - (o.angles - 1)) {
+		fprintf(stderr, "mkfixture: too many cells in a PGC\n");
+		return(1);
+	}
+	dir = argv[optind];
+
+	/* seed the generator the same way whatever the seed looks like */
+	rng_state = seed;
+	rng_next();
+
+	/* everything is laid out before anything is written */
+	memset(&vmgm, 0, sizeof(vmgm));
+	if (o.menus) {
+		layout_menu(&vmgm, 0x82, &o);
+	}
+	sets = xcalloc(o.title_sets, sizeof(title_set_t));
+	for (i = 0; i < o.title_sets; i++) {
+		layout_title_set(&sets[i], &o);
+	}
+
+	snprintf(path, sizeof(path), "%s/VIDEO_TS", dir);
+	if (make_dir(dir) != 0 || make_dir(path) != 0) {
+		return(1);
+	}
+	snprintf(path, sizeof(path), "%s/AUDIO_TS", dir);
+	if (make_dir(path) != 0) {
+		return(1);
+	}
+
+	if (vmgm.nr_of_vobus > 0) {
+		result = write_domain(&vmgm, dir, 0, 1, 0);
+	}
+	for (i = 0; i < o.title_sets && result == 0; i++) {
+		sets[i].ifo_sectors = write_vtsi(dir, i + 1, &sets[i].menu, &sets[i].titles, sets[i].wide,
+				sets[i].title_pgcs, sets[i].nr_of_titles);
+		if (sets[i].ifo_sectors == 0) {
+			result = 1;
+		}
+		if (result == 0 && sets[i].menu.nr_of_vobus > 0) {
+			result = write_domain(&sets[i].menu, dir, i + 1, 1, 0);
+		}
+		if (result == 0) {
+			result = write_domain(&sets[i].titles, dir, i + 1, 0, o.vob_size_blocks);
+		}
+	}
+	if (result == 0) {
+		result = write_vmg(dir, sets, &o, &vmgm);
+	}
+	if (result == 0 && iso != NULL) {
+		result = write_iso(dir, iso, o.name);
+	}
+
+	for (i = 0; i < o.title_sets; i++) {
+		free_domain(&sets[i].menu);
+		free_domain(&sets[i].titles);
+		free(sets[i].title_pgcs);
+	}
+	free(sets);
+	free_domain(&vmgm);
+
+	return(result);
+}
@@ -0,0 +1,52 @@
+#ifndef PROBES_H_
+#define PROBES_H_
+
+/*
+ * USDT probes for SystemTap, bpftrace and friends, provider "dvdbackup".
+ * With sys/sdt.h each probe is a single nop plus a note in the ELF file, so
+ * they cost nothing until a tracer attaches; without it they go away.
+ *
+ *   read-begin     offset, blocks
+ *   read-end       offset, blocks, blocks read or -1, microseconds
+ *   write-end      bytes, bytes written or -1, microseconds
+ *   read-size      old blocks per read, new, old blocks per second
+ *   read-cap       blocks that failed, blocks per read until reads work
+ *   watchdog       offset, blocks left for later, microseconds
+ *   pad            title set, menu, offset, blocks
+ *   skip-unused    title set, menu, offset, blocks        (-r u)
+ *   skip-compact   title set, menu, offset, blocks        (--compact)
+ *   file-open      file name, title set, vob
+ *   fault          kind, offset, blocks           (--fault-script)
+ *   ifo-begin      title set
+ *   ifo-end        title set, result
+ *   vm-begin       title set
+ *   vm-cell        title set, pgc, cell, first sector, last sector
+ *   vm-end         title set
+ *   log-message    level, message                 (logging thread)
+ *   log-drop       level
+ *   logdb-send     table, bytes, result (0 sent, 1 lost, 2 refused,
+ *                  3 rejected)
+ *   logdb-spool    table, rows
+ *
+ * e.g. bpftrace -e 'usdt:./dvdbackup:dvdbackup:read-end { @us = hist(arg3); }'
+ */
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+
+#define PROBE0(name) DTRACE_PROBE(dvdbackup, name)
+#define PROBE1(name, a) DTRACE_PROBE1(dvdbackup, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(dvdbackup, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(dvdbackup, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4(dvdbackup, name, a, b, c, d)
+#define PROBE5(name, a, b, c, d, e) DTRACE_PROBE5(dvdbackup, name, a, b, c, d, e)
+#else
+#define PROBE0(name) do {} while (0)
+#define PROBE1(name, a) do {} while (0)
+#define PROBE2(name, a, b) do {} while (0)
+#define PROBE3(name, a, b, c) do {} while (0)
+#define PROBE4(name, a, b, c, d) do {} while (0)
+#define PROBE5(name, a, b, c, d, e) do {} while (0)
+#endif
+
+#endif /* PROBES_H_ */
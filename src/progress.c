@@ -0,0 +1,223 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Progress reports. The copy loops hand over every block they deal with,
+ * the ones read apart from the ones skipped, left out or padded; a line is
+ * written at most progress_rate times a second, going by the monotonic
+ * clock, and once at the end of each file. Throughput and the estimated
+ * time left are worked out over the whole job, from the blocks read only.
+ *
+ * With --progress-fd the same reports, and the start and end of the job and
+ * of each file and every padded extent, also go out as newline-delimited
+ * JSON through the logging thread.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+/* C standard libraries */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* libdvdread */
+#include <dvdread/dvd_reader.h>
+
+/* internationalisation */
+#include "gettext.h"
+#define _(String) gettext(String)
+
+#include "dvdbackup.h"
+#include "dvdlogger.h"
+#include "progress.h"
+
+/* logical blocks per MiB */
+#define BLOCKS_PER_MIB 512.0
+
+/* shortest interval the current throughput is measured over, in seconds */
+#define MIN_INTERVAL 0.05
+
+/* Progress updates per second */
+double progress_rate = 4.0;
+
+/* Descriptor for JSON events, -1 for none */
+int progress_fd = -1;
+
+static struct {
+	long long total;		/* blocks the job will go through */
+	long long done;			/* read, skipped or padded */
+	long long read;			/* read off the disc */
+	int started;
+	struct timespec start;
+	double next;			/* seconds since start */
+	double last;
+	long long last_read;
+	double current;			/* MiB/s */
+	int announced;			/* job_start event sent */
+	char file[64];			/* JSON string of the current file */
+	int file_total;
+} job;
+
+/* Quote s as a JSON string into buf. */
+static void json_string(char *buf, size_t size, const char *s) {
+	size_t n = 0;
+
+	if (size < 3) {
+		return;
+	}
+	buf[n++] = '"';
+	for (; *s && n + 8 < size; s++) {
+		if (*s == '"' || *s == '\\') {
+			buf[n++] = '\\';
+			buf[n++] = *s;
+		} else if ((unsigned char)*s < 0x20) {
+			n += snprintf(buf + n, size - n, "\\u%04x", (unsigned char)*s);
+		} else {
+			buf[n++] = *s;
+		}
+	}
+	buf[n++] = '"';
+	buf[n] = '\0';
+}
+
+static double seconds_since(const struct timespec *start) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void job_start(void) {
+	if (!job.started) {
+		clock_gettime(CLOCK_MONOTONIC, &job.start);
+		job.started = 1;
+		strcpy(job.file, "null");
+	}
+}
+
+/* Announce blocks the job is going to copy, so the estimate covers all of
+ * it rather than the file at hand. */
+void progress_job_add(long long blocks) {
+	job_start();
+	job.total += blocks;
+}
+
+static void job_announce(void) {
+	char device[256], disc[80];
+	struct timespec now;
+
+	if (job.announced) {
+		return;
+	}
+	job.announced = 1;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	json_string(device, sizeof(device), pApp->dev_path ? pApp->dev_path : "");
+	json_string(disc, sizeof(disc), pApp->title_name ? pApp->title_name : "");
+	DVDLogEvent(DVD_LOGGER_LEVEL_INFO, "{\"event\":\"job_start\",\"time\":%ld.%03ld,\"device\":%s,\"disc\":%s,\"bytes\":%lld}",
+			(long)now.tv_sec, now.tv_nsec / 1000000L, device, disc, job.total * DVD_VIDEO_LB_LEN);
+}
+
+/* A file of the given size in blocks is about to be copied. */
+void progress_file_start(const char *name, int blocks) {
+	job_start();
+	job_announce();
+
+	json_string(job.file, sizeof(job.file), name);
+	job.file_total = blocks;
+	DVDLogEvent(DVD_LOGGER_LEVEL_INFO, "{\"event\":\"file_start\",\"t\":%.3f,\"file\":%s,\"bytes\":%lld}",
+			seconds_since(&job.start), job.file, (long long)blocks * DVD_VIDEO_LB_LEN);
+}
+
+/* Blocks could not be read and were padded or left out. */
+void progress_error(int offset, int blocks, const char *action) {
+	DVDLogEvent(DVD_LOGGER_LEVEL_ERROR, "{\"event\":\"error\",\"t\":%.3f,\"file\":%s,\"sector\":%d,\"sectors\":%d,\"action\":\"%s\"}",
+			seconds_since(&job.start), job.file, offset, blocks, action);
+}
+
+/* deferred blocks of the file were left for the end of the job */
+void progress_file_done(int ok, int deferred) {
+	DVDLogEvent(DVD_LOGGER_LEVEL_INFO, "{\"event\":\"file_done\",\"t\":%.3f,\"file\":%s,\"ok\":%s,\"bytes_deferred\":%lld}",
+			seconds_since(&job.start), job.file, ok ? "true" : "false", (long long)deferred * DVD_VIDEO_LB_LEN);
+}
+
+void progress_job_done(int ok) {
+	double now;
+
+	/* also when the job fails before it copied anything */
+	job_start();
+	job_announce();
+
+	now = seconds_since(&job.start);
+	DVDLogEvent(DVD_LOGGER_LEVEL_INFO, "{\"event\":\"job_done\",\"t\":%.3f,\"ok\":%s,\"bytes_done\":%lld,\"bytes_read\":%lld,\"avg_rate\":%.0f}",
+			now, ok ? "true" : "false", job.done * DVD_VIDEO_LB_LEN, job.read * DVD_VIDEO_LB_LEN,
+			now > 0 ? job.read * DVD_VIDEO_LB_LEN / now : 0.0);
+}
+
+/* Account for blocks the copy loop has dealt with, read of them read off
+ * the disc and passed skipped, left out or padded, and report if it is time
+ * to; file_done and file_total give the position in the current file. */
+void progress_update(const char *what, int file_done, int file_total, int read, int passed) {
+	double now, average;
+	long left;
+
+	job_start();
+	job.done += read + passed;
+	job.read += read;
+
+	now = seconds_since(&job.start);
+	if (now < job.next && file_done < file_total) {
+		return;
+	}
+	job.next = now + 1.0 / progress_rate;
+
+	if (now - job.last >= MIN_INTERVAL) {
+		job.current = (job.read - job.last_read) / BLOCKS_PER_MIB / (now - job.last);
+		job.last = now;
+		job.last_read = job.read;
+	}
+	average = now > 0 ? job.read / BLOCKS_PER_MIB / now : 0;
+	if (job.last_read == 0) {
+		/* too early to tell */
+		job.current = average;
+	}
+
+	left = job.total >= job.done && average > 0 ? (long)((job.total - job.done) / BLOCKS_PER_MIB / average) : -1;
+
+	DVDLogEvent(DVDBACKUP_LOGGER_LEVEL_PROGRESS, "{\"event\":\"progress\",\"t\":%.3f,\"file\":%s,"
+			"\"file_bytes_done\":%lld,\"file_bytes\":%lld,\"bytes_done\":%lld,\"bytes\":%lld,"
+			"\"bytes_read\":%lld,\"bytes_skipped\":%lld,"
+			"\"sectors_done\":%lld,\"rate\":%.0f,\"avg_rate\":%.0f,\"eta\":%ld}",
+			now, job.file, (long long)file_done * DVD_VIDEO_LB_LEN, (long long)file_total * DVD_VIDEO_LB_LEN,
+			job.done * DVD_VIDEO_LB_LEN, job.total * DVD_VIDEO_LB_LEN,
+			job.read * DVD_VIDEO_LB_LEN, (job.done - job.read) * DVD_VIDEO_LB_LEN, job.done,
+			job.current * 1048576, average * 1048576, left);
+
+	if (!progress) {
+		return;
+	}
+	if (left >= 0) {
+		XLog5(pApp, _("Copying %s: %.0f%% done (%.0f/%.0f MiB), %.1f MiB/s, average %.1f MiB/s; job %.0f%% done, %ld:%02ld:%02ld left"),
+				what, file_total ? 100.0 * file_done / file_total : 100.0,
+				file_done / BLOCKS_PER_MIB, file_total / BLOCKS_PER_MIB,
+				job.current, average, 100.0 * job.done / job.total,
+				left / 3600, left / 60 % 60, left % 60);
+	} else {
+		XLog5(pApp, _("Copying %s: %.0f%% done (%.0f/%.0f MiB), %.1f MiB/s, average %.1f MiB/s"),
+				what, file_total ? 100.0 * file_done / file_total : 100.0,
+				file_done / BLOCKS_PER_MIB, file_total / BLOCKS_PER_MIB,
+				job.current, average);
+	}
+}
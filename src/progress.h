@@ -0,0 +1,14 @@
+#ifndef PROGRESS_H_
+#define PROGRESS_H_
+
+extern double progress_rate;
+extern int progress_fd;
+
+void progress_job_add(long long blocks);
+void progress_file_start(const char *name, int blocks);
+void progress_update(const char *what, int file_done, int file_total, int read, int passed);
+void progress_error(int offset, int blocks, const char *action);
+void progress_file_done(int ok, int deferred);
+void progress_job_done(int ok);
+
+#endif /* PROGRESS_H_ */
@@ -0,0 +1,238 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Metrics for the node_exporter textfile collector. A thread snapshots the
+ * live statistics (see stats.h) every PROM_INTERVAL seconds and replaces the
+ * file given with --prom-file by writing a temporary file next to it and
+ * renaming it, so the collector never sees half a file.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+/* C standard libraries */
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* POSIX */
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+
+/* internationalisation */
+#include "gettext.h"
+#define _(String) gettext(String)
+
+#include "dvdbackup.h"
+#include "stats.h"
+#include "prom.h"
+
+/* seconds between rewrites */
+#define PROM_INTERVAL 5
+
+static struct {
+	char path[PATH_MAX];
+	char temp[PATH_MAX + 32];
+	char labels[512];	/* device="...",disc="..." */
+	int running;
+	int stop;
+	int failed;		/* warned about a failed write already */
+	sem_t wakeup;
+	pthread_t thread;
+} prom;
+
+
+/* Append name="value" to the label set in prom.labels, escaped as the
+ * text format wants. The buffer fits the longest device and disc names. */
+static void prom_label(const char *name, const char *value) {
+	char *out = prom.labels + strlen(prom.labels);
+
+	if (out != prom.labels) {
+		*out++ = ',';
+	}
+	out += sprintf(out, "%s=\"", name);
+	for (; *value != '\0'; value++) {
+		if (*value == '\\' || *value == '"') {
+			*out++ = '\\';
+			*out++ = *value;
+		} else if (*value == '\n') {
+			*out++ = '\\';
+			*out++ = 'n';
+		} else {
+			*out++ = *value;
+		}
+	}
+	*out++ = '"';
+	*out = '\0';
+}
+
+static void prom_counter(FILE *out, const char *name, const char *help, uint64_t value) {
+	fprintf(out, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+	fprintf(out, "%s{%s} %llu\n", name, prom.labels, (unsigned long long)value);
+}
+
+static void prom_histogram(FILE *out, const char *name, const char *help, const uint64_t *hist, uint64_t sum_us) {
+	uint64_t count = 0;
+	int i;
+
+	fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+	for (i = 0; i < STATS_NR_OF_BUCKETS; i++) {
+		/* stats keeps plain counts, Prometheus wants them cumulative */
+		count += hist[i];
+		if (i < STATS_NR_OF_BUCKETS - 1) {
+			fprintf(out, "%s_bucket{%s,le=\"%g\"} %llu\n", name, prom.labels,
+				stats_bucket_us[i] / 1e6, (unsigned long long)count);
+		} else {
+			fprintf(out, "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, prom.labels,
+				(unsigned long long)count);
+		}
+	}
+	fprintf(out, "%s_sum{%s} %.6f\n", name, prom.labels, sum_us / 1e6);
+	fprintf(out, "%s_count{%s} %llu\n", name, prom.labels, (unsigned long long)count);
+}
+
+/* Replace the file; returns 0 or an errno value. */
+static int prom_write(void) {
+	static const char *states[] = { "starting", "copying", "done", "failed" };
+	dvdbackup_stats_t s;
+	FILE *out;
+	int error;
+	int i;
+
+	stats_snapshot(&s);
+
+	/* the disc name is only known once the device is open */
+	s.device[sizeof(s.device) - 1] = '\0';
+	s.disc[sizeof(s.disc) - 1] = '\0';
+	prom.labels[0] = '\0';
+	prom_label("device", s.device);
+	prom_label("disc", s.disc);
+
+	out = fopen(prom.temp, "w");
+	if (out == NULL) {
+		return errno;
+	}
+
+	prom_counter(out, "dvdbackup_read_bytes_total", "Bytes read from the DVD.", s.bytes_read);
+	prom_counter(out, "dvdbackup_written_bytes_total", "Bytes written to the backup.", s.bytes_written);
+	prom_counter(out, "dvdbackup_read_errors_total", "Failed or short DVDReadBlocks calls.", s.read_errors);
+	prom_counter(out, "dvdbackup_padded_blocks_total", "Unreadable blocks written as zeros.", s.blocks_padded);
+	prom_counter(out, "dvdbackup_skipped_blocks_total", "Blocks left out because nothing refers to them.", s.blocks_skipped);
+	prom_counter(out, "dvdbackup_retries_total", "Reads tried again.", s.retries);
+
+	prom_histogram(out, "dvdbackup_read_seconds", "DVDReadBlocks latency.", s.read_hist, s.read_sum_us);
+	prom_histogram(out, "dvdbackup_write_seconds", "Backup file write latency.", s.write_hist, s.write_sum_us);
+
+	fprintf(out, "# HELP dvdbackup_start_time_seconds When the job started.\n");
+	fprintf(out, "# TYPE dvdbackup_start_time_seconds gauge\n");
+	fprintf(out, "dvdbackup_start_time_seconds{%s} %lld\n", prom.labels, (long long)s.started);
+
+	fprintf(out, "# HELP dvdbackup_state What the job is doing.\n");
+	fprintf(out, "# TYPE dvdbackup_state gauge\n");
+	for (i = 0; i < (int)(sizeof(states) / sizeof(states[0])); i++) {
+		fprintf(out, "dvdbackup_state{%s,state=\"%s\"} %d\n", prom.labels, states[i], s.state == i);
+	}
+
+	if (fflush(out) != 0 || ferror(out)) {
+		error = errno ? errno : EIO;
+		fclose(out);
+		unlink(prom.temp);
+		return error;
+	}
+	if (fclose(out) != 0 || rename(prom.temp, prom.path) != 0) {
+		error = errno;
+		unlink(prom.temp);
+		return error;
+	}
+
+	return 0;
+}
+
+/* Warn once per run of failed writes. Not through XLog: without the
+ * logging thread that writes from the caller's thread, and the main thread
+ * may be logging at the same time; stdio locks the stream for us. */
+static void prom_write_checked(void) {
+	int error = prom_write();
+
+	if (error != 0 && !prom.failed) {
+		fprintf(stderr, _("%s: failed to write %s: %s\n"), PACKAGE, prom.path, strerror(error));
+	}
+	prom.failed = error != 0;
+}
+
+static void* prom_thread(void *arg) {
+	struct timespec deadline;
+
+	(void)arg;
+
+	for (;;) {
+		prom_write_checked();
+		if (__atomic_load_n(&prom.stop, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += PROM_INTERVAL;
+		while (sem_timedwait(&prom.wakeup, &deadline) == -1 && errno == EINTR)
+			;
+	}
+
+	return NULL;
+}
+
+/* Start rewriting path with the current metrics. Returns 0 on success. */
+int prom_start(const char *path) {
+	if (prom.running) {
+		return 0;
+	}
+
+	if (strlen(path) >= sizeof(prom.path)) {
+		errno = ENAMETOOLONG;
+		return 1;
+	}
+	strcpy(prom.path, path);
+	/* the collector only reads *.prom, so it skips this one */
+	snprintf(prom.temp, sizeof(prom.temp), "%s.%d.tmp", path, (int)getpid());
+
+	if (sem_init(&prom.wakeup, 0, 0) != 0) {
+		return 1;
+	}
+	prom.stop = 0;
+	if (pthread_create(&prom.thread, NULL, prom_thread, NULL) != 0) {
+		sem_destroy(&prom.wakeup);
+		return 1;
+	}
+
+	prom.running = 1;
+	atexit(prom_stop);
+	return 0;
+}
+
+/* Write the metrics one last time and stop the thread. */
+void prom_stop(void) {
+	if (!prom.running) {
+		return;
+	}
+
+	__atomic_store_n(&prom.stop, 1, __ATOMIC_RELEASE);
+	sem_post(&prom.wakeup);
+	pthread_join(prom.thread, NULL);
+	sem_destroy(&prom.wakeup);
+	prom.running = 0;
+}
@@ -0,0 +1,7 @@
+#ifndef PROM_H_
+#define PROM_H_
+
+int prom_start(const char *path);
+void prom_stop(void);
+
+#endif /* PROM_H_ */
@@ -0,0 +1,771 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Every VOB read of the copy loops goes through here. Normally that is just
+ * DVDReadBlocks; with --fault-script the reads are checked against a list of
+ * ranges that fail, come back short, fail a few times before they work, or
+ * take longer, so the read error strategies can be tried on an image as if
+ * it were a scratched disc.
+ *
+ * A fault script has one fault per line, # starts a comment:
+ *
+ *   bad   RANGE        reads touching RANGE fail
+ *   short RANGE        reads touching RANGE stop at its first sector
+ *   flaky RANGE N      the first N reads touching RANGE fail
+ *   slow  RANGE MS     reads touching RANGE take MS milliseconds longer
+ *
+ * RANGE is FIRST or FIRST-LAST, in sectors from the start of the disc, or
+ * TS/menu:FIRST[-LAST] and TS/title:FIRST[-LAST] for sectors within the menu
+ * or title VOBs of title set TS (0 for the VMG). Disc sectors need an image
+ * or device; domain sectors work with VIDEO_TS directories too.
+ *
+ * --read-trace writes every read to a binary file: a 16 byte header, then
+ * one TRACE_RECORD_SIZE record per read, little endian,
+ *
+ *   u8 title set, u8 menu, u16 0, u32 offset, u32 blocks asked for,
+ *   i32 blocks returned or -1, u32 microseconds
+ *
+ * and --replay-trace plays such a trace back against an image of the same
+ * disc. A read that the trace has, at the same place and size, gets the
+ * result and the time the drive took then. Any other read, because the
+ * strategy or the buffer size changed, is answered from what the trace tells
+ * about each sector: sectors that were never read fail, sectors that failed
+ * before they were read fail as often, and the time is what the drive took
+ * per sector there.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+/* C standard libraries */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* libdvdread */
+#include <dvdread/dvd_reader.h>
+#include <dvdread/dvd_udf.h>
+
+/* internationalisation */
+#include "gettext.h"
+#define _(String) gettext(String)
+
+#include "dvdbackup.h"
+#include "dvdlogger.h"
+#include "probes.h"
+#include "reader.h"
+
+/* VOB files open at the same time; dvdbackup uses one or two */
+#define READER_MAX_FILES 8
+
+#define TRACE_MAGIC "DVDBKTRC"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_SIZE 16
+#define TRACE_RECORD_SIZE 20
+
+/* how far ahead in a domain's trace a read is looked for */
+#define REPLAY_WINDOW 64
+
+/* title sets times menu and title VOBs */
+#define READER_NR_OF_DOMAINS (100 * 2)
+
+typedef enum {
+	FAULT_BAD,
+	FAULT_SHORT,
+	FAULT_FLAKY,
+	FAULT_SLOW,
+	FAULT_NR_OF_KINDS
+} fault_kind_t;
+
+static const char *fault_names[FAULT_NR_OF_KINDS] = { "bad", "short", "flaky", "slow" };
+
+typedef struct {
+	fault_kind_t kind;
+	int title_set;		/* -1 for disc sectors */
+	int menu;
+	long long first;
+	long long last;
+	long arg;		/* failures left for flaky, milliseconds for slow */
+} fault_t;
+
+static fault_t *faults = NULL;
+static int nr_of_faults = 0;
+
+/* reads each kind of fault has hit */
+static long long injected[FAULT_NR_OF_KINDS];
+
+static struct {
+	dvd_file_t *file;
+	int title_set;
+	int menu;
+	long long start;	/* disc sector of the domain, -1 if unknown */
+} files[READER_MAX_FILES];
+
+/* warned that disc sectors cannot be placed */
+static int no_disc_sectors = 0;
+
+/* what a read will do, worked out before it is made */
+typedef struct {
+	size_t allowed;		/* blocks to read */
+	int failed;
+	long extra_us;		/* on top of the read */
+	long target_us;		/* the whole read should take this long, or -1 */
+} read_plan_t;
+
+typedef struct {
+	uint8_t title_set;
+	uint8_t menu;
+	uint32_t offset;
+	uint32_t count;
+	int32_t result;
+	uint32_t us;
+} trace_record_t;
+
+static FILE *trace = NULL;
+static char *trace_name = NULL;
+
+/* one domain of a replayed trace */
+typedef struct {
+	trace_record_t **records;	/* in the order they were read */
+	int nr_of_records;
+	int cursor;
+	uint32_t nr_of_sectors;
+	uint8_t *good;		/* read at least once */
+	uint8_t *fails;		/* failed reads of it before it was read */
+	float *us;		/* time per sector when read */
+	double fail_us;		/* mean time of a failed read */
+} replay_domain_t;
+
+static trace_record_t *replay = NULL;
+static int nr_of_replay = 0;
+static replay_domain_t *replay_domains[READER_NR_OF_DOMAINS];
+
+/* reads answered by the trace, exactly or from the sectors */
+static long long replayed_exact = 0;
+static long long replayed_model = 0;
+
+
+/* Parse [TS/menu:|TS/title:]FIRST[-LAST]; returns 0 on success. */
+static int reader_parse_range(const char *word, fault_t *fault) {
+	char domain[8];
+	int n = 0;
+
+	fault->title_set = -1;
+	fault->menu = 0;
+	if (sscanf(word, "%d/%7[a-z]:%n", &fault->title_set, domain, &n) == 2 && n > 0) {
+		if (strcmp(domain, "menu") == 0) {
+			fault->menu = 1;
+		} else if (strcmp(domain, "title") != 0) {
+			return 1;
+		}
+		if (fault->title_set < 0 || fault->title_set > 99) {
+			return 1;
+		}
+		word += n;
+	} else {
+		fault->title_set = -1;
+	}
+
+	n = 0;
+	if (sscanf(word, "%lld-%lld%n", &fault->first, &fault->last, &n) == 2 && word[n] == '\0') {
+		return fault->first < 0 || fault->last < fault->first;
+	}
+	n = 0;
+	if (sscanf(word, "%lld%n", &fault->first, &n) == 1 && word[n] == '\0') {
+		fault->last = fault->first;
+		return fault->first < 0;
+	}
+	return 1;
+}
+
+
+#define BLANKS " \t\r\n"
+
+/* Copy the word at the start of *p, after any blanks, to word and move *p
+ * past it. Returns 0 on success, 1 at the end of the line or if the word
+ * does not fit. */
+static int reader_next_word(const char **p, char *word, size_t size) {
+	size_t length;
+
+	*p += strspn(*p, BLANKS);
+	length = strcspn(*p, BLANKS);
+	if (length == 0 || length >= size) {
+		return 1;
+	}
+	memcpy(word, *p, length);
+	word[length] = '\0';
+	*p += length;
+	return 0;
+}
+
+
+/* Read the fault script; returns 0 on success. Errors are printed. */
+int reader_load_faults(const char *filename) {
+	FILE *stream;
+	char line[256];
+	char kind[16];
+	char range[64];
+	const char *p;
+	fault_t fault;
+	fault_t *more;
+	int line_nr = 0;
+	int whole;
+	int bad;
+	int c;
+	int n;
+	int i;
+
+	if ((stream = fopen(filename, "r")) == NULL) {
+		fprintf(stderr, _("Cannot open fault script %s: %s\n"), filename, strerror(errno));
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), stream) != NULL) {
+		line_nr++;
+		/* a line too long for the buffer is only all there if the rest
+		 * of it is a comment */
+		whole = strchr(line, '\n') != NULL || feof(stream);
+		if (!whole) {
+			while ((c = getc(stream)) != '\n' && c != EOF)
+				;
+		}
+		if (strchr(line, '#') != NULL) {
+			*strchr(line, '#') = '\0';
+			whole = 1;
+		}
+
+		p = line;
+		if (line[strspn(line, BLANKS)] == '\0') {
+			continue;
+		}
+
+		/* KIND RANGE [ARG], and nothing after that */
+		memset(&fault, 0, sizeof(fault));
+		bad = reader_next_word(&p, kind, sizeof(kind)) != 0
+			|| reader_next_word(&p, range, sizeof(range)) != 0;
+		if (!bad) {
+			for (i = 0; i < FAULT_NR_OF_KINDS; i++) {
+				if (strcmp(kind, fault_names[i]) == 0) {
+					break;
+				}
+			}
+			fault.kind = i;
+			bad = i == FAULT_NR_OF_KINDS || reader_parse_range(range, &fault) != 0;
+		}
+		if (!bad && (fault.kind == FAULT_FLAKY || fault.kind == FAULT_SLOW)) {
+			n = 0;
+			bad = sscanf(p, "%ld%n", &fault.arg, &n) != 1 || fault.arg < 0;
+			p += n;
+		}
+		if (bad || !whole || p[strspn(p, BLANKS)] != '\0') {
+			fprintf(stderr, _("%s:%d: cannot parse fault\n"), filename, line_nr);
+			fclose(stream);
+			return 1;
+		}
+
+		if ((more = realloc(faults, (nr_of_faults + 1) * sizeof(fault_t))) == NULL) {
+			fprintf(stderr, _("Out of memory reading %s\n"), filename);
+			fclose(stream);
+			return 1;
+		}
+		faults = more;
+		faults[nr_of_faults++] = fault;
+	}
+
+	fclose(stream);
+	return 0;
+}
+
+
+static void put_le32(unsigned char *p, uint32_t v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint32_t get_le32(const unsigned char *p) {
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+/* Start writing every read to filename; returns 0 on success. */
+int reader_start_trace(const char *filename) {
+	unsigned char header[TRACE_HEADER_SIZE];
+
+	if ((trace = fopen(filename, "wb")) == NULL) {
+		fprintf(stderr, _("Cannot create %s: %s\n"), filename, strerror(errno));
+		return 1;
+	}
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, TRACE_MAGIC, 8);
+	put_le32(header + 8, TRACE_VERSION);
+	put_le32(header + 12, TRACE_RECORD_SIZE);
+	if (fwrite(header, sizeof(header), 1, trace) != 1) {
+		fprintf(stderr, _("Error writing %s\n"), filename);
+		fclose(trace);
+		trace = NULL;
+		return 1;
+	}
+
+	trace_name = strdup(filename);
+	return 0;
+}
+
+
+static void reader_trace(int title_set, int menu, int offset, size_t count, ssize_t result, long us) {
+	unsigned char record[TRACE_RECORD_SIZE];
+
+	memset(record, 0, sizeof(record));
+	record[0] = title_set;
+	record[1] = menu;
+	put_le32(record + 4, offset);
+	put_le32(record + 8, count);
+	put_le32(record + 12, (uint32_t)(int32_t)result);
+	put_le32(record + 16, us);
+
+	if (fwrite(record, sizeof(record), 1, trace) != 1) {
+		XLog0(pApp, _("Error writing %s; no more reads are traced"), trace_name);
+		fclose(trace);
+		trace = NULL;
+	}
+}
+
+
+static replay_domain_t* replay_domain(int title_set, int menu) {
+	if (title_set < 0 || title_set >= READER_NR_OF_DOMAINS / 2) {
+		return NULL;
+	}
+	return replay_domains[title_set * 2 + menu];
+}
+
+
+/* Work out what the trace says about each sector of d. */
+static int replay_model(replay_domain_t *d) {
+	trace_record_t *r;
+	uint32_t end = 0;
+	uint32_t s, first_bad;
+	int fails = 0;
+	double fail_us = 0;
+	int i;
+
+	for (i = 0; i < d->nr_of_records; i++) {
+		r = d->records[i];
+		if (r->offset + r->count > end) {
+			end = r->offset + r->count;
+		}
+	}
+
+	d->nr_of_sectors = end;
+	d->good = calloc(end + 1, 1);
+	d->fails = calloc(end + 1, 1);
+	d->us = calloc(end + 1, sizeof(float));
+	if (d->good == NULL || d->fails == NULL || d->us == NULL) {
+		return 1;
+	}
+
+	/* what was read at all, and how fast */
+	for (i = 0; i < d->nr_of_records; i++) {
+		r = d->records[i];
+		if (r->result > 0) {
+			for (s = r->offset; s < r->offset + (uint32_t)r->result; s++) {
+				d->good[s] = 1;
+				d->us[s] = (float)r->us / r->result;
+			}
+		} else {
+			fail_us += r->us;
+			fails++;
+		}
+	}
+	d->fail_us = fails > 0 ? fail_us / fails : 0;
+
+	/* failed reads of sectors that were read later were intermittent; the
+	 * rest never read and stay bad */
+	for (i = 0; i < d->nr_of_records; i++) {
+		r = d->records[i];
+		if (r->result >= (int32_t)r->count) {
+			continue;
+		}
+		first_bad = r->offset + (r->result > 0 ? r->result : 0);
+		for (s = first_bad; s < r->offset + r->count && d->good[s]; s++)
+			;
+		if (s < r->offset + r->count) {
+			continue;
+		}
+		for (s = first_bad; s < r->offset + r->count; s++) {
+			if (d->fails[s] < UINT8_MAX) {
+				d->fails[s]++;
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+/* Read a trace to replay; returns 0 on success. Errors are printed. */
+int reader_load_replay(const char *filename) {
+	FILE *stream;
+	unsigned char header[TRACE_HEADER_SIZE];
+	unsigned char record[TRACE_RECORD_SIZE];
+	trace_record_t *more;
+	replay_domain_t *d;
+	trace_record_t **records;
+	int i, index;
+
+	if ((stream = fopen(filename, "rb")) == NULL) {
+		fprintf(stderr, _("Cannot open trace %s: %s\n"), filename, strerror(errno));
+		return 1;
+	}
+
+	if (fread(header, sizeof(header), 1, stream) != 1 || memcmp(header, TRACE_MAGIC, 8) != 0
+			|| get_le32(header + 8) != TRACE_VERSION || get_le32(header + 12) != TRACE_RECORD_SIZE) {
+		fprintf(stderr, _("%s is not a dvdbackup read trace\n"), filename);
+		fclose(stream);
+		return 1;
+	}
+
+	while (fread(record, sizeof(record), 1, stream) == 1) {
+		if (nr_of_replay % 1024 == 0) {
+			if ((more = realloc(replay, (nr_of_replay + 1024) * sizeof(trace_record_t))) == NULL) {
+				fprintf(stderr, _("Out of memory reading %s\n"), filename);
+				fclose(stream);
+				return 1;
+			}
+			replay = more;
+		}
+		replay[nr_of_replay].title_set = record[0];
+		replay[nr_of_replay].menu = record[1] != 0;
+		replay[nr_of_replay].offset = get_le32(record + 4);
+		replay[nr_of_replay].count = get_le32(record + 8);
+		replay[nr_of_replay].result = (int32_t)get_le32(record + 12);
+		replay[nr_of_replay].us = get_le32(record + 16);
+		if (replay[nr_of_replay].title_set >= READER_NR_OF_DOMAINS / 2
+				|| replay[nr_of_replay].result > (int32_t)replay[nr_of_replay].count) {
+			fprintf(stderr, _("%s: record %d is damaged\n"), filename, nr_of_replay + 1);
+			fclose(stream);
+			return 1;
+		}
+		nr_of_replay++;
+	}
+	fclose(stream);
+
+	/* sort the records by domain, keeping their order */
+	for (i = 0; i < nr_of_replay; i++) {
+		index = replay[i].title_set * 2 + replay[i].menu;
+		if ((d = replay_domains[index]) == NULL) {
+			if ((d = calloc(1, sizeof(replay_domain_t))) == NULL) {
+				fprintf(stderr, _("Out of memory reading %s\n"), filename);
+				return 1;
+			}
+			replay_domains[index] = d;
+		}
+		if ((records = realloc(d->records, (d->nr_of_records + 1) * sizeof(trace_record_t *))) == NULL) {
+			fprintf(stderr, _("Out of memory reading %s\n"), filename);
+			return 1;
+		}
+		d->records = records;
+		d->records[d->nr_of_records++] = &replay[i];
+	}
+
+	for (i = 0; i < READER_NR_OF_DOMAINS; i++) {
+		if (replay_domains[i] != NULL && replay_model(replay_domains[i]) != 0) {
+			fprintf(stderr, _("Out of memory reading %s\n"), filename);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/* DVDOpenFile for a VOB domain, remembering where on the disc it is. */
+dvd_file_t* reader_open_file(dvd_reader_t *dvd, int title_set, dvd_read_domain_t domain) {
+	dvd_file_t *dvd_file;
+	char filename[32];
+	uint32_t size;
+	uint32_t start = 0;
+	int i;
+
+	dvd_file = DVDOpenFile(dvd, title_set, domain);
+	if (dvd_file == NULL || (nr_of_faults == 0 && trace == NULL && replay == NULL)) {
+		return dvd_file;
+	}
+
+	for (i = 0; i < READER_MAX_FILES && files[i].file != NULL; i++)
+		;
+	if (i == READER_MAX_FILES) {
+		XLog1(pApp, _("Too many open VOB files; reads of title set %d are passed through"), title_set);
+		return dvd_file;
+	}
+
+	if (nr_of_faults > 0) {
+		if (title_set == 0) {
+			strcpy(filename, "/VIDEO_TS/VIDEO_TS.VOB");
+		} else {
+			snprintf(filename, sizeof(filename), "/VIDEO_TS/VTS_%02d_%d.VOB",
+					title_set, domain == DVD_READ_MENU_VOBS ? 0 : 1);
+		}
+		start = UDFFindFile(dvd, filename, &size);
+		if (start == 0 && !no_disc_sectors) {
+			XLog1(pApp, _("Cannot find %s on the disc; faults given in disc sectors are not injected"), filename);
+			no_disc_sectors = 1;
+		}
+	}
+
+	files[i].file = dvd_file;
+	files[i].title_set = title_set;
+	files[i].menu = domain == DVD_READ_MENU_VOBS;
+	files[i].start = start == 0 ? -1 : (long long)start;
+
+	return dvd_file;
+}
+
+
+static void reader_apply_faults(int file, int offset, size_t count, read_plan_t *plan) {
+	long long first, last;
+	int f;
+
+	for (f = 0; f < nr_of_faults; f++) {
+		fault_t *fault = &faults[f];
+
+		if (fault->title_set < 0) {
+			if (files[file].start < 0) {
+				continue;
+			}
+			first = files[file].start + offset;
+		} else if (fault->title_set == files[file].title_set && fault->menu == files[file].menu) {
+			first = offset;
+		} else {
+			continue;
+		}
+		last = first + (long long)count - 1;
+		if (last < fault->first || first > fault->last) {
+			continue;
+		}
+
+		switch (fault->kind) {
+		case FAULT_BAD:
+			plan->failed = 1;
+			break;
+		case FAULT_SHORT:
+			if (fault->first <= first) {
+				plan->allowed = 0;
+			} else if ((size_t)(fault->first - first) < plan->allowed) {
+				plan->allowed = fault->first - first;
+			}
+			break;
+		case FAULT_FLAKY:
+			if (fault->arg == 0) {
+				continue;
+			}
+			fault->arg--;
+			plan->failed = 1;
+			break;
+		case FAULT_SLOW:
+			plan->extra_us += fault->arg * 1000L;
+			break;
+		default:
+			break;
+		}
+
+		injected[fault->kind]++;
+		PROBE3(fault, fault_names[fault->kind], offset, count);
+		XLog3(pApp, _("Injecting %s fault into a read of %zu blocks at block %d"),
+				fault_names[fault->kind], count, offset);
+	}
+}
+
+
+static void reader_apply_replay(int file, int offset, size_t count, read_plan_t *plan) {
+	replay_domain_t *d = replay_domain(files[file].title_set, files[file].menu);
+	trace_record_t *r;
+	double us = 0;
+	uint32_t s, end = offset + count;
+	int i;
+
+	if (d == NULL) {
+		/* never read when the trace was taken */
+		plan->failed = 1;
+		replayed_model++;
+		return;
+	}
+
+	/* the same read as then */
+	for (i = d->cursor; i < d->nr_of_records && i < d->cursor + REPLAY_WINDOW; i++) {
+		r = d->records[i];
+		if (r->offset == (uint32_t)offset && r->count == count) {
+			d->cursor = i + 1;
+			if (r->result < 0) {
+				plan->failed = 1;
+			} else if ((size_t)r->result < plan->allowed) {
+				plan->allowed = r->result;
+			}
+			plan->target_us = r->us;
+			replayed_exact++;
+			return;
+		}
+	}
+
+	/* a different read; answer it sector by sector */
+	for (s = offset; s < end; s++) {
+		if (s >= d->nr_of_sectors || !d->good[s]) {
+			plan->failed = 1;
+			break;
+		}
+		if (d->fails[s] > 0) {
+			plan->failed = 1;
+		}
+		us += d->us[s];
+	}
+	if (plan->failed) {
+		/* an intermittent sector fails once less next time */
+		for (s = offset; s < end && s < d->nr_of_sectors; s++) {
+			if (d->good[s] && d->fails[s] > 0) {
+				d->fails[s]--;
+			}
+		}
+		us = d->fail_us;
+	}
+	plan->target_us = us;
+	replayed_model++;
+}
+
+
+static long reader_elapsed_us(const struct timespec *start) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000L + (now.tv_nsec - start->tv_nsec) / 1000L;
+}
+
+
+/* DVDReadBlocks, with the faults or trace that cover the read applied, and
+ * written to the trace being taken. */
+ssize_t reader_read_blocks(dvd_file_t *dvd_file, int offset, size_t count, unsigned char *buffer) {
+	read_plan_t plan = { count, 0, 0, -1 };
+	struct timespec start, delay;
+	ssize_t result;
+	long wait_us;
+	int i;
+
+	if (nr_of_faults == 0 && trace == NULL && replay == NULL) {
+		return DVDReadBlocks(dvd_file, offset, count, buffer);
+	}
+
+	for (i = 0; i < READER_MAX_FILES && files[i].file != dvd_file; i++)
+		;
+	if (i == READER_MAX_FILES) {
+		return DVDReadBlocks(dvd_file, offset, count, buffer);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	if (replay != NULL) {
+		reader_apply_replay(i, offset, count, &plan);
+	}
+	if (nr_of_faults > 0) {
+		reader_apply_faults(i, offset, count, &plan);
+	}
+
+	if (plan.failed) {
+		result = -1;
+	} else if (plan.allowed == 0) {
+		result = 0;
+	} else {
+		result = DVDReadBlocks(dvd_file, offset, plan.allowed, buffer);
+	}
+
+	/* take as long as the trace says, plus what the faults add */
+	wait_us = plan.extra_us;
+	if (plan.target_us >= 0) {
+		wait_us += plan.target_us - reader_elapsed_us(&start);
+	}
+	if (wait_us > 0) {
+		delay.tv_sec = wait_us / 1000000L;
+		delay.tv_nsec = wait_us % 1000000L * 1000L;
+		while (nanosleep(&delay, &delay) == -1 && errno == EINTR)
+			;
+	}
+
+	if (trace != NULL) {
+		reader_trace(files[i].title_set, files[i].menu, offset, count, result, reader_elapsed_us(&start));
+	}
+
+	return result;
+}
+
+
+void reader_close_file(dvd_file_t *dvd_file) {
+	int i;
+
+	for (i = 0; i < READER_MAX_FILES; i++) {
+		if (files[i].file == dvd_file) {
+			files[i].file = NULL;
+		}
+	}
+	if (trace != NULL) {
+		fflush(trace);
+	}
+
+	DVDCloseFile(dvd_file);
+}
+
+
+/* Say what was injected and replayed, finish the trace and forget it all. */
+void reader_free(void) {
+	replay_domain_t *d;
+	int i;
+
+	if (nr_of_faults > 0) {
+		XLog2(pApp, _("Injected faults: %lld failed, %lld short, %lld flaky and %lld slow reads"),
+				injected[FAULT_BAD], injected[FAULT_SHORT], injected[FAULT_FLAKY], injected[FAULT_SLOW]);
+	}
+	if (replay != NULL) {
+		XLog2(pApp, _("Replayed %lld reads as traced and %lld from the traced sectors"),
+				replayed_exact, replayed_model);
+	}
+	if (trace != NULL && fclose(trace) != 0) {
+		XLog0(pApp, _("Error writing %s"), trace_name);
+	}
+	trace = NULL;
+	free(trace_name);
+	trace_name = NULL;
+
+	for (i = 0; i < READER_NR_OF_DOMAINS; i++) {
+		if ((d = replay_domains[i]) != NULL) {
+			free(d->records);
+			free(d->good);
+			free(d->fails);
+			free(d->us);
+			free(d);
+			replay_domains[i] = NULL;
+		}
+	}
+	free(replay);
+	replay = NULL;
+	nr_of_replay = 0;
+	replayed_exact = 0;
+	replayed_model = 0;
+
+	free(faults);
+	faults = NULL;
+	nr_of_faults = 0;
+	memset(injected, 0, sizeof(injected));
+}
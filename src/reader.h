@@ -0,0 +1,16 @@
+#ifndef READER_H_
+#define READER_H_
+
+#include <sys/types.h>
+
+#include <dvdread/dvd_reader.h>
+
+int reader_load_faults(const char *filename);
+int reader_start_trace(const char *filename);
+int reader_load_replay(const char *filename);
+dvd_file_t* reader_open_file(dvd_reader_t *dvd, int title_set, dvd_read_domain_t domain);
+ssize_t reader_read_blocks(dvd_file_t *dvd_file, int offset, size_t count, unsigned char *buffer);
+void reader_close_file(dvd_file_t *dvd_file);
+void reader_free(void);
+
+#endif /* READER_H_ */
@@ -0,0 +1,464 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Sector coverage and waste report. For every domain that is copied the
+ * sectors referenced by any PGC are compared with what the copy loop actually
+ * did with them, broken down per VOB file and per title.
+ *
+ * Two sets of sectors count as in use. "Referenced" is the union of the
+ * cells of every PGC of the domain, whether or not anything can reach the
+ * PGC, and is what --compact keeps. "Reachable" is what the VM simulation
+ * of -r u can play, which is what -r u keeps; it is at most the referenced
+ * set.
+ * "Unused" is what is not referenced. A title covers the sectors from its
+ * first cell to its last, so its unused sectors are the gaps between them.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+/* C standard libraries */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* libdvdread */
+#include <dvdread/dvd_reader.h>
+#include <dvdread/ifo_read.h>
+
+/* internationalisation */
+#include "gettext.h"
+#define _(String) gettext(String)
+
+#include "dvdbackup.h"
+#include "dvdlogger.h"
+#include "find-sector.h"
+#include "sector-bitmap.h"
+#include "report.h"
+
+#define MAX_TITLE_SETS 100
+#define MAX_VOB_PARTS 9
+
+/* Flag for report mode */
+int report = 0;
+
+typedef struct {
+	int title;
+	/* the sectors from the title's first cell to its last */
+	int first;
+	int last;
+	sector_bitmap *referenced;
+} report_title_t;
+
+typedef struct {
+	int title_set;
+	dvd_read_domain_t domain;
+	int nr_of_parts;
+	int part_size[MAX_VOB_PARTS];
+	sector_bitmap *referenced;
+	sector_bitmap *reachable;
+	sector_bitmap *copied;
+	sector_bitmap *padded;
+	sector_bitmap *skipped;
+	int nr_of_titles;
+	report_title_t *titles;
+} report_domain_t;
+
+typedef struct {
+	long long sectors;
+	long long referenced;
+	long long reachable;
+	long long copied;
+	long long padded;
+	long long skipped;
+} report_counts_t;
+
+/* [title set][0 = menu VOB, 1 = title VOBs] */
+static report_domain_t *domains[MAX_TITLE_SETS][2];
+
+
+static int domain_index(dvd_read_domain_t domain) {
+	return domain == DVD_READ_MENU_VOBS ? 0 : 1;
+}
+
+
+static void report_free_domain(report_domain_t *d) {
+	int i;
+
+	if (d == NULL) {
+		return;
+	}
+
+	sector_bitmap_free(d->referenced);
+	sector_bitmap_free(d->reachable);
+	sector_bitmap_free(d->copied);
+	sector_bitmap_free(d->padded);
+	sector_bitmap_free(d->skipped);
+	for (i = 0; i < d->nr_of_titles; i++) {
+		sector_bitmap_free(d->titles[i].referenced);
+	}
+	free(d->titles);
+	free(d);
+}
+
+
+static void report_open_titles(dvd_reader_t *dvd, report_domain_t *d, int nr_of_sectors) {
+	ifo_handle_t *vmg_ifo, *vts_ifo;
+	GSList *range_list, *l;
+	report_title_t *t;
+	int i;
+
+	vmg_ifo = ifoOpen(dvd, 0);
+	if (vmg_ifo == NULL) {
+		return;
+	}
+	vts_ifo = ifoOpen(dvd, d->title_set);
+	if (vts_ifo == NULL) {
+		ifoClose(vmg_ifo);
+		return;
+	}
+
+	d->titles = calloc(vmg_ifo->tt_srpt->nr_of_srpts, sizeof(report_title_t));
+	if (d->titles != NULL) {
+		for (i = 0; i < vmg_ifo->tt_srpt->nr_of_srpts; i++) {
+			if (vmg_ifo->tt_srpt->title[i].title_set_nr != d->title_set) {
+				continue;
+			}
+
+			range_list = NULL;
+			create_title_range_list(vts_ifo, vmg_ifo->tt_srpt->title[i].vts_ttn, &range_list);
+			t = &d->titles[d->nr_of_titles];
+			t->title = i + 1;
+			t->first = nr_of_sectors;
+			t->last = -1;
+			for (l = range_list; l != NULL; l = l->next) {
+				sector_range *range = l->data;
+				if (range->start < t->first) {
+					t->first = range->start;
+				}
+				if (range->end > t->last) {
+					t->last = range->end;
+				}
+			}
+			if (t->last >= nr_of_sectors) {
+				t->last = nr_of_sectors - 1;
+			}
+			t->referenced = sector_bitmap_new(nr_of_sectors);
+			if (t->referenced != NULL) {
+				sector_bitmap_add_range_list(t->referenced, range_list);
+				d->nr_of_titles++;
+			}
+			free_sector_range_list(range_list);
+		}
+	}
+
+	ifoClose(vts_ifo);
+	ifoClose(vmg_ifo);
+}
+
+
+/* Start collecting coverage for a domain; repeated calls for the same domain
+ * (e.g. one per VOB part) are no-ops. */
+void report_open_domain(dvd_reader_t *dvd, int title_set, dvd_read_domain_t domain) {
+	report_domain_t *d;
+	dvd_stat_t statbuf;
+	GSList *range_list = NULL;
+	int nr_of_sectors = 0;
+	int i;
+
+	if (title_set < 0 || title_set >= MAX_TITLE_SETS || domains[title_set][domain_index(domain)] != NULL) {
+		return;
+	}
+
+	if (DVDFileStat(dvd, title_set, domain, &statbuf) == -1) {
+		return;
+	}
+
+	if ((d = calloc(1, sizeof(report_domain_t))) == NULL) {
+		XLog0(pApp, _("Out of memory creating the coverage report"));
+		return;
+	}
+
+	d->title_set = title_set;
+	d->domain = domain;
+	if (domain == DVD_READ_MENU_VOBS || statbuf.nr_parts < 1) {
+		d->nr_of_parts = 1;
+		d->part_size[0] = statbuf.size / DVD_VIDEO_LB_LEN;
+	} else {
+		d->nr_of_parts = statbuf.nr_parts < MAX_VOB_PARTS ? statbuf.nr_parts : MAX_VOB_PARTS;
+		for (i = 0; i < d->nr_of_parts; i++) {
+			d->part_size[i] = statbuf.parts_size[i] / DVD_VIDEO_LB_LEN;
+		}
+	}
+	for (i = 0; i < d->nr_of_parts; i++) {
+		nr_of_sectors += d->part_size[i];
+	}
+
+	d->referenced = sector_bitmap_new(nr_of_sectors);
+	d->reachable = sector_bitmap_new(nr_of_sectors);
+	d->copied = sector_bitmap_new(nr_of_sectors);
+	d->padded = sector_bitmap_new(nr_of_sectors);
+	d->skipped = sector_bitmap_new(nr_of_sectors);
+	if (!d->referenced || !d->reachable || !d->copied || !d->padded || !d->skipped) {
+		XLog0(pApp, _("Out of memory creating the coverage report"));
+		report_free_domain(d);
+		return;
+	}
+
+	create_domain_range_list(dvd, title_set, domain, &range_list);
+	sector_bitmap_add_range_list(d->referenced, range_list);
+	free_sector_range_list(range_list);
+
+	/* the same simulation -r u goes by */
+	range_list = NULL;
+	if (domain == DVD_READ_MENU_VOBS) {
+		create_menu_range_list(dvd, title_set, &range_list);
+	} else {
+		create_titleset_range_list(dvd, title_set, &range_list);
+	}
+	sector_bitmap_add_range_list(d->reachable, range_list);
+	free_sector_range_list(range_list);
+
+	if (domain == DVD_READ_TITLE_VOBS) {
+		report_open_titles(dvd, d, nr_of_sectors);
+	}
+
+	domains[title_set][domain_index(domain)] = d;
+}
+
+
+/* record what the copy loop did with count sectors starting at offset */
+void report_add(int title_set, dvd_read_domain_t domain, int offset, int count, report_status_t status) {
+	report_domain_t *d;
+
+	if (count <= 0 || title_set < 0 || title_set >= MAX_TITLE_SETS) {
+		return;
+	}
+	if ((d = domains[title_set][domain_index(domain)]) == NULL) {
+		return;
+	}
+
+	switch (status) {
+	case REPORT_COPIED:
+		sector_bitmap_set_range(d->copied, offset, offset + count - 1);
+		break;
+	case REPORT_PADDED:
+		sector_bitmap_set_range(d->padded, offset, offset + count - 1);
+		break;
+	case REPORT_SKIPPED:
+		sector_bitmap_set_range(d->skipped, offset, offset + count - 1);
+		break;
+	}
+}
+
+
+/* sectors from start to end set in both a and b, using tmp */
+static long long report_count_both(sector_bitmap *tmp, const sector_bitmap *a, const sector_bitmap *b, int start, int end) {
+	memset(tmp->words, 0, tmp->nr_of_words * sizeof(uint64_t));
+	sector_bitmap_union(tmp, a);
+	sector_bitmap_intersect(tmp, b);
+	return sector_bitmap_count(tmp, start, end);
+}
+
+
+static void report_count(report_domain_t *d, const sector_bitmap *mask, int start, int end, report_counts_t *counts) {
+	sector_bitmap *tmp;
+
+	memset(counts, 0, sizeof(*counts));
+	if (end < start) {
+		return;
+	}
+	counts->sectors = end - start + 1;
+
+	if (mask == NULL) {
+		counts->referenced = sector_bitmap_count(d->referenced, start, end);
+		counts->reachable = sector_bitmap_count(d->reachable, start, end);
+		counts->copied = sector_bitmap_count(d->copied, start, end);
+		counts->padded = sector_bitmap_count(d->padded, start, end);
+		counts->skipped = sector_bitmap_count(d->skipped, start, end);
+		return;
+	}
+
+	/* restricted to the sectors of one title */
+	counts->referenced = sector_bitmap_count(mask, start, end);
+	if ((tmp = sector_bitmap_new(mask->nr_of_sectors)) == NULL) {
+		return;
+	}
+	counts->reachable = report_count_both(tmp, mask, d->reachable, start, end);
+	counts->copied = report_count_both(tmp, mask, d->copied, start, end);
+	counts->padded = report_count_both(tmp, mask, d->padded, start, end);
+	counts->skipped = report_count_both(tmp, mask, d->skipped, start, end);
+	sector_bitmap_free(tmp);
+}
+
+
+static void report_sum(report_counts_t *total, const report_counts_t *counts) {
+	total->sectors += counts->sectors;
+	total->referenced += counts->referenced;
+	total->reachable += counts->reachable;
+	total->copied += counts->copied;
+	total->padded += counts->padded;
+	total->skipped += counts->skipped;
+}
+
+
+static void report_vob_name(const report_domain_t *d, int part, char *name, size_t length) {
+	if (d->title_set == 0) {
+		snprintf(name, length, "VIDEO_TS.VOB");
+	} else if (d->domain == DVD_READ_MENU_VOBS) {
+		snprintf(name, length, "VTS_%02i_0.VOB", d->title_set);
+	} else {
+		snprintf(name, length, "VTS_%02i_%i.VOB", d->title_set, part + 1);
+	}
+}
+
+
+static double percent(long long part, long long whole) {
+	return whole > 0 ? 100.0 * (double)part / (double)whole : 0.0;
+}
+
+
+static void report_text_counts(FILE *stream, const char *label, const report_counts_t *c) {
+	fprintf(stream, "  %-14s %10lld %10lld %6.1f%% %10lld %10lld %10lld %10lld %6.1f%%\n",
+			label, c->sectors, c->referenced, percent(c->referenced, c->sectors),
+			c->reachable, c->copied, c->padded, c->skipped,
+			percent(c->sectors - c->referenced, c->sectors));
+}
+
+
+static void report_json_counts(FILE *stream, const report_counts_t *c) {
+	fprintf(stream, "\"sectors\": %lld, \"referenced\": %lld, \"reachable\": %lld, \"copied\": %lld, \"padded\": %lld, \"skipped\": %lld, \"unreferenced\": %lld",
+			c->sectors, c->referenced, c->reachable, c->copied, c->padded, c->skipped, c->sectors - c->referenced);
+}
+
+
+int report_write(const char *filename, report_format_t format) {
+	FILE *stream;
+	report_domain_t *d;
+	report_counts_t counts, set_total, total;
+	char name[16];
+	int title_set, j, part, start;
+	int first_set = 1, first;
+
+	if ((stream = fopen(filename, "w")) == NULL) {
+		XLog0(pApp, _("Error creating %s"), filename);
+		return 1;
+	}
+
+	memset(&total, 0, sizeof(total));
+
+	if (format == REPORT_FORMAT_JSON) {
+		fprintf(stream, "{\n  \"sector_size\": %d,\n  \"title_sets\": [", DVD_VIDEO_LB_LEN);
+	} else {
+		fprintf(stream, _("Sector coverage report (sectors of %d bytes)\n"), DVD_VIDEO_LB_LEN);
+		/* TRANSLATORS: column headings of the coverage report; keep the widths */
+		fprintf(stream, _("  %-14s %10s %10s %7s %10s %10s %10s %10s %7s\n"),
+				_("file"), _("sectors"), _("referenced"), "", _("reachable"), _("copied"), _("padded"), _("skipped"), _("unused"));
+	}
+
+	for (title_set = 0; title_set < MAX_TITLE_SETS; title_set++) {
+		if (domains[title_set][0] == NULL && domains[title_set][1] == NULL) {
+			continue;
+		}
+
+		memset(&set_total, 0, sizeof(set_total));
+
+		if (format == REPORT_FORMAT_JSON) {
+			fprintf(stream, "%s\n    { \"title_set\": %d,\n      \"vobs\": [", first_set ? "" : ",", title_set);
+		} else {
+			fprintf(stream, _("Title set %d\n"), title_set);
+		}
+		first_set = 0;
+
+		/* per VOB file */
+		first = 1;
+		for (j = 0; j < 2; j++) {
+			if ((d = domains[title_set][j]) == NULL) {
+				continue;
+			}
+			start = 0;
+			for (part = 0; part < d->nr_of_parts; part++) {
+				report_vob_name(d, part, name, sizeof(name));
+				report_count(d, NULL, start, start + d->part_size[part] - 1, &counts);
+				report_sum(&set_total, &counts);
+				if (format == REPORT_FORMAT_JSON) {
+					fprintf(stream, "%s\n        { \"file\": \"%s\", ", first ? "" : ",", name);
+					report_json_counts(stream, &counts);
+					fprintf(stream, " }");
+				} else {
+					report_text_counts(stream, name, &counts);
+				}
+				first = 0;
+				start += d->part_size[part];
+			}
+		}
+
+		/* per title, over the span of its cells */
+		if (format == REPORT_FORMAT_JSON) {
+			fprintf(stream, "\n      ],\n      \"titles\": [");
+		}
+		first = 1;
+		if ((d = domains[title_set][1]) != NULL) {
+			for (j = 0; j < d->nr_of_titles; j++) {
+				report_count(d, d->titles[j].referenced, d->titles[j].first, d->titles[j].last, &counts);
+				if (format == REPORT_FORMAT_JSON) {
+					fprintf(stream, "%s\n        { \"title\": %d, ", first ? "" : ",", d->titles[j].title);
+					report_json_counts(stream, &counts);
+					fprintf(stream, " }");
+				} else {
+					snprintf(name, sizeof(name), _("title %d"), d->titles[j].title);
+					report_text_counts(stream, name, &counts);
+				}
+				first = 0;
+			}
+		}
+
+		if (format == REPORT_FORMAT_JSON) {
+			fprintf(stream, "\n      ],\n      \"total\": { ");
+			report_json_counts(stream, &set_total);
+			fprintf(stream, " } }");
+		} else {
+			report_text_counts(stream, _("total"), &set_total);
+		}
+		report_sum(&total, &set_total);
+	}
+
+	if (format == REPORT_FORMAT_JSON) {
+		fprintf(stream, "\n  ],\n  \"total\": { ");
+		report_json_counts(stream, &total);
+		fprintf(stream, " }\n}\n");
+	} else {
+		fprintf(stream, _("All copied files\n"));
+		report_text_counts(stream, _("total"), &total);
+	}
+
+	if (fclose(stream) != 0) {
+		XLog0(pApp, _("Error writing %s"), filename);
+		return 1;
+	}
+
+	return 0;
+}
+
+
+void report_free(void) {
+	int i;
+
+	for (i = 0; i < MAX_TITLE_SETS; i++) {
+		report_free_domain(domains[i][0]);
+		report_free_domain(domains[i][1]);
+		domains[i][0] = domains[i][1] = NULL;
+	}
+}
@@ -0,0 +1,24 @@
+#ifndef REPORT_H_
+#define REPORT_H_
+
+#include <dvdread/dvd_reader.h>
+
+typedef enum {
+	REPORT_COPIED,
+	REPORT_PADDED,
+	REPORT_SKIPPED
+} report_status_t;
+
+typedef enum {
+	REPORT_FORMAT_TEXT,
+	REPORT_FORMAT_JSON
+} report_format_t;
+
+extern int report;
+
+void report_open_domain(dvd_reader_t *dvd, int title_set, dvd_read_domain_t domain);
+void report_add(int title_set, dvd_read_domain_t domain, int offset, int count, report_status_t status);
+int report_write(const char *filename, report_format_t format);
+void report_free(void);
+
+#endif /* REPORT_H_ */
@@ -0,0 +1,247 @@
+/* sector-bitmap.c.
+ Compact reachability map of a DVD domain at one bit per sector. It is built from the range lists of find-sector.c and answers the same queries as find_next_sectors, but with word wide (and, where available, SIMD wide) scans instead of walking the list, so the copy loop does not slow down with the number of ranges.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <glib.h>
+
+#include <dvdread/dvd_reader.h>
+
+#include "find-sector.h"
+#include "sector-bitmap.h"
+
+#define WORD_BITS 64
+
+sector_bitmap *sector_bitmap_new(int nr_of_sectors)
+{
+	sector_bitmap *bitmap;
+
+	if(nr_of_sectors < 0)
+		return NULL;
+
+	bitmap = malloc(sizeof(sector_bitmap));
+	if(bitmap == NULL)
+		return NULL;
+
+	bitmap->nr_of_sectors = nr_of_sectors;
+	/* round up to a pair of words so the SIMD scan never needs a tail */
+	bitmap->nr_of_words = ((nr_of_sectors + 2 * WORD_BITS - 1) / (2 * WORD_BITS)) * 2;
+	bitmap->words = calloc(bitmap->nr_of_words ? bitmap->nr_of_words : 2, sizeof(uint64_t));
+	if(bitmap->words == NULL)
+	{
+		free(bitmap);
+		return NULL;
+	}
+
+	return bitmap;
+}
+
+void sector_bitmap_free(sector_bitmap *bitmap)
+{
+	if(bitmap == NULL)
+		return;
+
+	free(bitmap->words);
+	free(bitmap);
+}
+
+/* set all bits from start to end inclusive, clipped to the size of the bitmap */
+void sector_bitmap_set_range(sector_bitmap *bitmap, int start, int end)
+{
+	int first_word, last_word, i;
+	uint64_t first_mask, last_mask;
+
+	if(start < 0)
+		start = 0;
+	if(end >= bitmap->nr_of_sectors)
+		end = bitmap->nr_of_sectors - 1;
+	if(start > end)
+		return;
+
+	first_word = start / WORD_BITS;
+	last_word = end / WORD_BITS;
+	first_mask = ~UINT64_C(0) << (start % WORD_BITS);
+	last_mask = ~UINT64_C(0) >> (WORD_BITS - 1 - end % WORD_BITS);
+
+	if(first_word == last_word)
+	{
+		bitmap->words[first_word] |= first_mask & last_mask;
+		return;
+	}
+
+	bitmap->words[first_word] |= first_mask;
+	for(i = first_word + 1; i < last_word; i++)
+		bitmap->words[i] = ~UINT64_C(0);
+	bitmap->words[last_word] |= last_mask;
+}
+
+void sector_bitmap_add_range_list(sector_bitmap *bitmap, GSList *range_list)
+{
+	GSList *node;
+
+	for(node = range_list; node != NULL; node = g_slist_next(node))
+		sector_bitmap_set_range(bitmap, ((sector_range *)(node->data))->start, ((sector_range *)(node->data))->end);
+}
+
+int sector_bitmap_test(const sector_bitmap *bitmap, int sector)
+{
+	if(sector < 0 || sector >= bitmap->nr_of_sectors)
+		return 0;
+
+	return (bitmap->words[sector / WORD_BITS] >> (sector % WORD_BITS)) & 1;
+}
+
+/* Return the index of the first word from word to before end whose bits are
+ * not all equal to skip (0 or ~0), or end if there is none. end is even or
+ * nr_of_words. */
+static int find_word(const sector_bitmap *bitmap, int word, int end, uint64_t skip)
+{
+#ifdef __SSE2__
+	__m128i pattern = _mm_set1_epi32((int)(uint32_t)skip);
+
+	/* align to a pair of words, then compare 128 bits at a time */
+	if(word % 2 != 0 && word < end)
+	{
+		if(bitmap->words[word] != skip)
+			return word;
+		word++;
+	}
+	for(; word < end; word += 2)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(bitmap->words + word));
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(v, pattern)) != 0xFFFF)
+			return bitmap->words[word] != skip ? word : word + 1;
+	}
+#else
+	for(; word < end; word++)
+	{
+		if(bitmap->words[word] != skip)
+			return word;
+	}
+#endif
+	return end;
+}
+
+/* Return the first sector at or after offset whose bit equals value, or
+ * nr_of_sectors if there is none. The scan may stop early at any sector at or
+ * beyond limit, which is then returned. */
+static int find_bit(const sector_bitmap *bitmap, int offset, int value, int limit)
+{
+	uint64_t skip = value ? 0 : ~UINT64_C(0);
+	int word = offset / WORD_BITS;
+	/* a whole pair of words past limit keeps the SIMD loop aligned */
+	int end = limit >= bitmap->nr_of_sectors ? bitmap->nr_of_words
+		: ((limit / WORD_BITS + 2) & ~1);
+	uint64_t bits;
+	int sector;
+
+	if(offset >= bitmap->nr_of_sectors)
+		return bitmap->nr_of_sectors;
+	if(end > bitmap->nr_of_words)
+		end = bitmap->nr_of_words;
+
+	/* look at the rest of the first word */
+	bits = (bitmap->words[word] ^ skip) & (~UINT64_C(0) << (offset % WORD_BITS));
+	if(bits == 0)
+	{
+		word = find_word(bitmap, word + 1, end, skip);
+		if(word >= end)
+			return end >= bitmap->nr_of_words ? bitmap->nr_of_sectors : end * WORD_BITS;
+		bits = bitmap->words[word] ^ skip;
+	}
+
+	sector = word * WORD_BITS + __builtin_ctzll(bits);
+	return sector < bitmap->nr_of_sectors ? sector : bitmap->nr_of_sectors;
+}
+
+/* Same contract as find_next_sectors: starting at offset, return the count of
+ * consecutive referenced sectors, or the count until the next referenced
+ * sector as a negative number, or -INT_MAX if no referenced sectors remain.
+ * Positive counts stop at max, so a copy loop asking for at most max sectors
+ * only pays for the bits it is going to use. */
+int sector_bitmap_next_run(const sector_bitmap *bitmap, int offset, int max)
+{
+	int next;
+
+	if(offset < 0)
+		offset = 0;
+
+	if(sector_bitmap_test(bitmap, offset))
+	{
+		int limit = offset + max;
+		if(max <= 0 || limit > bitmap->nr_of_sectors || limit < offset)
+			limit = bitmap->nr_of_sectors;
+		next = find_bit(bitmap, offset, 0, limit);
+		return (next < limit ? next : limit) - offset;
+	}
+
+	next = find_bit(bitmap, offset, 1, bitmap->nr_of_sectors);
+	if(next >= bitmap->nr_of_sectors)
+		return -INT_MAX;
+
+	return offset - next;
+}
+
+/* number of referenced sectors from start to end inclusive */
+int sector_bitmap_count(const sector_bitmap *bitmap, int start, int end)
+{
+	int first_word, last_word, i;
+	uint64_t first_mask, last_mask;
+	int count = 0;
+
+	if(start < 0)
+		start = 0;
+	if(end >= bitmap->nr_of_sectors)
+		end = bitmap->nr_of_sectors - 1;
+	if(start > end)
+		return 0;
+
+	first_word = start / WORD_BITS;
+	last_word = end / WORD_BITS;
+	first_mask = ~UINT64_C(0) << (start % WORD_BITS);
+	last_mask = ~UINT64_C(0) >> (WORD_BITS - 1 - end % WORD_BITS);
+
+	if(first_word == last_word)
+		return __builtin_popcountll(bitmap->words[first_word] & first_mask & last_mask);
+
+	count += __builtin_popcountll(bitmap->words[first_word] & first_mask);
+	for(i = first_word + 1; i < last_word; i++)
+		count += __builtin_popcountll(bitmap->words[i]);
+	count += __builtin_popcountll(bitmap->words[last_word] & last_mask);
+
+	return count;
+}
+
+/* dst |= src over the sectors both bitmaps have in common */
+void sector_bitmap_union(sector_bitmap *dst, const sector_bitmap *src)
+{
+	int i;
+	int n = dst->nr_of_words < src->nr_of_words ? dst->nr_of_words : src->nr_of_words;
+
+	for(i = 0; i < n; i++)
+		dst->words[i] |= src->words[i];
+
+	/* bits beyond the end of dst must stay clear */
+	if(dst->nr_of_sectors % WORD_BITS != 0 && dst->nr_of_sectors / WORD_BITS < n)
+		dst->words[dst->nr_of_sectors / WORD_BITS] &= ~(~UINT64_C(0) << (dst->nr_of_sectors % WORD_BITS));
+	for(i = (dst->nr_of_sectors + WORD_BITS - 1) / WORD_BITS; i < n; i++)
+		dst->words[i] = 0;
+}
+
+/* dst &= src; sectors beyond the end of src are treated as unreferenced */
+void sector_bitmap_intersect(sector_bitmap *dst, const sector_bitmap *src)
+{
+	int i;
+
+	for(i = 0; i < dst->nr_of_words; i++)
+		dst->words[i] &= i < src->nr_of_words ? src->words[i] : 0;
+}
@@ -0,0 +1,26 @@
+#ifndef SECTOR_BITMAP_H
+#define SECTOR_BITMAP_H
+
+#include <stdint.h>
+#include <glib.h>
+
+/* One bit per 2 KiB sector of a domain (menu or title VOBs), set if the
+ * sector is referenced. A single layer disc needs about 290 KiB. */
+typedef struct sector_bitmap
+{
+	int nr_of_sectors;
+	int nr_of_words;
+	uint64_t *words;
+} sector_bitmap;
+
+sector_bitmap *sector_bitmap_new(int nr_of_sectors);
+void sector_bitmap_free(sector_bitmap *bitmap);
+void sector_bitmap_set_range(sector_bitmap *bitmap, int start, int end);
+void sector_bitmap_add_range_list(sector_bitmap *bitmap, GSList *range_list);
+int sector_bitmap_test(const sector_bitmap *bitmap, int sector);
+int sector_bitmap_next_run(const sector_bitmap *bitmap, int offset, int max);
+int sector_bitmap_count(const sector_bitmap *bitmap, int start, int end);
+void sector_bitmap_union(sector_bitmap *dst, const sector_bitmap *src);
+void sector_bitmap_intersect(sector_bitmap *dst, const sector_bitmap *src);
+
+#endif
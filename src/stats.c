@@ -0,0 +1,308 @@
+/*
+ * dvdbackup - tool to rip DVDs from the command line
+ *
+ * Live statistics in a POSIX shared memory segment, see stats.h and
+ * dvdbackup-stat.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+/* C standard libraries */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* POSIX */
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/* internationalisation */
+#include "gettext.h"
+#define _(String) gettext(String)
+
+#include "stats.h"
+
+static dvdbackup_stats_t fallback;
+dvdbackup_stats_t *stats = &fallback;
+
+static char shm_name[32];
+
+/* for the wall time in the summary */
+static struct timespec start_time;
+
+/* innermost running phase timer */
+static stats_timer_t *current_timer = NULL;
+
+static const char *phase_names[STATS_NR_OF_PHASES] = {
+	"open", "ifo", "vm", "read", "write", "recovery"
+};
+
+/* held while the segment is swapped out, so stats_snapshot never reads an
+ * unmapped page */
+static pthread_mutex_t swap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const uint64_t stats_bucket_us[STATS_NR_OF_BUCKETS - 1] = {
+	100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+	100000, 250000, 500000, 1000000, 2500000, 5000000
+};
+
+static void stats_unlink(void) {
+	dvdbackup_stats_t *s = stats;
+
+	if (s != &fallback) {
+		/* keep the final counts for whoever reads them after us */
+		pthread_mutex_lock(&swap_lock);
+		memcpy(&fallback, s, sizeof(dvdbackup_stats_t));
+		stats = &fallback;
+		pthread_mutex_unlock(&swap_lock);
+
+		munmap(s, sizeof(dvdbackup_stats_t));
+		shm_unlink(shm_name);
+	}
+}
+
+static int stats_bucket(long us) {
+	int i;
+
+	for (i = 0; i < STATS_NR_OF_BUCKETS - 1; i++) {
+		if ((uint64_t)us <= stats_bucket_us[i]) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+/* Create and map the segment for this process. On failure the counters
+ * stay private and 1 is returned. */
+int stats_open(const char *device) {
+	dvdbackup_stats_t *s;
+	int fd;
+
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+	snprintf(shm_name, sizeof(shm_name), STATS_SHM_PREFIX "%d", (int)getpid());
+
+	fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd == -1 && errno == EEXIST) {
+		/* left behind by an earlier process with the same pid */
+		shm_unlink(shm_name);
+		fd = shm_open(shm_name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	}
+	if (fd == -1) {
+		return 1;
+	}
+
+	if (ftruncate(fd, sizeof(dvdbackup_stats_t)) != 0) {
+		close(fd);
+		shm_unlink(shm_name);
+		return 1;
+	}
+
+	s = mmap(NULL, sizeof(dvdbackup_stats_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (s == MAP_FAILED) {
+		shm_unlink(shm_name);
+		return 1;
+	}
+
+	/* keep whatever was counted before */
+	memcpy(s, &fallback, sizeof(dvdbackup_stats_t));
+	s->version = STATS_VERSION;
+	s->size = sizeof(dvdbackup_stats_t);
+	s->pid = getpid();
+	s->started = time(NULL);
+	snprintf(s->device, sizeof(s->device), "%s", device);
+	__atomic_store_n(&s->magic, STATS_MAGIC, __ATOMIC_RELEASE);
+
+	stats = s;
+	atexit(stats_unlink);
+	return 0;
+}
+
+void stats_set_disc(const char *disc) {
+	snprintf(stats->disc, sizeof(stats->disc), "%s", disc);
+}
+
+void stats_read_latency(long us) {
+	STATS_ADD(read_hist[stats_bucket(us)], 1);
+	STATS_ADD(read_sum_us, us);
+}
+
+void stats_write_latency(long us) {
+	STATS_ADD(write_hist[stats_bucket(us)], 1);
+	STATS_ADD(write_sum_us, us);
+}
+
+static uint64_t stats_elapsed_us(const struct timespec *start) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000LL + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+void stats_timer_start(stats_timer_t *timer) {
+	clock_gettime(CLOCK_MONOTONIC, &timer->start);
+	timer->inner_us = 0;
+	timer->outer = current_timer;
+	current_timer = timer;
+}
+
+/* Charge the time since stats_timer_start, less that of inner phases, to
+ * phase. Returns the whole time. */
+uint64_t stats_timer_stop(stats_timer_t *timer, stats_phase_t phase) {
+	uint64_t us = stats_elapsed_us(&timer->start);
+
+	current_timer = timer->outer;
+	if (current_timer != NULL) {
+		current_timer->inner_us += us;
+	}
+	STATS_ADD(phase_us[phase], us > timer->inner_us ? us - timer->inner_us : 0);
+	STATS_ADD(phase_calls[phase], 1);
+
+	return us;
+}
+
+/* Charge time measured elsewhere, e.g. a timed read, to phase. */
+void stats_phase_add(stats_phase_t phase, uint64_t us) {
+	if (current_timer != NULL) {
+		current_timer->inner_us += us;
+	}
+	STATS_ADD(phase_us[phase], us);
+	STATS_ADD(phase_calls[phase], 1);
+}
+
+/* Copy the counters for a thread other than the one doing the copy. */
+void stats_snapshot(dvdbackup_stats_t *copy) {
+	pthread_mutex_lock(&swap_lock);
+	memcpy(copy, stats, sizeof(dvdbackup_stats_t));
+	pthread_mutex_unlock(&swap_lock);
+}
+
+/* Record how the job ended and remove the segment; the counters stay
+ * readable through stats. */
+void stats_close(int ok) {
+	STATS_SET(state, ok ? STATS_STATE_DONE : STATS_STATE_FAILED);
+	stats_unlink();
+}
+
+
+static uint64_t stats_calls(const uint64_t *hist) {
+	uint64_t calls = 0;
+	int i;
+
+	for (i = 0; i < STATS_NR_OF_BUCKETS; i++) {
+		calls += hist[i];
+	}
+
+	return calls;
+}
+
+static double seconds(const struct timeval *tv) {
+	return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+/* Print the counters, phase times and resource usage to stderr (--stats). */
+void stats_summary(void) {
+	struct rusage usage;
+	int i;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	fprintf(stderr, _("Statistics\n"));
+	fprintf(stderr, _("  wall time          %10.3f s\n"), stats_elapsed_us(&start_time) / 1e6);
+	fprintf(stderr, _("  CPU time           %10.3f s user, %.3f s system\n"),
+			seconds(&usage.ru_utime), seconds(&usage.ru_stime));
+	fprintf(stderr, _("  maximum resident   %10ld KiB\n"), usage.ru_maxrss);
+	fprintf(stderr, _("  page faults        %10ld major, %ld minor\n"), usage.ru_majflt, usage.ru_minflt);
+	fprintf(stderr, _("  block operations   %10ld in, %ld out\n"), usage.ru_inblock, usage.ru_oublock);
+	fprintf(stderr, _("  context switches   %10ld voluntary, %ld involuntary\n"), usage.ru_nvcsw, usage.ru_nivcsw);
+	fprintf(stderr, _("  read               %10.1f MiB in %" PRIu64 " calls, %" PRIu64 " failed\n"),
+			STATS_GET(stats, bytes_read) / (1024.0 * 1024), stats_calls(stats->read_hist),
+			STATS_GET(stats, read_errors));
+	fprintf(stderr, _("  written            %10.1f MiB in %" PRIu64 " calls\n"),
+			STATS_GET(stats, bytes_written) / (1024.0 * 1024), stats_calls(stats->write_hist));
+	fprintf(stderr, _("  sectors            %10" PRIu64 " padded, %" PRIu64 " skipped, %" PRIu64 " retried\n"),
+			STATS_GET(stats, blocks_padded), STATS_GET(stats, blocks_skipped), STATS_GET(stats, retries));
+	fprintf(stderr, _("  slowest read       %10.3f ms\n"), STATS_GET(stats, max_read_us) / 1e3);
+	fprintf(stderr, _("  read size          %10d KiB, %" PRIu64 " changes between %d and %d KiB\n"),
+			STATS_GET(stats, read_size_blocks) * 2, STATS_GET(stats, read_size_changes),
+			STATS_GET(stats, read_size_min_blocks) * 2, STATS_GET(stats, read_size_max_blocks) * 2);
+	/* TRANSLATORS: column headings of the phase table; keep the widths */
+	fprintf(stderr, _("  %-18s %10s %10s\n"), _("phase"), _("seconds"), _("calls"));
+	for (i = 0; i < STATS_NR_OF_PHASES; i++) {
+		fprintf(stderr, "  %-18s %10.3f %10" PRIu64 "\n", phase_names[i],
+				STATS_GET(stats, phase_us[i]) / 1e6, STATS_GET(stats, phase_calls[i]));
+	}
+}
+
+/* Write the summary as JSON to filename, or to stdout for "-"
+ * (--stats-json). Returns 0 on success. */
+int stats_write_json(const char *filename) {
+	FILE *stream;
+	struct rusage usage;
+	int i;
+
+	if (strcmp(filename, "-") == 0) {
+		stream = stdout;
+	} else if ((stream = fopen(filename, "w")) == NULL) {
+		fprintf(stderr, _("Error creating %s\n"), filename);
+		return 1;
+	}
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	fprintf(stream, "{\n  \"wall_s\": %.6f,\n", stats_elapsed_us(&start_time) / 1e6);
+	fprintf(stream, "  \"user_s\": %.6f,\n  \"system_s\": %.6f,\n",
+			seconds(&usage.ru_utime), seconds(&usage.ru_stime));
+	fprintf(stream, "  \"max_rss_kib\": %ld,\n", usage.ru_maxrss);
+	fprintf(stream, "  \"major_faults\": %ld,\n  \"minor_faults\": %ld,\n", usage.ru_majflt, usage.ru_minflt);
+	fprintf(stream, "  \"block_in\": %ld,\n  \"block_out\": %ld,\n", usage.ru_inblock, usage.ru_oublock);
+	fprintf(stream, "  \"voluntary_switches\": %ld,\n  \"involuntary_switches\": %ld,\n",
+			usage.ru_nvcsw, usage.ru_nivcsw);
+	fprintf(stream, "  \"bytes_read\": %" PRIu64 ",\n  \"read_calls\": %" PRIu64 ",\n  \"read_errors\": %" PRIu64 ",\n",
+			STATS_GET(stats, bytes_read), stats_calls(stats->read_hist), STATS_GET(stats, read_errors));
+	fprintf(stream, "  \"bytes_written\": %" PRIu64 ",\n  \"write_calls\": %" PRIu64 ",\n",
+			STATS_GET(stats, bytes_written), stats_calls(stats->write_hist));
+	fprintf(stream, "  \"blocks_padded\": %" PRIu64 ",\n  \"blocks_skipped\": %" PRIu64 ",\n  \"retries\": %" PRIu64 ",\n",
+			STATS_GET(stats, blocks_padded), STATS_GET(stats, blocks_skipped), STATS_GET(stats, retries));
+	fprintf(stream, "  \"read_size_kib\": %d,\n  \"read_size_changes\": %" PRIu64 ",\n",
+			STATS_GET(stats, read_size_blocks) * 2, STATS_GET(stats, read_size_changes));
+	fprintf(stream, "  \"read_size_min_kib\": %d,\n  \"read_size_max_kib\": %d,\n",
+			STATS_GET(stats, read_size_min_blocks) * 2, STATS_GET(stats, read_size_max_blocks) * 2);
+	fprintf(stream, "  \"max_read_us\": %" PRIu64 ",\n  \"phases\": {", STATS_GET(stats, max_read_us));
+	for (i = 0; i < STATS_NR_OF_PHASES; i++) {
+		fprintf(stream, "%s\n    \"%s\": { \"us\": %" PRIu64 ", \"calls\": %" PRIu64 " }",
+				i > 0 ? "," : "", phase_names[i],
+				STATS_GET(stats, phase_us[i]), STATS_GET(stats, phase_calls[i]));
+	}
+	fprintf(stream, "\n  }\n}\n");
+
+	if (stream == stdout) {
+		return fflush(stream) != 0;
+	}
+	if (fclose(stream) != 0) {
+		fprintf(stderr, _("Error writing %s\n"), filename);
+		return 1;
+	}
+
+	return 0;
+}
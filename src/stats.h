@@ -0,0 +1,103 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/* segments are named STATS_SHM_PREFIX<pid> */
+#define STATS_SHM_PREFIX "/dvdbackup-"
+#define STATS_MAGIC 0x44564442u
+#define STATS_VERSION 1
+
+typedef enum {
+	STATS_PHASE_OPEN,	/* opening the device */
+	STATS_PHASE_IFO,	/* reading and writing IFO and BUP files */
+	STATS_PHASE_VM,		/* simulating the VM for -r u and --compact */
+	STATS_PHASE_READ,
+	STATS_PHASE_WRITE,
+	STATS_PHASE_RECOVERY,	/* failed reads and padding */
+	STATS_NR_OF_PHASES
+} stats_phase_t;
+
+/* upper bounds of the latency histogram buckets, the last one is +Inf */
+#define STATS_NR_OF_BUCKETS 16
+extern const uint64_t stats_bucket_us[STATS_NR_OF_BUCKETS - 1];
+
+typedef enum {
+	STATS_STATE_STARTING,
+	STATS_STATE_COPYING,
+	STATS_STATE_DONE,
+	STATS_STATE_FAILED
+} stats_state_t;
+
+/*
+ * Layout of the shared memory segment every running dvdbackup publishes.
+ * The copy loop updates it with relaxed atomic stores, so readers see each
+ * counter whole but not all of them from the same instant. Readers check
+ * magic, version and size; new fields only ever go at the end.
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	int32_t pid;
+	int64_t started;		/* seconds since the epoch */
+	char device[128];
+	char disc[40];
+	int32_t state;
+	int32_t title_set;
+	int32_t menu;			/* 1 while copying menu VOBs */
+	int32_t vob;
+	int64_t lba;			/* in blocks from the start of the domain */
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	uint64_t read_errors;
+	uint64_t blocks_padded;
+	uint64_t blocks_skipped;
+	uint64_t retries;
+	uint64_t last_read_us;
+	uint64_t max_read_us;
+	uint64_t phase_us[STATS_NR_OF_PHASES];
+	uint64_t read_hist[STATS_NR_OF_BUCKETS];	/* DVDReadBlocks calls per bucket */
+	uint64_t read_sum_us;
+	uint64_t write_hist[STATS_NR_OF_BUCKETS];
+	uint64_t write_sum_us;
+	uint64_t phase_calls[STATS_NR_OF_PHASES];
+	int32_t read_size_blocks;	/* blocks asked for per read, see chunk.c */
+	int32_t read_size_min_blocks;
+	int32_t read_size_max_blocks;
+	uint64_t read_size_changes;
+} dvdbackup_stats_t;
+
+/*
+ * Times one phase from stats_timer_start to stats_timer_stop. Timers may
+ * nest but must be stopped in reverse order, on every path out; time spent
+ * in an inner timer, or passed to stats_phase_add meanwhile, is counted
+ * only there.
+ */
+typedef struct stats_timer {
+	struct timespec start;
+	uint64_t inner_us;
+	struct stats_timer *outer;
+} stats_timer_t;
+
+/* never NULL; points to private memory if the segment could not be made */
+extern dvdbackup_stats_t *stats;
+
+#define STATS_ADD(field, n) __atomic_fetch_add(&stats->field, (n), __ATOMIC_RELAXED)
+#define STATS_SET(field, v) __atomic_store_n(&stats->field, (v), __ATOMIC_RELAXED)
+#define STATS_GET(s, field) __atomic_load_n(&(s)->field, __ATOMIC_RELAXED)
+
+int stats_open(const char *device);
+void stats_set_disc(const char *disc);
+void stats_read_latency(long us);
+void stats_write_latency(long us);
+void stats_snapshot(dvdbackup_stats_t *copy);
+void stats_timer_start(stats_timer_t *timer);
+uint64_t stats_timer_stop(stats_timer_t *timer, stats_phase_t phase);
+void stats_phase_add(stats_phase_t phase, uint64_t us);
+void stats_close(int ok);
+void stats_summary(void);
+int stats_write_json(const char *filename);
+
+#endif /* STATS_H_ */
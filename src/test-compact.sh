@@ -0,0 +1,35 @@
+#!/bin/sh
+#
+# test-compact.sh - a --compact mirror must leave out the decoys and keep
+# every cell at the address its rewritten IFO gives
+#
+# Run by make check, which sets DVDBACKUP, MKFIXTURE and CHECK_COMPACT; see
+# check-compact.c for what is compared.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+set -e
+. "${srcdir:-.}/test-lib.sh"
+
+"$mkfixture" -s 3 -T 2 -t 2 -c 6 -a 2 -d 6 "$work/disc" >/dev/null
+"$dvdbackup" -i "$work/disc" -o "$work/out" -n TEST -M --compact \
+	--stats-json="$work/stats.json" </dev/null
+
+skipped=$(json_field "$work/stats.json" blocks_skipped)
+if [ "$skipped" -eq 0 ]; then
+	echo "--compact left out nothing" >&2
+	exit 1
+fi
+
+"$check_compact" "$work/disc" "$work/out/TEST"
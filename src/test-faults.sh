@@ -0,0 +1,56 @@
+#!/bin/sh
+#
+# test-faults.sh - each -r strategy against the faults of --fault-script
+#
+# Run by make check, which sets DVDBACKUP and MKFIXTURE.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+set -e
+. "${srcdir:-.}/test-lib.sh"
+
+"$mkfixture" -s 5 -T 1 -t 2 -c 4 -d 0 "$work/disc" >/dev/null
+
+echo "bad 1/title:300-309" > "$work/block.faults"
+cp "$work/block.faults" "$work/multiblock.faults"
+cp "$work/block.faults" "$work/abort.faults"
+echo "flaky 1/title:300-309 1" > "$work/flaky.faults"
+echo "bad 1/title:300-309 10" > "$work/trailing.faults"
+
+# skipping single blocks pads exactly the damage
+copy block -r b
+padded block 10 10
+only_damage block 300 309
+
+# skipping multiple blocks pads at most one smallest read either side
+copy multiblock -r m
+padded multiblock 10 64
+only_damage multiblock 300 309
+
+# aborting fails the copy
+if copy abort -r a 2>/dev/null; then
+	echo "abort: the copy did not fail" >&2
+	exit 1
+fi
+
+# a read that works when tried again loses nothing
+copy flaky -r b
+padded flaky 0 0
+only_damage flaky 300 309
+
+# and a line with anything after the fault is refused
+if copy trailing -r b 2>/dev/null; then
+	echo "trailing: the fault script was not refused" >&2
+	exit 1
+fi
@@ -0,0 +1,70 @@
+# test-lib.sh - what the test-*.sh scripts share; sourced, not run
+#
+# The programs come from DVDBACKUP, MKFIXTURE and CHECK_COMPACT, as make
+# check sets them. Each script works in a temporary directory, $work, that
+# is removed when it exits.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+dvdbackup=${DVDBACKUP:-./dvdbackup}
+mkfixture=${MKFIXTURE:-./mkfixture}
+check_compact=${CHECK_COMPACT:-./check-compact}
+
+work=$(mktemp -d "${TMPDIR:-/tmp}/dvdbackup-test.XXXXXX")
+trap 'rm -rf "$work"' EXIT
+
+# json_field FILE KEY: a number from the --stats-json output
+json_field() {
+	sed -n "s/^  \"$2\": \([0-9.]*\),*$/\1/p" "$1"
+}
+
+# copy NAME [OPTION]...: mirror $work/disc to $work/NAME with the faults in
+# $work/NAME.faults, keeping the statistics in $work/NAME.json
+copy() {
+	name=$1
+	shift
+	"$dvdbackup" -i "$work/disc" -o "$work/$name" -n TEST -M "$@" \
+		--fault-script="$work/$name.faults" --stats-json="$work/$name.json" </dev/null
+}
+
+# padded NAME MIN MAX: the copy padded MIN to MAX blocks
+padded() {
+	blocks=$(json_field "$work/$1.json" blocks_padded)
+	if [ "$blocks" -lt "$2" ] || [ "$blocks" -gt "$3" ]; then
+		echo "$1: $blocks blocks padded, expected $2 to $3" >&2
+		exit 1
+	fi
+}
+
+# same_size NAME: every file of the copy is as long as on the disc
+same_size() {
+	for file in "$work/disc/VIDEO_TS/"*; do
+		if [ "$(wc -c <"$file")" -ne "$(wc -c <"$work/$1/TEST/VIDEO_TS/${file##*/}")" ]; then
+			echo "$1: ${file##*/} changed size" >&2
+			exit 1
+		fi
+	done
+}
+
+# only_damage NAME FIRST LAST: the copy differs from the disc in blocks
+# FIRST to LAST of a file at most
+only_damage() {
+	same_size "$1"
+	for file in "$work/disc/VIDEO_TS/"*; do
+		cmp -l "$file" "$work/$1/TEST/VIDEO_TS/${file##*/}" | awk -v name="$1" -v first="$2" -v last="$3" '
+			{ block = int(($1 - 1) / 2048) }
+			block < first || block > last { print name ": block " block " differs" > "/dev/stderr"; bad = 1; exit }
+			END { exit bad }' || exit 1
+	done
+}
@@ -0,0 +1,38 @@
+#!/bin/sh
+#
+# test-mirror.sh - a mirror of a generated disc must be the same bytes
+#
+# Run by make check, which sets DVDBACKUP and MKFIXTURE. Title VOBs are split
+# at 1000 blocks so the copy has to cross VOB files, and there are angle
+# blocks and unreferenced decoys, all of which -M copies as they are.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+set -e
+. "${srcdir:-.}/test-lib.sh"
+
+"$mkfixture" -s 7 -T 2 -t 2 -c 4 -a 2 -S 1000 -d 2 "$work/disc" >/dev/null
+"$dvdbackup" -i "$work/disc" -o "$work/out" -n TEST -M </dev/null
+
+for file in "$work/disc/VIDEO_TS/"*; do
+	cmp "$file" "$work/out/TEST/VIDEO_TS/${file##*/}"
+done
+
+# and nothing else
+original=$(ls "$work/disc/VIDEO_TS" | wc -l)
+copy=$(ls "$work/out/TEST/VIDEO_TS" | wc -l)
+if [ "$original" -ne "$copy" ]; then
+	echo "$original files became $copy" >&2
+	exit 1
+fi
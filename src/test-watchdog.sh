@@ -0,0 +1,58 @@
+#!/bin/sh
+#
+# test-watchdog.sh - --read-timeout and --deadline against slow and bad sectors
+#
+# Run by make check, which sets DVDBACKUP and MKFIXTURE.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+set -e
+. "${srcdir:-.}/test-lib.sh"
+
+"$mkfixture" -s 5 -T 1 -t 2 -c 4 -d 0 "$work/disc" >/dev/null
+
+# blocks jumped over after a slow read are filled in at the end of the file
+echo "slow 1/title:300-303 300" > "$work/slow.faults"
+copy slow -r b --read-timeout=100
+padded slow 0 0
+only_damage slow 300 309
+
+# and damage there is still padded block by block
+printf '%s\n' "slow 1/title:300-309 300" "bad 1/title:300-309" > "$work/slowbad.faults"
+copy slowbad -r b --read-timeout=100
+padded slowbad 10 10
+only_damage slowbad 300 309
+
+# with time to spare, damage is padded as -r says but fails the copy
+echo "bad 1/title:300-309" > "$work/bad.faults"
+status=0
+copy bad -r b --deadline=1h || status=$?
+if [ "$status" -ne 3 ]; then
+	echo "bad: exit status $status, expected 3" >&2
+	exit 1
+fi
+padded bad 10 10
+only_damage bad 300 309
+
+# past the deadline the rest of every file is left as a hole; the first
+# title VOB read ends well after it, however loaded the machine
+echo "slow 1/title:0-3 8000" > "$work/late.faults"
+status=0
+copy late -r b --deadline=2 || status=$?
+if [ "$status" -ne 3 ]; then
+	echo "late: exit status $status, expected 3" >&2
+	exit 1
+fi
+padded late 1 1000000
+same_size late